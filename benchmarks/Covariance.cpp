@@ -0,0 +1,406 @@
+// STL includes
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Covariance includes
+#include <Covariance/Covariance4D.hpp>
+#include <Covariance/InvCovariance4D.hpp>
+#include <Covariance/CovarianceBatch4D.hpp>
+using namespace Covariance;
+
+/* Microbenchmark suite of the operators and queries of 'Covariance4D' and
+ * 'InvCovariance4D', in single and double precision, for the scalar types
+ * and the batched paths ('CovarianceBatch4D', with and without the 'Load'
+ * and 'Store' of the lanes from an array of matrices, and the structure of
+ * arrays stream functions).
+ *
+ * Each operator is applied to an array of matrices several times and the
+ * average time per matrix is reported. Invertible operators alternate the
+ * sign of their parameter between repetitions so that the matrices stay
+ * bounded. 'Projection' is timed together with the 'InverseProjection' back
+ * to the incoming direction for the same reason.
+ *
+ * The output is CSV by default and JSON with '--json'. Each line is:
+ *
+ *    representation, precision, path, operator, ns/op, Mop/s
+ *
+ * Usage: BenchCovariance [--json] [--count n] [--reps r]
+ */
+
+struct Vector {
+   double x, y, z;
+   Vector() {}
+   Vector(double x, double y, double z) : x(x), y(y), z(z) {}
+   static double Dot(const Vector& w1, const Vector& w2) {
+      return w1.x*w2.x + w1.y*w2.y + w1.z*w2.z;
+   }
+   static Vector Cross(const Vector& u, const Vector& v) {
+      return Vector(u.y*v.z - u.z*v.y, u.z*v.x - u.x*v.z, u.x*v.y - u.y*v.x);
+   }
+   static void Frame(const Vector& z, Vector& x, Vector& y) {
+      CanonicalBasis(z, x, y);
+   }
+   void Normalize() {
+      const double norm = sqrt(Dot(*this, *this));
+      x /= norm; y /= norm; z /= norm;
+   }
+   friend Vector operator*(double a, const Vector& w) {
+      return Vector(a*w.x, a*w.y, a*w.z);
+   }
+   friend Vector operator+(const Vector& a, const Vector& w) {
+      return Vector(a.x+w.x, a.y+w.y, a.z+w.z);
+   }
+   friend Vector operator-(const Vector& w) {
+      return Vector(-w.x, -w.y, -w.z);
+   }
+};
+
+/* Results and output
+ */
+struct Result {
+   std::string repr, precision, path, op;
+   double ns;
+};
+
+std::vector<Result> results;
+volatile double sink = 0.0;
+int count = 4096;
+int reps  = 200;
+
+template<typename Float> const char* Precision();
+template<> const char* Precision<float>()  { return "float"; }
+template<> const char* Precision<double>() { return "double"; }
+
+/* Time 'reps' calls of 'f', which processes 'count' matrices, and store the
+ * time per matrix. 'f' receives the repetition index.
+ */
+template<class F>
+void Time(const char* repr, const char* precision, const char* path,
+          const char* op, F f) {
+   f(1);
+   const auto start = std::chrono::steady_clock::now();
+   for(int r=0; r<reps; ++r) {
+      f(r);
+   }
+   const auto stop = std::chrono::steady_clock::now();
+   const double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+   results.push_back({ repr, precision, path, op, ns / (double(reps)*count) });
+}
+
+void PrintCSV() {
+   std::cout << "representation,precision,path,operator,ns_per_op,mops_per_s" << std::endl;
+   std::cout << std::fixed << std::setprecision(3);
+   for(const auto& r : results) {
+      std::cout << r.repr << "," << r.precision << "," << r.path << ","
+                << r.op << "," << r.ns << "," << 1.0E3/r.ns << std::endl;
+   }
+}
+
+void PrintJSON() {
+   std::cout << "{\n  \"benchmarks\": [\n";
+   std::cout << std::fixed << std::setprecision(3);
+   for(size_t i=0; i<results.size(); ++i) {
+      const auto& r = results[i];
+      std::cout << "    { \"representation\": \"" << r.repr << "\", "
+                << "\"precision\": \"" << r.precision << "\", "
+                << "\"path\": \"" << r.path << "\", "
+                << "\"operator\": \"" << r.op << "\", "
+                << "\"ns_per_op\": " << r.ns << ", "
+                << "\"mops_per_s\": " << 1.0E3/r.ns << " }"
+                << ((i+1 < results.size()) ? ",\n" : "\n");
+   }
+   std::cout << "  ]\n}" << std::endl;
+}
+
+/* Inputs shared by all benchmarks: random operator parameters and normals
+ * facing the incoming direction Z.
+ */
+struct Inputs {
+   std::vector<double> d, k, c, s, wz, rho;
+   std::vector<Vector> n;
+
+   Inputs() {
+      std::mt19937 gen(0);
+      std::uniform_real_distribution<double> dist(-1.0, 1.0);
+      for(int i=0; i<count; ++i) {
+         const double a = 0.5*dist(gen);
+         d.push_back(1.0 + 0.5*dist(gen));
+         k.push_back(0.5*dist(gen));
+         c.push_back(cos(a));
+         s.push_back(sin(a));
+         wz.push_back(0.5 + 0.4*dist(gen));
+         rho.push_back(5.0 + dist(gen));
+         Vector ni(0.3*dist(gen), 0.3*dist(gen), -1.0);
+         ni.Normalize();
+         n.push_back(ni);
+      }
+   }
+};
+
+const std::array<double, 10> Matrix = { 4.0,
+                                        1.0, 3.0,
+                                        0.5, 0.2, 2.0,
+                                        0.1, 0.3, 0.4, 1.5 };
+
+
+////////////////////////
+//   Scalar classes   //
+////////////////////////
+
+template<class Cov, typename Float>
+void BenchScalar(const char* repr, const Inputs& in) {
+   const char* prec = Precision<Float>();
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+
+   std::array<Float, 10> matrix;
+   for(int i=0; i<10; ++i) { matrix[i] = Matrix[i]; }
+   std::vector<Cov> covs(count, Cov(matrix, x, y, z));
+   auto sign = [](int r) { return (r % 2 == 0) ? Float(1.0) : Float(-1.0); };
+
+   // Operators
+   Time(repr, prec, "scalar", "Travel", [&](int r) {
+      for(int i=0; i<count; ++i) { covs[i].Travel(sign(r)*Float(in.d[i])); }
+   });
+   Time(repr, prec, "scalar", "Curvature", [&](int r) {
+      for(int i=0; i<count; ++i) { covs[i].Curvature(sign(r)*Float(in.k[i]), Float(in.k[i])*sign(r)); }
+   });
+   Time(repr, prec, "scalar", "Rotate", [&](int r) {
+      for(int i=0; i<count; ++i) { covs[i].Rotate(Float(in.c[i]), sign(r)*Float(in.s[i])); }
+   });
+   Time(repr, prec, "scalar", "Symmetry", [&](int) {
+      for(int i=0; i<count; ++i) { covs[i].Symmetry(); }
+   });
+   // The cosine operator is a no-op on the inverse matrix: its loop would
+   // be optimized away and timed at zero.
+   if(!std::is_same<Cov, InvCovariance4D<Vector, Float>>::value) {
+      Time(repr, prec, "scalar", "Cosine", [&](int) {
+         for(int i=0; i<count; ++i) { covs[i].Cosine(Float(in.wz[i])); }
+      });
+   }
+   Time(repr, prec, "scalar", "ProductUV", [&](int) {
+      for(int i=0; i<count; ++i) { covs[i].ProductUV(Float(in.rho[i]), Float(in.rho[i])); }
+   });
+   Time(repr, prec, "scalar", "Reflection", [&](int) {
+      for(int i=0; i<count; ++i) { covs[i].Reflection(Float(in.rho[i]), Float(in.rho[i])); }
+   });
+   for(int i=0; i<count; ++i) { covs[i] = Cov(matrix, x, y, z); }
+   Time(repr, prec, "scalar", "Projection+InverseProjection", [&](int) {
+      for(int i=0; i<count; ++i) {
+         covs[i].Projection(in.n[i]);
+         covs[i].InverseProjection(z);
+      }
+   });
+   Time(repr, prec, "scalar", "Add", [&](int) {
+      for(int i=0; i<count; ++i) { covs[i].Add(covs[(i+1) % count], Float(0.5), Float(0.5)); }
+   });
+
+   // Queries
+   for(int i=0; i<count; ++i) { covs[i] = Cov(matrix, x, y, z); covs[i].Travel(Float(in.d[i])); }
+   Time(repr, prec, "scalar", "InverseMatrix", [&](int) {
+      Float inverse[16], sum = 0.0;
+      for(int i=0; i<count; ++i) { covs[i].TryInverseMatrix(inverse); sum += inverse[0]; }
+      sink = sink + sum;
+   });
+   Time(repr, prec, "scalar", "SpatialFilter", [&](int) {
+      Float sxx, sxy, syy, sum = 0.0;
+      for(int i=0; i<count; ++i) { covs[i].TrySpatialFilter(sxx, sxy, syy); sum += sxy; }
+      sink = sink + sum;
+   });
+   Time(repr, prec, "scalar", "AngularFilter", [&](int) {
+      Float suu, suv, svv, sum = 0.0;
+      for(int i=0; i<count; ++i) { covs[i].TryAngularFilter(suu, suv, svv); sum += suv; }
+      sink = sink + sum;
+   });
+   Time(repr, prec, "scalar", "Extent", [&](int) {
+      Vector Dx, Dy, Du, Dv;
+      double sum = 0.0;
+      for(int i=0; i<count; ++i) { covs[i].Extent(Dx, Dy, Du, Dv); sum += Dx.x + Du.x; }
+      sink = sink + sum;
+   });
+   Time(repr, prec, "scalar", "Volume", [&](int) {
+      Float sum = 0.0;
+      for(int i=0; i<count; ++i) { sum += covs[i].Volume(); }
+      sink = sink + sum;
+   });
+
+   sink = sink + covs[0].matrix[0];
+}
+
+/* Queries only available with 'Covariance4D'.
+ */
+template<typename Float>
+void BenchFactorize(const Inputs& in) {
+   using Cov = Covariance4D<Vector, Float>;
+   const char* prec = Precision<Float>();
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+
+   std::array<Float, 10> matrix;
+   for(int i=0; i<10; ++i) { matrix[i] = Matrix[i]; }
+   std::vector<Cov> covs(count, Cov(matrix, x, y, z));
+   for(int i=0; i<count; ++i) { covs[i].Travel(Float(in.d[i])); }
+
+   Time("Covariance4D", prec, "scalar", "Factorize", [&](int) {
+      Float sum = 0.0;
+      for(int i=0; i<count; ++i) { sum += covs[i].Factorize().inverse[0]; }
+      sink = sink + sum;
+   });
+   Time("Covariance4D", prec, "scalar", "Factorize+Filters", [&](int) {
+      Float sxx, sxy, syy, suu, suv, svv, sum = 0.0;
+      for(int i=0; i<count; ++i) {
+         const auto factor = covs[i].Factorize();
+         covs[i].SpatialFilter(factor, sxx, sxy, syy);
+         covs[i].AngularFilter(suu, suv, svv);
+         sum += sxy + suv + covs[i].Volume(factor);
+      }
+      sink = sink + sum;
+   });
+}
+
+
+////////////////////////
+//   Batched paths    //
+////////////////////////
+
+template<typename Float>
+void BenchBatch(const Inputs& in) {
+   const int N = 16;
+   using Batch = CovarianceBatch4D<Float, N>;
+   using Cov   = Covariance4D<Vector, Float>;
+   const char* prec = Precision<Float>();
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   const int nb = count / N;
+
+   std::array<Float, 10> matrix;
+   for(int i=0; i<10; ++i) { matrix[i] = Matrix[i]; }
+   const Cov cov(matrix, x, y, z);
+
+   // Batches and per lane parameters, in the same order as the scalar
+   // benchmarks.
+   struct alignas(64) Lanes {
+      Float d[2][N], k[2][N], c[N], s[2][N], wz[N], rho[N];
+      Float n[3][N], z[3][N];
+   };
+   std::vector<Batch> batches(nb);
+   std::vector<Lanes> lanes(nb);
+   for(int b=0; b<nb; ++b) {
+      for(int l=0; l<N; ++l) {
+         const int i = b*N + l;
+         batches[b].Load(l, cov);
+         Lanes& L = lanes[b];
+         L.d[0][l] = in.d[i]; L.d[1][l] = -in.d[i];
+         L.k[0][l] = in.k[i]; L.k[1][l] = -in.k[i];
+         L.c[l]    = in.c[i];
+         L.s[0][l] = in.s[i]; L.s[1][l] = -in.s[i];
+         L.wz[l]   = in.wz[i];
+         L.rho[l]  = in.rho[i];
+         L.n[0][l] = in.n[i].x; L.n[1][l] = in.n[i].y; L.n[2][l] = in.n[i].z;
+         L.z[0][l] = 0.0;       L.z[1][l] = 0.0;       L.z[2][l] = 1.0;
+      }
+   }
+
+   Time("Covariance4D", prec, "batch", "Travel", [&](int r) {
+      for(int b=0; b<nb; ++b) { batches[b].Travel(lanes[b].d[r % 2]); }
+   });
+   Time("Covariance4D", prec, "batch", "Curvature", [&](int r) {
+      for(int b=0; b<nb; ++b) { batches[b].Curvature(lanes[b].k[r % 2], lanes[b].k[r % 2]); }
+   });
+   Time("Covariance4D", prec, "batch", "Rotate", [&](int r) {
+      for(int b=0; b<nb; ++b) { batches[b].Rotate(lanes[b].c, lanes[b].s[r % 2]); }
+   });
+   Time("Covariance4D", prec, "batch", "Symmetry", [&](int) {
+      for(int b=0; b<nb; ++b) { batches[b].Symmetry(); }
+   });
+   Time("Covariance4D", prec, "batch", "Cosine", [&](int) {
+      for(int b=0; b<nb; ++b) { batches[b].Cosine(lanes[b].wz); }
+   });
+   Time("Covariance4D", prec, "batch", "ProductUV", [&](int) {
+      for(int b=0; b<nb; ++b) { batches[b].ProductUV(lanes[b].rho, lanes[b].rho); }
+   });
+   Time("Covariance4D", prec, "batch", "Reflection", [&](int) {
+      for(int b=0; b<nb; ++b) { batches[b].Reflection(lanes[b].rho, lanes[b].rho); }
+   });
+   for(int b=0; b<nb; ++b) {
+      for(int l=0; l<N; ++l) { batches[b].Load(l, cov); }
+   }
+   Time("Covariance4D", prec, "batch", "Projection+InverseProjection", [&](int) {
+      for(int b=0; b<nb; ++b) {
+         batches[b].Projection(lanes[b].n);
+         batches[b].InverseProjection(lanes[b].z);
+      }
+   });
+   sink = sink + batches[0].matrix[0][0];
+
+   // Structure of arrays streams
+   std::vector<Float> soa(10*count), rho(count);
+   Float* m[10];
+   for(int k=0; k<10; ++k) {
+      m[k] = soa.data() + k*count;
+      for(int i=0; i<count; ++i) { m[k][i] = matrix[k]; }
+   }
+   for(int i=0; i<count; ++i) { rho[i] = in.rho[i]; }
+   Time("Covariance4D", prec, "stream", "ProductUV", [&](int) {
+      ProductUV(m, rho.data(), rho.data(), std::size_t(count));
+   });
+   Time("Covariance4D", prec, "stream", "Reflection", [&](int) {
+      Reflection(m, rho.data(), rho.data(), std::size_t(count));
+   });
+   sink = sink + m[0][0];
+
+   // Arrays of 'Covariance4D' processed by blocks of a batch: the cost of
+   // 'Load' and 'Store' around the operator.
+   std::vector<Cov> covs(nb*N, cov);
+   Time("Covariance4D", prec, "load+store", "Reflection", [&](int) {
+      Batch batch;
+      for(int b=0; b<nb; ++b) {
+         for(int l=0; l<N; ++l) { batch.Load(l, covs[b*N+l]); }
+         batch.Reflection(lanes[b].rho, lanes[b].rho);
+         for(int l=0; l<N; ++l) { batch.Store(l, covs[b*N+l]); }
+      }
+   });
+   sink = sink + covs[0].matrix[0];
+}
+
+template<typename Float>
+void Bench(const Inputs& in) {
+   BenchScalar<Covariance4D<Vector, Float>, Float>("Covariance4D", in);
+   BenchFactorize<Float>(in);
+   BenchBatch<Float>(in);
+   BenchScalar<InvCovariance4D<Vector, Float>, Float>("InvCovariance4D", in);
+}
+
+int main(int argc, char** argv) {
+   bool json = false;
+   for(int i=1; i<argc; ++i) {
+      if(strcmp(argv[i], "--json") == 0) {
+         json = true;
+      } else if(strcmp(argv[i], "--count") == 0 && i+1 < argc) {
+         count = std::max(16, atoi(argv[++i]) / 16 * 16);
+      } else if(strcmp(argv[i], "--reps") == 0 && i+1 < argc) {
+         reps = std::max(1, atoi(argv[++i]));
+      } else {
+         std::cerr << "Usage: " << argv[0] << " [--json] [--count n] [--reps r]" << std::endl;
+         return EXIT_FAILURE;
+      }
+   }
+
+   const Inputs in;
+   Bench<double>(in);
+   Bench<float>(in);
+
+   if(json) {
+      PrintJSON();
+   } else {
+      PrintCSV();
+   }
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+// STL includes
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Covariance includes
+#include <Covariance/Covariance4D.hpp>
+#include <Covariance/Covariance5D.hpp>
+using namespace Covariance;
+
+/* Microbenchmark of the cost of the temporal dimension. It traces the same
+ * bounces (travel, projection, curvature, cosine, symmetry, reflection and
+ * inverse projection) with 'Covariance4D' and 'Covariance5D', and reports
+ * the time per bounce of both and their ratio. Bounces are traced with the
+ * chain of operators, and with the fused 'SurfaceInteraction' used by the
+ * tracers.
+ *
+ * Usage: BenchCovariance5D [nb_bounces]
+ */
+
+struct Vector {
+   double x, y, z;
+   Vector() {}
+   Vector(double x, double y, double z) : x(x), y(y), z(z) {}
+   static double Dot(const Vector& w1, const Vector& w2) {
+      return w1.x*w2.x + w1.y*w2.y + w1.z*w2.z;
+   }
+   static Vector Cross(const Vector& u, const Vector& v) {
+      return Vector(u.y*v.z - u.z*v.y, u.z*v.x - u.x*v.z, u.x*v.y - u.y*v.x);
+   }
+   void Normalize() {
+      const double norm = sqrt(Dot(*this, *this));
+      x /= norm; y /= norm; z /= norm;
+   }
+   friend Vector operator*(double a, const Vector& w) {
+      return Vector(a*w.x, a*w.y, a*w.z);
+   }
+   friend Vector operator+(const Vector& a, const Vector& w) {
+      return Vector(a.x+w.x, a.y+w.y, a.z+w.z);
+   }
+   friend Vector operator-(const Vector& w) {
+      return Vector(-w.x, -w.y, -w.z);
+   }
+};
+
+using Cov4D = Covariance4D<Vector, double>;
+using Cov5D = Covariance5D<Vector, double>;
+
+template<class Cov>
+void Bounce(Cov& cov, const Vector& n, const Vector& wo, double d) {
+   cov.Travel(d);
+   cov.Projection(n);
+   cov.Curvature(0.3, -0.2);
+   cov.Cosine(0.8);
+   cov.Symmetry();
+   cov.Reflection(5.0, 2.0);
+   cov.InverseProjection(wo);
+}
+
+template<class Cov>
+void FusedBounce(Cov& cov, const Vector& n, const Vector& wo, double d) {
+   cov.SurfaceInteraction(n, 0.3, wo, 5.0, 2.0, d, 0.8);
+}
+
+int main(int argc, char** argv) {
+   const int nb_bounces = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+   // Random normals facing the incoming ray and outgoing directions. See
+   // 'BenchProjection'.
+   std::mt19937 gen(0);
+   std::uniform_real_distribution<double> dist(-1.0, 1.0);
+   const int nb_dirs = 1024;
+   std::vector<Vector> normals(nb_dirs), outgoing(nb_dirs);
+   std::vector<double> dists(nb_dirs);
+   for(int i=0; i<nb_dirs; ++i) {
+      normals[i]  = Vector(0.3*dist(gen), 0.3*dist(gen), -1.0);
+      outgoing[i] = Vector(0.3*dist(gen), 0.3*dist(gen),  1.0);
+      normals[i].Normalize();
+      outgoing[i].Normalize();
+      dists[i] = 1.0 + 0.5*dist(gen);
+   }
+
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+
+   auto run = [&](auto cov, bool fused, double& sum) {
+      const auto start = std::chrono::steady_clock::now();
+      const auto init  = cov;
+      for(int i=0; i<nb_bounces; ++i) {
+         if(i % 8 == 0) { cov = init; }
+         const Vector& n  = normals[i % nb_dirs];
+         const Vector& wo = outgoing[(7*i) % nb_dirs];
+         const double  d  = dists[(3*i) % nb_dirs];
+         if(fused) {
+            FusedBounce(cov, n, wo, d);
+         } else {
+            Bounce(cov, n, wo, d);
+         }
+         sum += cov.matrix[0];
+      }
+      const auto stop = std::chrono::steady_clock::now();
+      return std::chrono::duration<double, std::nano>(stop - start).count()
+             / nb_bounces;
+   };
+
+   const Cov4D init4({ 4.0,
+                       1.0, 3.0,
+                       0.5, 0.2, 2.0,
+                       0.1, 0.3, 0.4, 1.5 }, x, y, z);
+   const Cov5D init5({ 4.0,
+                       1.0, 3.0,
+                       0.5, 0.2, 2.0,
+                       0.1, 0.3, 0.4, 1.5,
+                       0.0, 0.0, 0.0, 0.0, 1.0 }, x, y, z);
+
+   double sum4 = 0.0, sum5 = 0.0, fsum4 = 0.0, fsum5 = 0.0;
+   const double time4  = run(init4, false, sum4);
+   const double time5  = run(init5, false, sum5);
+   const double ftime4 = run(init4, true,  fsum4);
+   const double ftime5 = run(init5, true,  fsum5);
+
+   std::cout << std::fixed << std::setprecision(2);
+   std::cout << "4D bounce       : " << time4  << " ns" << std::endl;
+   std::cout << "5D bounce       : " << time5  << " ns" << std::endl;
+   std::cout << "ratio           : " << time5 / time4 << "x" << std::endl;
+   std::cout << "4D fused bounce : " << ftime4 << " ns" << std::endl;
+   std::cout << "5D fused bounce : " << ftime5 << " ns" << std::endl;
+   std::cout << "fused ratio     : " << ftime5 / ftime4 << "x" << std::endl;
+   std::cout << std::scientific;
+   std::cout << "4D/5D xx        : " << std::abs(sum4 - sum5) / std::abs(sum4) << std::endl;
+   std::cout << "4D/5D fused xx  : " << std::abs(fsum4 - fsum5) / std::abs(fsum4) << std::endl;
+
+   return EXIT_SUCCESS;
+}
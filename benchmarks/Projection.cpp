@@ -0,0 +1,146 @@
+// STL includes
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Covariance includes
+#include <Covariance/Covariance4D.hpp>
+using namespace Covariance;
+
+/* Microbenchmark of the frame alignment of 'Projection' and
+ * 'InverseProjection'. It runs the bounce loop (projection on a surface
+ * followed by the projection to the outgoing direction) with the
+ * trigonometry-free rotation of 'Covariance4D' and with the previous atan2
+ * based rotation, and reports the time per bounce of both.
+ *
+ * Usage: BenchProjection [nb_bounces]
+ */
+
+struct Vector {
+   double x, y, z;
+   Vector() {}
+   Vector(double x, double y, double z) : x(x), y(y), z(z) {}
+   static double Dot(const Vector& w1, const Vector& w2) {
+      return w1.x*w2.x + w1.y*w2.y + w1.z*w2.z;
+   }
+   static Vector Cross(const Vector& u, const Vector& v) {
+      return Vector(u.y*v.z - u.z*v.y, u.z*v.x - u.x*v.z, u.x*v.y - u.y*v.x);
+   }
+   void Normalize() {
+      const double norm = sqrt(Dot(*this, *this));
+      x /= norm; y /= norm; z /= norm;
+   }
+   friend Vector operator*(double a, const Vector& w) {
+      return Vector(a*w.x, a*w.y, a*w.z);
+   }
+   friend Vector operator+(const Vector& a, const Vector& w) {
+      return Vector(a.x+w.x, a.y+w.y, a.z+w.z);
+   }
+   friend Vector operator-(const Vector& w) {
+      return Vector(-w.x, -w.y, -w.z);
+   }
+};
+
+using Cov = Covariance4D<Vector, double>;
+
+/* Previous implementation of the projections, using atan2, cos and sin to
+ * evaluate the frame rotation.
+ */
+void ReferenceProjection(Cov& cov, const Vector& n) {
+   const auto cx = Vector::Dot(cov.x, n);
+   const auto cy = Vector::Dot(cov.y, n);
+   const double alpha = (cx != 0.0) ? atan2(cx, cy) : 0.0;
+   const double c = cos(alpha), s = -sin(alpha);
+   cov.Rotate(c, s);
+   const double cosine = Vector::Dot(cov.z, n);
+   cov.ScaleY(std::abs(cosine));
+   cov.x = c*cov.x + s*cov.y;
+   cov.z = (cosine < 0.0f) ? -n : n;
+   cov.y = (cosine < 0.0f) ?  Vector::Cross(cov.x, cov.z) : Vector::Cross(cov.z, cov.x);
+}
+
+void ReferenceInverseProjection(Cov& cov, const Vector& d) {
+   const auto cx = Vector::Dot(cov.x, d);
+   const auto cy = Vector::Dot(cov.y, d);
+   const double alpha = (cx != 0.0) ? atan2(cx, cy) : 0.0;
+   const double c = cos(alpha), s = -sin(alpha);
+   cov.Rotate(c, s);
+   const double cosine = Vector::Dot(cov.z, d);
+   if(cosine < 0.0f) {
+      cov.ScaleV(-1.0f);
+      cov.ScaleU(-1.0f);
+   }
+   cov.ScaleY(1.0/fmax(fabs(cosine), Limits<double>::CovMin()));
+   cov.x = c*cov.x + s*cov.y;
+   cov.z = d;
+   cov.y = Vector::Cross(cov.z, cov.x);
+}
+
+int main(int argc, char** argv) {
+   const int nb_bounces = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+   // Random normals facing the incoming ray and outgoing directions.
+   // Directions alternate between the two frames so that the bounce loop
+   // stays bounded.
+   std::mt19937 gen(0);
+   std::uniform_real_distribution<double> dist(-1.0, 1.0);
+   const int nb_dirs = 1024;
+   std::vector<Vector> normals(nb_dirs), outgoing(nb_dirs);
+   for(int i=0; i<nb_dirs; ++i) {
+      normals[i]  = Vector(0.3*dist(gen), 0.3*dist(gen), -1.0);
+      outgoing[i] = Vector(0.3*dist(gen), 0.3*dist(gen),  1.0);
+      normals[i].Normalize();
+      outgoing[i].Normalize();
+   }
+
+   const std::array<double, 10> matrix = { 4.0,
+                                          1.0, 3.0,
+                                          0.5, 0.2, 2.0,
+                                          0.1, 0.3, 0.4, 1.5};
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+
+   auto run = [&](bool reference, Cov& result) {
+      const auto start = std::chrono::steady_clock::now();
+      for(int i=0; i<nb_bounces; ++i) {
+         Cov cov(matrix, x, y, z);
+         const Vector& n  = normals[i % nb_dirs];
+         const Vector& wo = outgoing[(7*i) % nb_dirs];
+         if(reference) {
+            ReferenceProjection(cov, n);
+            ReferenceInverseProjection(cov, wo);
+         } else {
+            cov.Projection(n);
+            cov.InverseProjection(wo);
+         }
+         for(int k=0; k<10; ++k) {
+            result.matrix[k] += cov.matrix[k];
+         }
+      }
+      const auto stop = std::chrono::steady_clock::now();
+      return std::chrono::duration<double, std::nano>(stop - start).count()
+             / nb_bounces;
+   };
+
+   Cov A({0,0,0,0,0,0,0,0,0,0}, x, y, z), B({0,0,0,0,0,0,0,0,0,0}, x, y, z);
+   const double time_ref  = run(true,  A);
+   const double time_fast = run(false, B);
+
+   double error = 0.0;
+   for(int k=0; k<10; ++k) {
+      error = std::max(error, std::abs(A.matrix[k] - B.matrix[k]) /
+                              std::max(1.0, std::abs(A.matrix[k])));
+   }
+
+   std::cout << std::fixed << std::setprecision(2);
+   std::cout << "atan2 rotation     : " << time_ref  << " ns/bounce" << std::endl;
+   std::cout << "trig-free rotation : " << time_fast << " ns/bounce" << std::endl;
+   std::cout << "speedup            : " << time_ref / time_fast << "x" << std::endl;
+   std::cout << std::scientific;
+   std::cout << "max relative error : " << error << std::endl;
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+// STL includes
+#include <array>
+
+// Local includes
+#include "Matrix.hpp"
+#include "Covariance4D.hpp"
+#include "InvCovariance4D.hpp"
+
+namespace Covariance {
+
+   /* Streaming weighted average of 4D covariance matrices.
+    *
+    * The accumulator stores the weighted sum of the covariance matrices (in
+    * primal form) and the sum of the weights. Adding a 'Covariance4D' is a
+    * multiply-add of its 10 entries. Adding an 'InvCovariance4D' inverts it
+    * once. The average is only evaluated when it is read with 'Mean',
+    * 'Covariance' or 'InvCovariance'. This replaces repeated calls to
+    * 'Covariance4D::Add' and 'InvCovariance4D::Add', which renormalize
+    * (and for the latter invert both operands and the result) at every
+    * accumulation.
+    *
+    * Partial accumulators can be merged with 'Add', for example to reduce
+    * per-thread or per-tile results. The merge is deterministic: merging
+    * the same partial results in the same order gives the same result
+    * regardless of which thread produced them.
+    *
+    * When 'Moments' is true, the accumulator also tracks the weighted
+    * second central moment of each entry of the matrix, updated with the
+    * weighted version of Welford's algorithm (West 1979) and merged with the
+    * pairwise formula of Chan et al. [1979]. Use 'Variance' to read it.
+    *
+    * Like 'Add', the matrices are averaged entry-wise without changing of
+    * frame: the frame of the result is the one of the first matrix added.
+    */
+   template<class Vector, typename Float, bool Moments = false>
+   struct CovarianceAccumulator4D {
+
+      std::array<Float, 10> sum;
+      std::array<Float, Moments ? 10 : 0> moment;
+      Float weight;
+      Vector x, y, z;
+
+      CovarianceAccumulator4D() {
+         Clear();
+      }
+
+      void Clear() {
+         sum.fill(0.0f);
+         moment.fill(0.0f);
+         weight = 0.0f;
+      }
+
+      /* Add the covariance matrix 'cov' with weight 'w'. Null and negative
+       * weights are ignored.
+       */
+      void Add(const Covariance4D<Vector, Float>& cov, Float w=1.0f) {
+         if(!(w > 0.0f)) return;
+         SetFrame(cov.x, cov.y, cov.z);
+         Accumulate(cov.matrix.data(), w);
+      }
+
+      /* Add the inverse covariance matrix 'cov' with weight 'w'. The matrix
+       * is inverted once (see 'InvCovariance4D::TryInverseMatrix').
+       */
+      void Add(const InvCovariance4D<Vector, Float>& cov, Float w=1.0f) {
+         if(!(w > 0.0f)) return;
+         SetFrame(cov.x, cov.y, cov.z);
+
+         Float inverse[16], packed[10];
+         cov.TryInverseMatrix(inverse);
+         for(unsigned short i=0; i<10; ++i) {
+            packed[i] = inverse[InvCovariance4D<Vector, Float>::Unpacked(i)];
+         }
+         Accumulate(packed, w);
+      }
+
+      /* Merge the accumulator 'acc' into this one.
+       */
+      void Add(const CovarianceAccumulator4D& acc) {
+         if(!(acc.weight > 0.0f)) return;
+         SetFrame(acc.x, acc.y, acc.z);
+
+         const Float W = weight + acc.weight;
+         if(Moments && weight > 0.0f) {
+            const Float ia = Float(1.0) / weight, ib = Float(1.0) / acc.weight;
+            const Float f  = weight*acc.weight / W;
+            for(unsigned short i=0; i<moment.size(); ++i) {
+               const Float delta = acc.sum[i]*ib - sum[i]*ia;
+               moment[i] += acc.moment[i] + delta*delta*f;
+            }
+         } else if(Moments) {
+            moment = acc.moment;
+         }
+         for(unsigned short i=0; i<10; ++i) {
+            sum[i] += acc.sum[i];
+         }
+         weight = W;
+      }
+
+      /* Add the packed matrix 'm' with weight 'w' to the sums.
+       */
+      inline void Accumulate(const Float* m, Float w) {
+         if(Moments) {
+            // The running mean before and after the update are needed for
+            // the second moment.
+            const Float W  = weight + w;
+            const Float ia = (weight > 0.0f) ? Float(1.0) / weight : Float(0.0);
+            const Float iW = Float(1.0) / W;
+            for(unsigned short i=0; i<moment.size(); ++i) {
+               const Float delta = (weight > 0.0f) ? m[i] - sum[i]*ia : Float(0.0);
+               sum[i] += w*m[i];
+               moment[i] += w*delta*(m[i] - sum[i]*iW);
+            }
+            weight = W;
+         } else {
+            for(unsigned short i=0; i<10; ++i) {
+               sum[i] += w*m[i];
+            }
+            weight += w;
+         }
+      }
+
+      /* Keep the frame of the first matrix added.
+       */
+      inline void SetFrame(const Vector& x, const Vector& y, const Vector& z) {
+         if(weight > 0.0f) return;
+         this->x = x; this->y = y; this->z = z;
+      }
+
+
+      /////////////////////
+      //     Results     //
+      /////////////////////
+
+      /* Weighted average of the covariance matrices. This is the null
+       * matrix if nothing was added.
+       */
+      std::array<Float, 10> Mean() const {
+         std::array<Float, 10> mean;
+         const Float iw = (weight > 0.0f) ? Float(1.0) / weight : Float(0.0);
+         for(unsigned short i=0; i<10; ++i) {
+            mean[i] = sum[i] * iw;
+         }
+         return mean;
+      }
+
+      /* Weighted variance of each entry of the covariance matrices. This is
+       * only available when 'Moments' is true.
+       */
+      std::array<Float, 10> Variance() const {
+         static_assert(Moments, "The accumulator does not track the second moment");
+         std::array<Float, 10> variance;
+         const Float iw = (weight > 0.0f) ? Float(1.0) / weight : Float(0.0);
+         for(unsigned short i=0; i<moment.size(); ++i) {
+            variance[i] = moment[i] * iw;
+         }
+         return variance;
+      }
+
+      Covariance4D<Vector, Float> Covariance() const {
+         return Covariance4D<Vector, Float>(Mean(), x, y, z);
+      }
+
+      /* Inverse of the weighted average. This is the only inversion of the
+       * accumulated matrix, see 'Covariance4D::TryInverseMatrix' for the
+       * regularization and the fallback.
+       */
+      InvCovariance4D<Vector, Float> InvCovariance() const {
+         Float inverse[16];
+         Covariance().TryInverseMatrix(inverse);
+
+         std::array<Float, 10> matrix;
+         for(unsigned short i=0; i<10; ++i) {
+            matrix[i] = inverse[InvCovariance4D<Vector, Float>::Unpacked(i)];
+         }
+         return InvCovariance4D<Vector, Float>(matrix, x, y, z);
+      }
+   };
+}
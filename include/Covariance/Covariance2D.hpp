@@ -1,14 +1,256 @@
 #pragma once
 
+// STL includes
+#include <array>
+#include <cmath>
+
+// Local includes
+#include "Limits.hpp"
+
 namespace Covariance {
 
-   /*! The 2D isotropic version of Covariance Tracing.
-    *  This code assumes that light transport in 2 dimensions and only
-    *  store a 2D covariance matrix for space and angles.
+   /* Rank 1 update of a packed 2x2 covariance matrix for the product with an
+    * angular signal of covariance 's'. This is the 2D counterpart of
+    * 'ProductUVLane': a null 's' leaves the matrix untouched without
+    * branching.
     */
+   template<typename Float>
+   inline void ProductULane(Float& cov_xx, Float& cov_xu, Float& cov_uu,
+                            Float s) {
+      const Float xu = cov_xu, uu = cov_uu;
+      const bool  skip = (s == 0.0);
+      const Float g    = skip ? Float(0.0) : Float(1.0) / (skip ? Float(1.0) : uu+s);
+      cov_xx -= g*xu*xu;
+      cov_xu -= g*xu*uu;
+      cov_uu -= g*uu*uu;
+   }
+
+   /* The 2D version of Covariance Tracing.
+    *
+    * This is the flatland version of 'Covariance4D': light transport happens
+    * in a plane and the local lightfield around the central ray has one
+    * spatial (X) and one angular (U) dimension. The covariance matrix is a
+    * 2x2 symmetric matrix stored as its upper triangle:
+    *
+    * C =  ( 0  1 )
+    *      ( 1  2 )
+    *
+    * The local frame is made of the ray direction 'z' and the tangent 'x'.
+    * The 'Vector' type is a 2D vector with the same interface as for
+    * 'Covariance4D' ('Dot', sum and product by a scalar) except 'Cross'.
+    *
+    * All operations are closed-form.
+    */
+   template<class Vector, typename Float>
    struct Covariance2D {
 
-      float matrix[3];
+      // Data
+      std::array<Float, 3> matrix;
+      Vector x, z;
+
+
+      ////////////////////////
+      //  Atomic operators  //
+      ////////////////////////
+
+      /* Travel operator
+       *
+       * 'd' distance of travel along the central ray
+       */
+      inline void Travel(Float d) {
+         ShearAngleSpace(d);
+      }
+
+      /* Curvature operator
+       *
+       * 'k' curvature of the surface
+       */
+      inline void Curvature(Float k) {
+         ShearSpaceAngle(k);
+      }
+
+      /* Cosine operator
+       *
+       * 'wz' The incident direction's elevation in the local frame
+       */
+      inline void Cosine(Float wz) {
+         const Float theta = acos(wz);
+         const Float dist  = std::abs(0.5*M_PI-theta);
+         const Float freq  = 1.0 / fmax(dist, 1.0E-10);
+         matrix[2] += freq*freq;
+      }
+
+      /* Reflection operator
+       *
+       * 's' the covariance of the BRDF.
+       */
+      inline void Reflection(Float s) {
+         if(s < Limits<Float>::CovMax()) {
+            ProductU(fmax(s, Limits<Float>::CovMin()));
+         }
+      }
+
+      inline void Symmetry() {
+         matrix[1] = -matrix[1];
+      }
+
+
+      /////////////////////////////
+      //  Local Frame alignment  //
+      /////////////////////////////
+
+      /* Perform the projection of the incomming lightfield on the surface with
+       * normal n. See 'Covariance4D::Projection'.
+       *
+       * 'n' the surface normal.
+       */
+      inline void Projection(const Vector& n) {
+         const Float cosine = Vector::Dot(z, n);
+         ScaleX(std::abs(cosine));
+
+         // Update direction vectors. The tangent is the one closest to the
+         // previous tangent.
+         z = (cosine < 0.0f) ? Float(-1.0)*n : n;
+         x = Tangent(x, z);
+      }
+
+      /* Perform the projection of a lightfield defined on a surface to an
+       * outgoing direction. See 'Covariance4D::InverseProjection'.
+       *
+       * 'd' the outgoing direction.
+       */
+      inline void InverseProjection(const Vector& d) {
+         const Float cosine = Vector::Dot(z, d);
+         if(cosine < 0.0f) {
+            ScaleU(-1.0f);
+         }
+         ScaleX(1.0/fmax(fabs(cosine), Limits<Float>::CovMin()));
+
+         // Update direction vectors.
+         z = d;
+         x = Tangent(x, z);
+      }
+
+      /* Unit vector orthogonal to 'z' closest to 'x'. 'x' is returned when
+       * it is colinear to 'z'.
+       */
+      static inline Vector Tangent(const Vector& x, const Vector& z) {
+         const Vector t = x + (-Vector::Dot(x, z))*z;
+         const Float  l = sqrt(Vector::Dot(t, t));
+         return (l > Limits<Float>::CovMin()) ? Float(1.0/l)*t : x;
+      }
+
+
+      ////////////////////////
+      //   Matrix scaling   //
+      ////////////////////////
+
+      inline void ScaleX(Float alpha) {
+         matrix[0] *= alpha*alpha;
+         matrix[1] *= alpha;
+      }
+
+      inline void ScaleU(Float alpha) {
+         matrix[1] *= alpha;
+         matrix[2] *= alpha*alpha;
+      }
+
+
+      ////////////////////////
+      //   Matrix shearing  //
+      ////////////////////////
+
+      // Shear the spatial (X) domain by the angular (U) domain.
+      inline void ShearSpaceAngle(Float c) {
+         matrix[0] += (matrix[2]*c - 2*matrix[1])*c;
+         matrix[1] -=  matrix[2]*c;
+      }
+
+      // Shear the angular (U) domain by the spatial (X) domain.
+      inline void ShearAngleSpace(Float c) {
+         matrix[2] += (matrix[0]*c - 2*matrix[1])*c;
+         matrix[1] -=  matrix[0]*c;
+      }
+
+
+      ////////////////////////
+      // Product of signals //
+      ////////////////////////
+
+      /* Evaluate the covariance matrix of the product of the local lightfield
+       * and an angularly varying only signal (like a BSDF) of covariance 's'.
+       */
+      inline void ProductU(Float s) {
+         ProductULane(matrix[0], matrix[1], matrix[2], s);
+      }
+
+
+      /////////////////////////////
+      // Add covariance together //
+      /////////////////////////////
+
+      void Add(const Covariance2D& cov, Float L1=1.0f, Float L2=1.0f) {
+         const Float L = L1+L2;
+         if(L <= 0.0f) return;
+
+         for(unsigned short i=0; i<3; ++i) {
+            matrix[i] = (L1*matrix[i] + L2*cov.matrix[i]) / L;
+         }
+      }
+
+
+      /////////////////////
+      //     Filters     //
+      /////////////////////
+
+      /* Compute the spatial filter in primal space. The filter is the
+       * Gaussian f(x) = exp(- 0.5 sxx x^2). This is the inverse of the
+       * spatial entry of the inverse matrix, which is the Schur complement
+       * of the angular entry.
+       */
+      void SpatialFilter(Float& sxx) const {
+         const Float xx = matrix[0] + Limits<Float>::CovMin();
+         const Float uu = matrix[2] + Limits<Float>::CovMin();
+         sxx = 4.0*M_PI*M_PI * (xx - matrix[1]*matrix[1]/uu);
+      }
+
+      /* Compute the angular filter in primal space. The filter is the
+       * Gaussian f(u) = exp(- 0.5 suu u^2).
+       */
+      void AngularFilter(Float& suu) const {
+         if(matrix[2] > 0.0) {
+            suu = 4.0*M_PI*M_PI / matrix[2];
+         } else {
+            suu = Limits<Float>::CovMax();
+         }
+      }
+
+      /* Compute the volume of the covariance matrix, which is its
+       * determinant. An epsilon is added to the diagonal like in
+       * 'Covariance4D::Volume'.
+       */
+      Float Volume() const {
+         const Float xx = matrix[0] + Limits<Float>::CovMin();
+         const Float uu = matrix[2] + Limits<Float>::CovMin();
+         return xx*uu - matrix[1]*matrix[1];
+      }
+
+
+      /////////////////////
+      //   Constructors  //
+      /////////////////////
 
+      Covariance2D() {
+         matrix = { 0.0f,
+                    0.0f, 0.0f };
+      }
+      Covariance2D(Float sxx, Float suu) {
+         matrix = {  sxx,
+                    0.0f,  suu };
+      }
+      Covariance2D(std::array<Float, 3> matrix,
+                   const Vector& x,
+                   const Vector& z) :
+         matrix(matrix), x(x), z(z) {}
    };
 }
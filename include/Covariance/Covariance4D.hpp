@@ -7,14 +7,78 @@
 
 // Local includes
 #include "Matrix.hpp"
-
-#define COV_MAX_FLOAT 1.0E+5
-#define COV_MIN_FLOAT 1.0E-5
+#include "Frame.hpp"
+#include "Limits.hpp"
+#include "Instrumentation.hpp"
 
 #define USE_WOODBURY_IDENTITY
 
 namespace Covariance {
 
+   /* Multiply-add used by the fused and batched kernels. Define
+    * 'COV_USE_FMA' to force fused multiply-add instructions (only do it when
+    * the target has them, otherwise 'std::fma' falls back to a slow software
+    * implementation).
+    */
+   template<typename Float>
+   COV_LANE Float MulAdd(Float a, Float b, Float c) {
+#ifdef COV_USE_FMA
+      return std::fma(a, b, c);
+#else
+      return a*b + c;
+#endif
+   }
+
+   /* Rank 2 Woodbury update of one packed covariance matrix given as its 10
+    * entries. This is the kernel of 'Covariance4D::ProductUV' written without
+    * branches: a matrix for which both 'su' and 'sv' are zero is left
+    * untouched by using a null gain. It is meant to be inlined in loops over
+    * the lanes of a batch so that the compiler vectorizes it, or in fused
+    * operators working on registers.
+    */
+   template<typename Float>
+   COV_LANE void ProductUVLane(Float& cov_xx, Float& cov_xy, Float& cov_yy,
+                               Float& cov_xu, Float& cov_yu, Float& cov_uu,
+                               Float& cov_xv, Float& cov_yv, Float& cov_uv,
+                               Float& cov_vv, Float su, Float sv) {
+      const Float xu = cov_xu, yu = cov_yu, uu = cov_uu;
+      const Float xv = cov_xv, yv = cov_yv, uv = cov_uv, vv = cov_vv;
+
+      const bool  skip  = (su == 0.0 && sv == 0.0);
+      const Float sig_u = uu+su, sig_v = vv+sv;
+      const Float og    = MulAdd(sig_u, sig_v, -uv*uv);
+      const Float g     = skip ? Float(0.0) : Float(1.0) / (skip ? Float(1.0) : og);
+
+      // Rows of (C_uv + S)^-1 C_uv^T without the 1/det factor
+      const Float ax = MulAdd(sig_v, xu, -uv*xv), bx = MulAdd(sig_u, xv, -uv*xu);
+      const Float ay = MulAdd(sig_v, yu, -uv*yv), by = MulAdd(sig_u, yv, -uv*yu);
+      const Float au = MulAdd(sig_v, uu, -uv*uv), bu = MulAdd(sig_u, uv, -uv*uu);
+      const Float av = MulAdd(sig_v, uv, -uv*vv), bv = MulAdd(sig_u, vv, -uv*uv);
+
+      cov_xx -= g*MulAdd(xu, ax, xv*bx);
+      cov_xy -= g*MulAdd(yu, ax, yv*bx);
+      cov_yy -= g*MulAdd(yu, ay, yv*by);
+      cov_xu -= g*MulAdd(uu, ax, uv*bx);
+      cov_yu -= g*MulAdd(uu, ay, uv*by);
+      cov_uu -= g*MulAdd(uu, au, uv*bu);
+      cov_xv -= g*MulAdd(uv, ax, vv*bx);
+      cov_yv -= g*MulAdd(uv, ay, vv*by);
+      cov_uv -= g*MulAdd(uv, au, vv*bu);
+      cov_vv -= g*MulAdd(uv, av, vv*bv);
+   }
+
+   /* Convert the BRDF covariances of the reflection operator to the
+    * arguments of 'ProductUVLane'. Specular lanes (covariance above
+    * 'Limits::CovMax') get null arguments and are skipped.
+    */
+   template<typename Float>
+   COV_LANE void ReflectionLane(Float suu, Float svv, Float& su, Float& sv) {
+      const Float cmin = Limits<Float>::CovMin(), cmax = Limits<Float>::CovMax();
+      const bool active = suu < cmax && svv < cmax;
+      su = active ? Float(fmax(suu, cmin)) : Float(0.0);
+      sv = active ? Float(fmax(svv, cmin)) : Float(0.0);
+   }
+
    /* The 4D version of Covariance Tracing.
     * This is the timeless version of Covariance Tracing. It allows to compute
     * covariance information of the local lightfield around the central ray
@@ -40,7 +104,24 @@ namespace Covariance {
     *      ( 1  2  4  7)
     *      ( 3  4  5  8)
     *      ( 6  7  8  9)
+    *
+    * When 'COV_CACHE_INVERSE' is defined, the const queries (filters,
+    * extents, 'Factorize') write the cached factorization: concurrent
+    * queries on the same object are a data race and must be synchronized
+    * by the caller. Without the cache, const methods do not write the
+    * object.
+    *
+    * The layout of the class depends on 'COV_CACHE_INVERSE'. The class is
+    * declared in an inline namespace named after the setting so that
+    * translation units compiled with different settings define different
+    * types, and exchanging objects between them fails to link instead of
+    * silently violating the one definition rule.
     */
+#ifdef COV_CACHE_INVERSE
+   inline namespace CachedInverse {
+#else
+   inline namespace UncachedInverse {
+#endif
    template<class Vector, typename Float>
    struct Covariance4D {
 
@@ -57,6 +138,7 @@ namespace Covariance {
        * 'd' distance of travel along the central ray
        */
       inline void Travel(Float d) {
+         COV_TIME(Cov4D, Travel);
          ShearAngleSpace(d, d);
       }
 
@@ -66,6 +148,7 @@ namespace Covariance {
        * 'ky' curvature along the Y direction
        */
       inline void Curvature(Float kx, Float ky) {
+         COV_TIME(Cov4D, Curvature);
          ShearSpaceAngle(kx, ky);
       }
 
@@ -74,6 +157,8 @@ namespace Covariance {
        * 'wz' The incident direction's elevation in the local frame
        */
       inline void Cosine(Float wz) {
+         COV_TIME(Cov4D, Cosine);
+         Invalidate();
          const Float theta = acos(wz);
          const Float dist  = std::abs(0.5*M_PI-theta);
          const Float frequ = 2.0 / M_PI;
@@ -82,14 +167,29 @@ namespace Covariance {
          matrix[9] += freqv*freqv;
       }
 
+      /* Cosine operator at normal incidence, equivalent to 'Cosine(1.0)'
+       * without the trigonometry: both frequencies are 2/pi.
+       */
+      inline void Cosine() {
+         COV_TIME(Cov4D, Cosine);
+         Invalidate();
+         const Float freq2 = 4.0 / (M_PI*M_PI);
+         matrix[5] += freq2;
+         matrix[9] += freq2;
+      }
+
       /* Reflection operator
        *
        * 'suu' the covariance of the BRDF along the X axis.
        * 'svv' the covariance of the BRDF along the Y axis.
        */
       inline void Reflection(Float suu, Float svv) {
-         if(suu < COV_MAX_FLOAT && svv < COV_MAX_FLOAT) {
-            ProductUV(fmax(suu, COV_MIN_FLOAT), fmax(svv, COV_MIN_FLOAT));
+         COV_TIME(Cov4D, Reflection);
+         const Float cmin = Limits<Float>::CovMin(), cmax = Limits<Float>::CovMax();
+         if(suu < cmax && svv < cmax) {
+            ProductUV(fmax(suu, cmin), fmax(svv, cmin));
+         } else {
+            COV_COUNT(Cov4D, ReflectionSkipped);
          }
       }
 
@@ -105,13 +205,14 @@ namespace Covariance {
        * 'n' the surface normal.
        */
       inline void Projection(const Vector& n) {
+         COV_TIME(Cov4D, Projection);
 
          const auto cx = Vector::Dot(x, n);
          const auto cy = Vector::Dot(y, n);
 
          // Rotate the Frame to be aligned with plane.
-         const Float alpha = (cx != 0.0) ? atan2(cx, cy) : 0.0;
-         const Float c = cos(alpha), s = -sin(alpha);
+         Float c, s;
+         FrameRotation<Float>(cx, cy, c, s);
          Rotate(c, s);
 
          // Scale the componnent that project by the cosine of the ray direction
@@ -133,13 +234,14 @@ namespace Covariance {
        * 'd' the outgoing direction.
        */
       inline void InverseProjection(const Vector& d) {
+         COV_TIME(Cov4D, InverseProjection);
 
          const auto cx = Vector::Dot(x, d);
          const auto cy = Vector::Dot(y, d);
 
          // Rotate the Frame to be aligned with plane.
-         const Float alpha = (cx != 0.0) ? atan2(cx, cy) : 0.0;
-         const Float c = cos(alpha), s = -sin(alpha);
+         Float c, s;
+         FrameRotation<Float>(cx, cy, c, s);
          Rotate(c, s); // Rotate of -alpha
 
          // Scale the componnent that project by the inverse cosine of the ray
@@ -149,7 +251,7 @@ namespace Covariance {
             ScaleV(-1.0f);
             ScaleU(-1.0f);
          }
-         ScaleY(1.0/fmax(fabs(cosine), COV_MIN_FLOAT));
+         ScaleY(1.0/fmax(fabs(cosine), Limits<Float>::CovMin()));
 
          // Update direction vectors.
          x = c*x + s*y;
@@ -163,6 +265,8 @@ namespace Covariance {
        * is ajusted with respect to symmetry.
        */
       inline void Symmetry() {
+         COV_TIME(Cov4D, Symmetry);
+         Invalidate();
          matrix[3] = -matrix[3];
          matrix[4] = -matrix[4];
          matrix[6] = -matrix[6];
@@ -170,11 +274,103 @@ namespace Covariance {
       }
 
 
+      /////////////////////////
+      //   Fused operators   //
+      /////////////////////////
+
+      /* Surface interaction operator
+       *
+       * Apply the standard chain of operators of a reflection on a surface
+       * in a single call. This is equivalent to:
+       *
+       *    Projection(n);
+       *    Curvature(k, k);
+       *    Cosine(wz);
+       *    Symmetry();
+       *    Reflection(rho_u, rho_v);
+       *    Curvature(-k, -k);
+       *    InverseProjection(wo);
+       *    Travel(t);
+       *
+       * but the operators between the two projections are evaluated on
+       * local copies of the matrix entries, which are only loaded and stored
+       * once.
+       *
+       * 'n'     the surface normal (see 'Projection').
+       * 'k'     the curvature of the surface.
+       * 'wo'    the outgoing direction (see 'InverseProjection').
+       * 'rho_u' and 'rho_v' the covariance of the BRDF (see 'Reflection').
+       * 't'     the distance of travel after the reflection.
+       * 'wz'    the incident direction's elevation (see 'Cosine').
+       */
+      inline void SurfaceInteraction(const Vector& n, Float k, const Vector& wo,
+                                     Float rho_u, Float rho_v, Float t,
+                                     Float wz = 1.0) {
+         COV_TIME(Cov4D, SurfaceInteraction);
+         Projection(n);
+
+         Float cov_xx = matrix[0], cov_xy = matrix[1], cov_yy = matrix[2];
+         Float cov_xu = matrix[3], cov_yu = matrix[4], cov_uu = matrix[5];
+         Float cov_xv = matrix[6], cov_yv = matrix[7], cov_uv = matrix[8];
+         Float cov_vv = matrix[9];
+
+         // Curvature(k, k)
+         cov_xx += (cov_uu*k - 2*cov_xu)*k;
+         cov_xy +=  cov_uv*k*k - (cov_yu*k + cov_xv*k);
+         cov_yy += (cov_vv*k - 2*cov_yv)*k;
+         cov_xu -=  cov_uu*k;
+         cov_yu -=  cov_uv*k;
+         cov_xv -=  cov_uv*k;
+         cov_yv -=  cov_vv*k;
+
+         // Cosine(wz)
+         const Float dist  = std::abs(0.5*M_PI-acos(wz));
+         const Float frequ = 2.0 / M_PI;
+         const Float freqv = 1.0 / fmax(dist, 1.0E-10);
+         cov_uu += frequ*frequ;
+         cov_vv += freqv*freqv;
+
+         // Symmetry()
+         cov_xu = -cov_xu; cov_yu = -cov_yu;
+         cov_xv = -cov_xv; cov_yv = -cov_yv;
+
+         // Reflection(rho_u, rho_v)
+#ifdef COV_INSTRUMENT
+         if(!(rho_u < Limits<Float>::CovMax() && rho_v < Limits<Float>::CovMax())) {
+            COV_COUNT(Cov4D, ReflectionSkipped);
+         }
+#endif
+         Float su, sv;
+         ReflectionLane(rho_u, rho_v, su, sv);
+         ProductUVLane(cov_xx, cov_xy, cov_yy, cov_xu, cov_yu, cov_uu,
+                       cov_xv, cov_yv, cov_uv, cov_vv, su, sv);
+
+         // Curvature(-k, -k)
+         cov_xx += (cov_uu*k + 2*cov_xu)*k;
+         cov_xy +=  cov_uv*k*k + (cov_yu*k + cov_xv*k);
+         cov_yy += (cov_vv*k + 2*cov_yv)*k;
+         cov_xu +=  cov_uu*k;
+         cov_yu +=  cov_uv*k;
+         cov_xv +=  cov_uv*k;
+         cov_yv +=  cov_vv*k;
+
+         matrix[0] = cov_xx; matrix[1] = cov_xy; matrix[2] = cov_yy;
+         matrix[3] = cov_xu; matrix[4] = cov_yu; matrix[5] = cov_uu;
+         matrix[6] = cov_xv; matrix[7] = cov_yv; matrix[8] = cov_uv;
+         matrix[9] = cov_vv;
+         Invalidate();
+
+         InverseProjection(wo);
+         Travel(t);
+      }
+
+
       ////////////////////////
       //   Matrix scaling   //
       ////////////////////////
 
       inline void ScaleX(Float alpha) {
+         Invalidate();
          matrix[0] *= alpha*alpha;
          matrix[1] *= alpha;
          matrix[3] *= alpha;
@@ -182,6 +378,7 @@ namespace Covariance {
       }
 
       inline void ScaleY(Float alpha) {
+         Invalidate();
          matrix[1] *= alpha;
          matrix[2] *= alpha*alpha;
          matrix[4] *= alpha;
@@ -189,6 +386,7 @@ namespace Covariance {
       }
 
       inline void ScaleU(Float alpha) {
+         Invalidate();
          matrix[3] *= alpha;
          matrix[4] *= alpha;
          matrix[5] *= alpha*alpha;
@@ -196,6 +394,7 @@ namespace Covariance {
       }
 
       inline void ScaleV(Float alpha) {
+         Invalidate();
          matrix[6] *= alpha;
          matrix[7] *= alpha;
          matrix[8] *= alpha;
@@ -211,6 +410,7 @@ namespace Covariance {
       // \param cx amount of shear along the x direction.
       // \param cy amount of shear along the y direction.
       inline void ShearSpaceAngle(Float cx, Float cy) {
+         Invalidate();
          matrix[0] += (matrix[5]*cx - 2*matrix[3])*cx;
          matrix[1] +=  matrix[8]*cx*cy - (matrix[4]*cy + matrix[6]*cx);
          matrix[2] += (matrix[9]*cy - 2*matrix[7])*cy;
@@ -224,6 +424,7 @@ namespace Covariance {
       // \param cu amount of shear along the U direction.
       // \param cy amount of shear along the V direction.
       inline void ShearAngleSpace(Float cu, Float cv) {
+         Invalidate();
          matrix[5] += (matrix[0]*cu - 2*matrix[3])*cu;
          matrix[3] -=  matrix[0]*cu;
          matrix[8] +=  matrix[1]*cu*cv - (matrix[4]*cv + matrix[6]*cu);
@@ -248,6 +449,7 @@ namespace Covariance {
       // 'c' the cosine of the rotation angle
       // 's' the sine of the rotation angle
       inline void Rotate(Float c, Float s) {
+         Invalidate();
          const Float cs = c*s;
          const Float c2 = c*c;
          const Float s2 = s*s;
@@ -285,6 +487,18 @@ namespace Covariance {
       //    Matrix inverse  //
       ////////////////////////
 
+      /* Return the packed covariance matrix with an epsilon added to the
+       * diagonal in order to ensure that the matrix can be inverted.
+       */
+      inline std::array<Float, 10> RegularizedMatrix() const {
+         std::array<Float, 10> regular = matrix;
+         regular[0] += Limits<Float>::CovMin();
+         regular[2] += Limits<Float>::CovMin();
+         regular[5] += Limits<Float>::CovMin();
+         regular[9] += Limits<Float>::CovMin();
+         return regular;
+      }
+
       /* Compute the inverse of the covariance matrix.
        *
        * We add an epsilon to the diagonal in order to ensure that the matrix
@@ -293,23 +507,98 @@ namespace Covariance {
        * 'inverse' needs to be a 4x4 preallocated matrix (16 Floats)..
        */
       void InverseMatrix(Float* inverse) const {
-         // Compute the inverse matrix. We need to add an epsilon to the
-         // diagonal in order to ensure that the matrix can be inverted.
-         inverse[ 0] = matrix[ 0] + COV_MIN_FLOAT;
-         inverse[ 1] = matrix[ 1]; inverse[ 4] = matrix[ 1];
-         inverse[ 5] = matrix[ 2] + COV_MIN_FLOAT;
-         inverse[ 2] = matrix[ 3]; inverse[ 8] = matrix[ 3];
-         inverse[ 6] = matrix[ 4]; inverse[ 9] = matrix[ 4];
-         inverse[10] = matrix[ 5] + COV_MIN_FLOAT;
-         inverse[ 3] = matrix[ 6]; inverse[12] = matrix[ 6];
-         inverse[ 7] = matrix[ 7]; inverse[13] = matrix[ 7];
-         inverse[11] = matrix[ 8]; inverse[14] = matrix[ 8];
-         inverse[15] = matrix[ 9] + COV_MIN_FLOAT;
+         if(!TryInverseMatrix(inverse)) { COV_THROW; }
+      }
 
-         if(!Inverse<Float>(inverse, 4)) { throw 1; }
+      /* Same as above without exception. Return 'false' if the matrix cannot
+       * be inverted, in which case 'inverse' is the isotropic inverse of
+       * maximal bandwidth.
+       */
+      bool TryInverseMatrix(Float* inverse) const noexcept {
+         COV_TIME(Cov4D, Inverse);
+         const std::array<Float, 10> regular = RegularizedMatrix();
+         if(SymmetricInverse4<Float>(regular.data(), inverse)) { return true; }
+         COV_COUNT(Cov4D, InverseFailed);
+         for(int i=0; i<16; ++i) {
+            inverse[i] = (i % 5 == 0) ? Limits<Float>::CovMin() : Float(0.0);
+         }
+         return false;
       }
 
 
+      ////////////////////////
+      //   Factorization    //
+      ////////////////////////
+
+      using Factor = SymmetricFactor4<Float>;
+
+#ifdef COV_CACHE_INVERSE
+      /* Cached factorization of the matrix. When 'COV_CACHE_INVERSE' is
+       * defined (before including this file, and consistently across
+       * translation units), the factorization is only computed on the first
+       * query after a modification of the matrix. Every operator of this
+       * class marks the cache as dirty. If you write 'matrix' directly, call
+       * 'Invalidate()' afterwards. The cache is not thread-safe, see the
+       * class comment.
+       */
+      mutable Factor _factor;
+      mutable bool   _dirty = true;
+#endif
+
+      /* Mark the cached factorization as outdated. This is a no-op when the
+       * cache is disabled.
+       */
+      inline void Invalidate() {
+#ifdef COV_CACHE_INVERSE
+         _dirty = true;
+#endif
+      }
+
+      /* Compute the factorization of the (regularized) covariance matrix
+       * and its packed inverse (see 'SymmetricFactor4'). The factor can be
+       * passed to 'Volume', 'SpatialFilter' and the extent queries so that a
+       * matrix queried several times is only factored once:
+       *
+       *    const auto factor = cov.Factorize();
+       *    if(factor.positive) {
+       *       cov.SpatialFilter(factor, sxx, sxy, syy);
+       *       cov.SpatialExtent(factor, Dx, Dy);
+       *    }
+       *
+       * Checking 'factor.positive' replaces the exception thrown by the
+       * query methods when the matrix cannot be inverted. The 'Try*' query
+       * methods do this check and return a fallback filter instead.
+       */
+      Factor Factorize() const {
+#ifdef COV_CACHE_INVERSE
+         if(!_dirty) {
+            return _factor;
+         }
+#endif
+         COV_TIME(Cov4D, Inverse);
+         const std::array<Float, 10> regular = RegularizedMatrix();
+         Factor factor;
+         if(factor.Factor(regular.data())) {
+            factor.Invert();
+         } else {
+            COV_COUNT(Cov4D, InverseFailed);
+         }
+#ifdef COV_CACHE_INVERSE
+         _factor = factor;
+         _dirty  = false;
+#endif
+         return factor;
+      }
+
+      /* Check if the (regularized) covariance matrix is positive definite.
+       * This only performs the factorization and not the inversion.
+       */
+      bool IsPositiveDefinite() const {
+         const std::array<Float, 10> regular = RegularizedMatrix();
+         Factor factor;
+         return factor.Factor(regular.data());
+      }
+
 
       ////////////////////////
       // Product of signals //
@@ -325,6 +614,7 @@ namespace Covariance {
          if(su == 0.0 && sv == 0.0) {
             return;
          }
+         Invalidate();
 
 #ifdef USE_WOODBURY_IDENTITY
          const Float cov_xu = matrix[3];
@@ -373,22 +663,15 @@ namespace Covariance {
          // the Woodbury formula.
 
          Float inverse[16];
-         inverse[ 0] = matrix[ 0] + COV_MIN_FLOAT;
-         inverse[ 1] = matrix[ 1]; inverse[ 4] = matrix[ 1];
-         inverse[ 5] = matrix[ 2] + COV_MIN_FLOAT;
-         inverse[ 2] = matrix[ 3]; inverse[ 8] = matrix[ 3];
-         inverse[ 6] = matrix[ 4]; inverse[ 9] = matrix[ 4];
-         inverse[10] = matrix[ 5] + COV_MIN_FLOAT;
-         inverse[ 3] = matrix[ 6]; inverse[12] = matrix[ 6];
-         inverse[ 7] = matrix[ 7]; inverse[13] = matrix[ 7];
-         inverse[11] = matrix[ 8]; inverse[14] = matrix[ 8];
-         inverse[15] = matrix[ 9] + COV_MIN_FLOAT;
-
-         if(!Inverse<Float>(inverse, 4)) { throw 1; }
-         inverse[10] += 1.0f/std::max<Float>(sv, COV_MIN_FLOAT);
-         inverse[15] += 1.0f/std::max<Float>(su, COV_MIN_FLOAT);
-
-         if(!Inverse<Float>(inverse, 4)) { throw 1; }
+         this->InverseMatrix(inverse);
+         inverse[10] += 1.0f/std::max<Float>(sv, Limits<Float>::CovMin());
+         inverse[15] += 1.0f/std::max<Float>(su, Limits<Float>::CovMin());
+
+         const Float packed[10] = { inverse[ 0],
+                                    inverse[ 1], inverse[ 5],
+                                    inverse[ 2], inverse[ 6], inverse[10],
+                                    inverse[ 3], inverse[ 7], inverse[11], inverse[15] };
+         if(!SymmetricInverse4<Float>(packed, inverse)) { COV_THROW; }
          matrix[ 0] = inverse[ 0];
          matrix[ 1] = inverse[ 1];
          matrix[ 2] = inverse[ 5];
@@ -407,8 +690,10 @@ namespace Covariance {
       /////////////////////////////
 
       void Add(const Covariance4D& cov, Float L1=1.0f, Float L2=1.0f) {
+         COV_TIME(Cov4D, Add);
          const Float L = L1+L2;
          if(L <= 0.0f) return;
+         Invalidate();
 
          for(unsigned short i=0; i<10; ++i) {
             matrix[i] = (L1*matrix[i] + L2*cov.matrix[i]) / L;
@@ -437,75 +722,39 @@ namespace Covariance {
        *  equivalent ray differential [Igehy 1999].
        */
       void Extent(Vector& Dx, Vector& Dy, Vector& Du, Vector& Dv) const {
-         // Compute the inverse matrix. 
-         Float inverse[16];
-         this->InverseMatrix(inverse);
+         if(!TryExtent(Dx, Dy, Du, Dv)) { COV_THROW; }
+      }
 
-          // T = trace and D = det of the spatial submatrix
-          Float T = inverse[0]+inverse[5];
-          Float D = inverse[0]*inverse[5] - inverse[1]*inverse[1];
-
-          // Solve the 2nd order polynomial roots of p(l) = l^2 - l T + D.
-          // This gives us the eigen values.
-          Float d  = 0.25*T*T - D;
-          if(d < 0.0) { throw 1; } // No solution exists
-          Float l1 = 0.5*T + sqrt(d);
-          Float l2 = 0.5*T - sqrt(d);
-
-          if(abs(inverse[1]) > COV_MIN_FLOAT) {
-            Dx.x = l1 - inverse[5];
-            Dx.y = inverse[1];
-            Dx.z = 0.0;
-            Dy.x = l2 - inverse[5];
-            Dy.y = inverse[1];
-            Dy.z = 0.0;
-
-            Dx.Normalize();
-            Dy.Normalize();
-
-            Dx = sqrt(l1)/(2.0*M_PI) * Dx;
-            Dy = sqrt(l2)/(2.0*M_PI) * Dy;
-          } else {
-            Dx.x = sqrt(inverse[0])/(2.0*M_PI);
-            Dx.y = 0.0;
-            Dx.z = 0.0;
-            Dy.x = 0.0;
-            Dy.y = sqrt(inverse[5])/(2.0*M_PI);
-            Dy.z = 0.0;
-          }
-
-          // T = trace and D = det of the angluar submatrix
-          T = inverse[10]+inverse[15];
-          D = inverse[10]*inverse[15] - inverse[11]*inverse[11];
-
-          // Solve the 2nd order polynomial roots of p(l) = l^2 - l T + D.
-          // This gives us the eigen values.
-          d  = 0.25*T*T - D;
-          if(d < 0.0) { throw 1; } // No solution exists
-          l1 = 0.5*T + sqrt(d);
-          l2 = 0.5*T - sqrt(d);
-
-          if(abs(inverse[11]) > COV_MIN_FLOAT) {
-            Du.x = l1 - inverse[15];
-            Du.y = inverse[11];
-            Du.z = 0.0;
-            Dv.x = l2 - inverse[15];
-            Dv.y = inverse[11];
-            Dv.z = 0.0;
-
-            Du.Normalize();
-            Dv.Normalize();
-
-            Du = sqrt(l1)/(2.0*M_PI) * Du;
-            Dv = sqrt(l2)/(2.0*M_PI) * Dv;
-          } else {
-            Du.x = sqrt(inverse[10])/(2.0*M_PI);
-            Du.y = 0.0;
-            Du.z = 0.0;
-            Dv.x = 0.0;
-            Dv.y = sqrt(inverse[15])/(2.0*M_PI);
-            Dv.z = 0.0;
-          }
+      /* Same as above without exception. Return 'false' if the matrix cannot
+       * be inverted, in which case the extent is the one of the isotropic
+       * filter of maximal bandwidth (see 'FallbackExtent').
+       */
+      bool TryExtent(Vector& Dx, Vector& Dy, Vector& Du, Vector& Dv) const noexcept {
+         const Factor factor = Factorize();
+         if(factor.positive) {
+            Extent(factor, Dx, Dy, Du, Dv);
+            return true;
+         }
+         FallbackExtent(Dx, Dy);
+         FallbackExtent(Du, Dv);
+         return false;
+      }
+
+      /* Same as above using a precomputed factorization of the matrix.
+       */
+      void Extent(const Factor& factor,
+                  Vector& Dx, Vector& Dy, Vector& Du, Vector& Dv) const {
+         SpatialExtent(factor, Dx, Dy);
+         AngularExtent(factor, Du, Dv);
+      }
+
+      /* Footprint of the isotropic filter of maximal bandwidth, which is the
+       * one of a filter 'sxx = syy = Limits::CovMax'.
+       */
+      static inline void FallbackExtent(Vector& D1, Vector& D2) {
+         const Float a = 4.0*M_PI*M_PI * Limits<Float>::CovMin();
+         ExtentAxes(a, Float(0.0), a,
+                    Limits<Float>::CovMin(), D1, D2);
       }
 
 
@@ -518,27 +767,35 @@ namespace Covariance {
        *  matrix in frequency space.
        */
       void SpatialFilter(Float& sxx, Float& sxy, Float& syy) const {
+         if(!TrySpatialFilter(sxx, sxy, syy)) { COV_THROW; }
+      }
 
-         // Compute the inverse matrix. We need to add an epsilon to the
-         // diagonal in order to ensure that the matrix can be inverted.
-         Float inverse[16];
-         inverse[ 0] = matrix[ 0] + COV_MIN_FLOAT;
-         inverse[ 1] = matrix[ 1]; inverse[ 4] = matrix[ 1];
-         inverse[ 5] = matrix[ 2] + COV_MIN_FLOAT;
-         inverse[ 2] = matrix[ 3]; inverse[ 8] = matrix[ 3];
-         inverse[ 6] = matrix[ 4]; inverse[ 9] = matrix[ 4];
-         inverse[10] = matrix[ 5] + COV_MIN_FLOAT;
-         inverse[ 3] = matrix[ 6]; inverse[12] = matrix[ 6];
-         inverse[ 7] = matrix[ 7]; inverse[13] = matrix[ 7];
-         inverse[11] = matrix[ 8]; inverse[14] = matrix[ 8];
-         inverse[15] = matrix[ 9] + COV_MIN_FLOAT;
-
-         if(!Inverse<Float>(inverse, 4)) { throw 1; }
+      /* Same as above without exception. Return 'false' if the matrix cannot
+       * be inverted, in which case the filter is isotropic with the maximal
+       * bandwidth.
+       */
+      bool TrySpatialFilter(Float& sxx, Float& sxy, Float& syy) const noexcept {
+         const Factor factor = Factorize();
+         if(factor.positive) {
+            SpatialFilter(factor, sxx, sxy, syy);
+            return true;
+         }
+         sxx = Limits<Float>::CovMax();
+         syy = Limits<Float>::CovMax();
+         sxy = 0.0;
+         return false;
+      }
+
+      /* Same as above using a precomputed factorization of the matrix.
+       */
+      void SpatialFilter(const Factor& factor,
+                         Float& sxx, Float& sxy, Float& syy) const {
+         const Float* inverse = factor.inverse;
 
          // The outgoing filter is the inverse submatrix of this inverse
          // matrix.
-         Float det = (inverse[0]*inverse[5]-inverse[1]*inverse[1]) / pow(2.0*M_PI, 2);
-         sxx =  inverse[5] / det;
+         Float det = (inverse[0]*inverse[2]-inverse[1]*inverse[1]) / pow(2.0*M_PI, 2);
+         sxx =  inverse[2] / det;
          syy =  inverse[0] / det;
          sxy = -inverse[1] / det;
       }
@@ -557,54 +814,27 @@ namespace Covariance {
        *  of the polygonal shape.
        */
       void SpatialExtent(Vector& Dx, Vector& Dy) const {
-         // Compute the inverse matrix. We need to add an epsilon to the
-         // diagonal in order to ensure that the matrix can be inverted.
-         Float inverse[16];
-         inverse[ 0] = matrix[ 0] + COV_MIN_FLOAT;
-         inverse[ 1] = matrix[ 1]; inverse[ 4] = matrix[ 1];
-         inverse[ 5] = matrix[ 2] + COV_MIN_FLOAT;
-         inverse[ 2] = matrix[ 3]; inverse[ 8] = matrix[ 3];
-         inverse[ 6] = matrix[ 4]; inverse[ 9] = matrix[ 4];
-         inverse[10] = matrix[ 5] + COV_MIN_FLOAT;
-         inverse[ 3] = matrix[ 6]; inverse[12] = matrix[ 6];
-         inverse[ 7] = matrix[ 7]; inverse[13] = matrix[ 7];
-         inverse[11] = matrix[ 8]; inverse[14] = matrix[ 8];
-         inverse[15] = matrix[ 9] + COV_MIN_FLOAT;
-
-         if(!Inverse<Float>(inverse, 4)) { throw 1; }
-
-          // T = trace and D = det of the spatial submatrix
-          Float T = inverse[0]+inverse[5];
-          Float D = inverse[0]*inverse[5] - inverse[1]*inverse[1];
-
-          // Solve the 2nd order polynomial roots of p(l) = l^2 - l T + D.
-          // This gives us the eigen values.
-          Float d  = 0.25*T*T - D;
-          if(d < 0.0) { throw 1; } // No solution exists
-          Float l1 = 0.5*T + sqrt(d);
-          Float l2 = 0.5*T - sqrt(d);
-
-          if(abs(inverse[1]) > COV_MIN_FLOAT) {
-            Dx.x = l1 - inverse[5];
-            Dx.y = inverse[1];
-            Dx.z = 0.0;
-            Dy.x = l2 - inverse[5];
-            Dy.y = inverse[1];
-            Dy.z = 0.0;
-
-            Dx.Normalize();
-            Dy.Normalize();
-
-            Dx = sqrt(l1)/(2.0*M_PI) * Dx;
-            Dy = sqrt(l2)/(2.0*M_PI) * Dy;
-          } else {
-            Dx.x = sqrt(inverse[0])/(2.0*M_PI);
-            Dx.y = 0.0;
-            Dx.z = 0.0;
-            Dy.x = 0.0;
-            Dy.y = sqrt(inverse[5])/(2.0*M_PI);
-            Dy.z = 0.0;
-          }
+         if(!TrySpatialExtent(Dx, Dy)) { COV_THROW; }
+      }
+
+      /* Same as above without exception. See 'TryExtent'.
+       */
+      bool TrySpatialExtent(Vector& Dx, Vector& Dy) const noexcept {
+         const Factor factor = Factorize();
+         if(factor.positive) {
+            SpatialExtent(factor, Dx, Dy);
+            return true;
+         }
+         FallbackExtent(Dx, Dy);
+         return false;
+      }
+
+      /* Same as above using a precomputed factorization of the matrix.
+       */
+      void SpatialExtent(const Factor& factor, Vector& Dx, Vector& Dy) const {
+         const Float* inverse = factor.inverse;
+         ExtentAxes(inverse[0], inverse[1], inverse[2],
+                    Limits<Float>::CovMin(), Dx, Dy);
       }
 
 
@@ -618,26 +848,22 @@ namespace Covariance {
        *        f(u,v) = exp(- 0.5 (suu u^2 + 2 suv u v + svv v^2))
        * in the local tangent frame or directions..
        *
-       * This resumes to computing the inverse of the spatial submatrix from
-       * the inverse covariance matrix in frequency space.
+       * This resumes to computing the inverse of the angular submatrix of
+       * the covariance matrix. When the angular submatrix is degenerate,
+       * the filter is isotropic with the maximal bandwidth (see
+       * 'TryAngularFilter'). Throws if the regularized matrix cannot be
+       * inverted, like 'SpatialFilter'.
        */
       void AngularFilter(Float& suu, Float& suv, Float& svv) const {
+         if(!Factorize().positive) { COV_THROW; }
+         TryAngularFilter(suu, suv, svv);
+      }
 
-         // Compute the inverse matrix. We need to add an epsilon to the
-         // diagonal in order to ensure that the matrix can be inverted.
-         Float inverse[16];
-         inverse[ 0] = matrix[ 0] + COV_MIN_FLOAT;
-         inverse[ 1] = matrix[ 1]; inverse[ 4] = matrix[ 1];
-         inverse[ 5] = matrix[ 2] + COV_MIN_FLOAT;
-         inverse[ 2] = matrix[ 3]; inverse[ 8] = matrix[ 3];
-         inverse[ 6] = matrix[ 4]; inverse[ 9] = matrix[ 4];
-         inverse[10] = matrix[ 5] + COV_MIN_FLOAT;
-         inverse[ 3] = matrix[ 6]; inverse[12] = matrix[ 6];
-         inverse[ 7] = matrix[ 7]; inverse[13] = matrix[ 7];
-         inverse[11] = matrix[ 8]; inverse[14] = matrix[ 8];
-         inverse[15] = matrix[ 9] + COV_MIN_FLOAT;
-
-         if(!Inverse<Float>(inverse, 4)) { throw 1; }
+      /* Same as above, returning 'false' when the angular submatrix is
+       * degenerate, in which case the filter is isotropic with the maximal
+       * bandwidth.
+       */
+      bool TryAngularFilter(Float& suu, Float& suv, Float& svv) const noexcept {
 
          // The outgoing filter is the inverse submatrix of this inverse
          // matrix.
@@ -646,10 +872,12 @@ namespace Covariance {
             suu =  matrix[9] / det;
             svv =  matrix[5] / det;
             suv = -matrix[8] / det;
+            return true;
          } else {
-            suu = COV_MAX_FLOAT;
-            svv = COV_MAX_FLOAT;
+            suu = Limits<Float>::CovMax();
+            svv = Limits<Float>::CovMax();
             suv = 0.0;
+            return false;
          }
       }
 
@@ -667,74 +895,47 @@ namespace Covariance {
        *  of the polygonal shape.
        */
       void AngularExtent(Vector& Du, Vector& Dv) const {
-         // Compute the inverse matrix. We need to add an epsilon to the
-         // diagonal in order to ensure that the matrix can be inverted.
-         Float inverse[16];
-         inverse[ 0] = matrix[ 0] + COV_MIN_FLOAT;
-         inverse[ 1] = matrix[ 1]; inverse[ 4] = matrix[ 1];
-         inverse[ 5] = matrix[ 2] + COV_MIN_FLOAT;
-         inverse[ 2] = matrix[ 3]; inverse[ 8] = matrix[ 3];
-         inverse[ 6] = matrix[ 4]; inverse[ 9] = matrix[ 4];
-         inverse[10] = matrix[ 5] + COV_MIN_FLOAT;
-         inverse[ 3] = matrix[ 6]; inverse[12] = matrix[ 6];
-         inverse[ 7] = matrix[ 7]; inverse[13] = matrix[ 7];
-         inverse[11] = matrix[ 8]; inverse[14] = matrix[ 8];
-         inverse[15] = matrix[ 9] + COV_MIN_FLOAT;
-
-         if(!Inverse<Float>(inverse, 4)) { throw 1; }
-
-          // T = trace and D = det of the spatial submatrix
-          Float T = inverse[10]+inverse[15];
-          Float D = inverse[10]*inverse[15] - inverse[11]*inverse[11];
-
-          // Solve the 2nd order polynomial roots of p(l) = l^2 - l T + D.
-          // This gives us the eigen values.
-          Float d  = 0.25*T*T - D;
-          if(d < 0.0) { throw 1; } // No solution exists
-          Float l1 = 0.5*T + sqrt(d);
-          Float l2 = 0.5*T - sqrt(d);
-
-          if(abs(inverse[11]) > COV_MIN_FLOAT) {
-            Du.x = l1 - inverse[15];
-            Du.y = inverse[11];
-            Du.z = 0.0;
-            Dv.x = l2 - inverse[15];
-            Dv.y = inverse[11];
-            Dv.z = 0.0;
-
-            Du.Normalize();
-            Dv.Normalize();
-
-            Du = sqrt(l1)/(2.0*M_PI) * Du;
-            Dv = sqrt(l2)/(2.0*M_PI) * Dv;
-          } else {
-            Du.x = sqrt(inverse[10])/(2.0*M_PI);
-            Du.y = 0.0;
-            Du.z = 0.0;
-            Dv.x = 0.0;
-            Dv.y = sqrt(inverse[15])/(2.0*M_PI);
-            Dv.z = 0.0;
-          }
+         if(!TryAngularExtent(Du, Dv)) { COV_THROW; }
+      }
+
+      /* Same as above without exception. See 'TryExtent'.
+       */
+      bool TryAngularExtent(Vector& Du, Vector& Dv) const noexcept {
+         const Factor factor = Factorize();
+         if(factor.positive) {
+            AngularExtent(factor, Du, Dv);
+            return true;
+         }
+         FallbackExtent(Du, Dv);
+         return false;
+      }
+
+      /* Same as above using a precomputed factorization of the matrix.
+       */
+      void AngularExtent(const Factor& factor, Vector& Du, Vector& Dv) const {
+         const Float* inverse = factor.inverse;
+         ExtentAxes(inverse[5], inverse[8], inverse[9],
+                    Limits<Float>::CovMin(), Du, Dv);
       }
 
       /* Compute the volume (in frequency domain) spanned by the matrix.
        * Note: this volume should always be positive.
        */
       Float Volume() const {
+         COV_TIME(Cov4D, Volume);
+         const std::array<Float, 10> regular = RegularizedMatrix();
+         const Float volume = SymmetricDeterminant4<Float>(regular.data());
+         COV_COUNT_VOLUME(Cov4D, volume);
+         return volume;
+      }
 
-         Float fmatrix[16];
-         fmatrix[ 0] = matrix[ 0] + COV_MIN_FLOAT;
-         fmatrix[ 1] = matrix[ 1]; fmatrix[ 4] = matrix[ 1];
-         fmatrix[ 5] = matrix[ 2] + COV_MIN_FLOAT;
-         fmatrix[ 2] = matrix[ 3]; fmatrix[ 8] = matrix[ 3];
-         fmatrix[ 6] = matrix[ 4]; fmatrix[ 9] = matrix[ 4];
-         fmatrix[10] = matrix[ 5] + COV_MIN_FLOAT;
-         fmatrix[ 3] = matrix[ 6]; fmatrix[12] = matrix[ 6];
-         fmatrix[ 7] = matrix[ 7]; fmatrix[13] = matrix[ 7];
-         fmatrix[11] = matrix[ 8]; fmatrix[14] = matrix[ 8];
-         fmatrix[15] = matrix[ 9] + COV_MIN_FLOAT;
-
-         return Determinant<Float>(fmatrix, 4);
+      /* Same as above using a precomputed factorization of the matrix.
+       */
+      Float Volume(const Factor& factor) const {
+         COV_TIME(Cov4D, Volume);
+         const Float volume = factor.Determinant();
+         COV_COUNT_VOLUME(Cov4D, volume);
+         return volume;
       }
 
       /////////////////////
@@ -763,4 +964,5 @@ namespace Covariance {
                    const Vector& z) :
          matrix(matrix), x(x), y(y), z(z) {}
    };
+   } // inline namespace
 }
@@ -0,0 +1,705 @@
+#pragma once
+
+// STL includes
+#include <array>
+#include <cmath>
+
+// Local includes
+#include "Matrix.hpp"
+#include "Frame.hpp"
+#include "Limits.hpp"
+#include "Covariance4D.hpp"
+
+namespace Covariance {
+
+   /* The 5D version of Covariance Tracing.
+    * This is the temporal version of 'Covariance4D': the local lightfield
+    * around the central ray is described in the (X, Y, U, V, T) coordinates
+    * where T is the time (Belcour 2013). It allows to adapt the sampling and
+    * the shutter filter to motion blur.
+    *
+    * The covariance matrix is a 5x5 symetric Matrix and we only deal with the
+    * upper triangle. The first 10 entries are the ones of 'Covariance4D' and
+    * the time column is appended:
+    *
+    * C =  ( 0  1  3  6 10)
+    *      ( *  2  4  7 11)
+    *      ( *  *  5  8 12)
+    *      ( *  *  *  9 13)
+    *      ( *  *  *  * 14)
+    *
+    * All the operators of 'Covariance4D' are linear transforms of the
+    * spatio-angular coordinates: they act on the 4x4 block as in
+    * 'Covariance4D' and on the time column as on a vector. Motion is a shear
+    * of the time domain by the spatial domain (see 'Motion').
+    */
+   template<class Vector, typename Float>
+   struct Covariance5D {
+
+      // Data
+      std::array<Float, 15> matrix;
+      Vector x, y, z;
+
+
+      ////////////////////////
+      //  Atomic operators  //
+      ////////////////////////
+
+      /* Travel operator
+       *
+       * 'd' distance of travel along the central ray
+       */
+      inline void Travel(Float d) {
+         ShearAngleSpace(d, d);
+      }
+
+      /* Curvature operator
+       *
+       * 'kx' curvature along the X direction
+       * 'ky' curvature along the Y direction
+       */
+      inline void Curvature(Float kx, Float ky) {
+         ShearSpaceAngle(kx, ky);
+      }
+
+      /* Motion operator
+       *
+       * 'vx' velocity of the local lightfield along the X direction
+       * 'vy' velocity of the local lightfield along the Y direction
+       *
+       * A lightfield moving at velocity (vx, vy) in the local frame has its
+       * spectrum sheared along the time frequency by the spatial frequencies.
+       */
+      inline void Motion(Float vx, Float vy) {
+         ShearTimeSpace(vx, vy);
+      }
+
+      /* Cosine operator
+       *
+       * 'wz' The incident direction's elevation in the local frame
+       */
+      inline void Cosine(Float wz) {
+         const Float theta = acos(wz);
+         const Float dist  = std::abs(0.5*M_PI-theta);
+         const Float frequ = 2.0 / M_PI;
+         const Float freqv = 1.0 / fmax(dist, 1.0E-10);
+         matrix[5] += frequ*frequ;
+         matrix[9] += freqv*freqv;
+      }
+
+      /* Cosine operator at normal incidence. See 'Covariance4D::Cosine'.
+       */
+      inline void Cosine() {
+         const Float freq2 = 4.0 / (M_PI*M_PI);
+         matrix[5] += freq2;
+         matrix[9] += freq2;
+      }
+
+      /* Reflection operator
+       *
+       * 'suu' the covariance of the BRDF along the X axis.
+       * 'svv' the covariance of the BRDF along the Y axis.
+       */
+      inline void Reflection(Float suu, Float svv) {
+         const Float cmin = Limits<Float>::CovMin(), cmax = Limits<Float>::CovMax();
+         if(suu < cmax && svv < cmax) {
+            ProductUV(fmax(suu, cmin), fmax(svv, cmin));
+         }
+      }
+
+
+      /////////////////////////////
+      //  Local Frame alignment  //
+      /////////////////////////////
+
+      /* See 'Covariance4D::Projection'.
+       */
+      inline void Projection(const Vector& n) {
+         const auto cx = Vector::Dot(x, n);
+         const auto cy = Vector::Dot(y, n);
+
+         // Rotate the Frame to be aligned with plane.
+         Float c, s;
+         FrameRotation<Float>(cx, cy, c, s);
+         Rotate(c, s);
+
+         const Float cosine = Vector::Dot(z, n);
+         ScaleY(std::abs(cosine));
+
+         // Update direction vectors.
+         x = c*x + s*y;
+         z = (cosine < 0.0f) ? -n : n;
+         y = (cosine < 0.0f) ?  Vector::Cross(x, z) : Vector::Cross(z, x);
+      }
+
+      /* See 'Covariance4D::InverseProjection'.
+       */
+      inline void InverseProjection(const Vector& d) {
+         const auto cx = Vector::Dot(x, d);
+         const auto cy = Vector::Dot(y, d);
+
+         // Rotate the Frame to be aligned with plane.
+         Float c, s;
+         FrameRotation<Float>(cx, cy, c, s);
+         Rotate(c, s);
+
+         const Float cosine = Vector::Dot(z, d);
+         if(cosine < 0.0f) {
+            ScaleV(-1.0f);
+            ScaleU(-1.0f);
+         }
+         ScaleY(1.0/fmax(fabs(cosine), Limits<Float>::CovMin()));
+
+         // Update direction vectors.
+         x = c*x + s*y;
+         z = d;
+         y = Vector::Cross(z, x);
+      }
+
+      inline void Symmetry() {
+         matrix[3]  = -matrix[3];
+         matrix[4]  = -matrix[4];
+         matrix[6]  = -matrix[6];
+         matrix[7]  = -matrix[7];
+         matrix[12] = -matrix[12];
+         matrix[13] = -matrix[13];
+      }
+
+
+      /////////////////////////
+      //   Fused operators   //
+      /////////////////////////
+
+      /* Surface interaction operator. See
+       * 'Covariance4D::SurfaceInteraction'. This is equivalent to:
+       *
+       *    Projection(n);
+       *    Curvature(k, k);
+       *    Cosine(wz);
+       *    Symmetry();
+       *    Reflection(rho_u, rho_v);
+       *    Curvature(-k, -k);
+       *    InverseProjection(wo);
+       *    Travel(t);
+       *
+       * but the operators between the two projections are evaluated on a
+       * local copy of the matrix entries.
+       */
+      inline void SurfaceInteraction(const Vector& n, Float k, const Vector& wo,
+                                     Float rho_u, Float rho_v, Float t,
+                                     Float wz = 1.0) {
+         Projection(n);
+
+         Float m[15];
+         for(int i=0; i<15; ++i) { m[i] = matrix[i]; }
+
+         // Curvature(k, k)
+         ShearSpaceAngle(m, k, k);
+
+         // Cosine(wz)
+         const Float dist  = std::abs(0.5*M_PI-acos(wz));
+         const Float frequ = 2.0 / M_PI;
+         const Float freqv = 1.0 / fmax(dist, 1.0E-10);
+         m[5] += frequ*frequ;
+         m[9] += freqv*freqv;
+
+         // Symmetry()
+         m[3]  = -m[3];  m[4]  = -m[4];
+         m[6]  = -m[6];  m[7]  = -m[7];
+         m[12] = -m[12]; m[13] = -m[13];
+
+         // Reflection(rho_u, rho_v)
+         Float su, sv;
+         ReflectionLane(rho_u, rho_v, su, sv);
+         ProductUV(m, su, sv);
+
+         // Curvature(-k, -k)
+         ShearSpaceAngle(m, -k, -k);
+
+         for(int i=0; i<15; ++i) { matrix[i] = m[i]; }
+
+         InverseProjection(wo);
+         Travel(t);
+      }
+
+
+      ////////////////////////
+      //   Matrix scaling   //
+      ////////////////////////
+
+      inline void ScaleX(Float alpha) {
+         matrix[0]  *= alpha*alpha;
+         matrix[1]  *= alpha;
+         matrix[3]  *= alpha;
+         matrix[6]  *= alpha;
+         matrix[10] *= alpha;
+      }
+
+      inline void ScaleY(Float alpha) {
+         matrix[1]  *= alpha;
+         matrix[2]  *= alpha*alpha;
+         matrix[4]  *= alpha;
+         matrix[7]  *= alpha;
+         matrix[11] *= alpha;
+      }
+
+      inline void ScaleU(Float alpha) {
+         matrix[3]  *= alpha;
+         matrix[4]  *= alpha;
+         matrix[5]  *= alpha*alpha;
+         matrix[8]  *= alpha;
+         matrix[12] *= alpha;
+      }
+
+      inline void ScaleV(Float alpha) {
+         matrix[6]  *= alpha;
+         matrix[7]  *= alpha;
+         matrix[8]  *= alpha;
+         matrix[9]  *= alpha*alpha;
+         matrix[13] *= alpha;
+      }
+
+      inline void ScaleT(Float alpha) {
+         matrix[10] *= alpha;
+         matrix[11] *= alpha;
+         matrix[12] *= alpha;
+         matrix[13] *= alpha;
+         matrix[14] *= alpha*alpha;
+      }
+
+
+      ////////////////////////
+      //   Matrix shearing  //
+      ////////////////////////
+
+      // Shear the Spatial (x,y) domain by the Angular (u,v).
+      inline void ShearSpaceAngle(Float cx, Float cy) {
+         ShearSpaceAngle(matrix.data(), cx, cy);
+      }
+
+      // Same as above on the 15 packed entries 'm'.
+      static inline void ShearSpaceAngle(Float* m, Float cx, Float cy) {
+         m[0]  += (m[5]*cx - 2*m[3])*cx;
+         m[1]  +=  m[8]*cx*cy - (m[4]*cy + m[6]*cx);
+         m[2]  += (m[9]*cy - 2*m[7])*cy;
+         m[3]  -=  m[5]*cx;
+         m[4]  -=  m[8]*cy;
+         m[6]  -=  m[8]*cx;
+         m[7]  -=  m[9]*cy;
+         m[10] -=  m[12]*cx;
+         m[11] -=  m[13]*cy;
+      }
+
+      // Shear the angular (U, V) domain by the spatial (X, Y) domain.
+      inline void ShearAngleSpace(Float cu, Float cv) {
+         matrix[5]  += (matrix[0]*cu - 2*matrix[3])*cu;
+         matrix[3]  -=  matrix[0]*cu;
+         matrix[8]  +=  matrix[1]*cu*cv - (matrix[4]*cv + matrix[6]*cu);
+         matrix[4]  -=  matrix[1]*cv;
+         matrix[6]  -=  matrix[1]*cu;
+         matrix[9]  += (matrix[2]*cv - 2*matrix[7])*cv;
+         matrix[7]  -=  matrix[2]*cv;
+         matrix[12] -=  matrix[10]*cu;
+         matrix[13] -=  matrix[11]*cv;
+      }
+
+      // Shear the time (T) domain by the spatial (X, Y) domain.
+      inline void ShearTimeSpace(Float cx, Float cy) {
+         const Float tx = matrix[0]*cx + matrix[1]*cy;
+         const Float ty = matrix[1]*cx + matrix[2]*cy;
+         const Float tu = matrix[3]*cx + matrix[4]*cy;
+         const Float tv = matrix[6]*cx + matrix[7]*cy;
+         matrix[14] += (tx*cx + ty*cy) - 2*(matrix[10]*cx + matrix[11]*cy);
+         matrix[10] -= tx;
+         matrix[11] -= ty;
+         matrix[12] -= tu;
+         matrix[13] -= tv;
+      }
+
+
+      ////////////////////////
+      //   Matrix rotation  //
+      ////////////////////////
+
+      // alpha rotation angle
+      inline void Rotate(Float alpha) {
+         const Float c = cos(alpha);
+         const Float s = sin(alpha);
+         Rotate(c, s);
+      }
+
+      // 'c' the cosine of the rotation angle
+      // 's' the sine of the rotation angle
+      inline void Rotate(Float c, Float s) {
+         const Float cs = c*s;
+         const Float c2 = c*c;
+         const Float s2 = s*s;
+
+         const Float cov_xx = matrix[0];
+         const Float cov_xy = matrix[1];
+         const Float cov_yy = matrix[2];
+         const Float cov_xu = matrix[3];
+         const Float cov_yu = matrix[4];
+         const Float cov_uu = matrix[5];
+         const Float cov_xv = matrix[6];
+         const Float cov_yv = matrix[7];
+         const Float cov_uv = matrix[8];
+         const Float cov_vv = matrix[9];
+         const Float cov_xt = matrix[10];
+         const Float cov_yt = matrix[11];
+         const Float cov_ut = matrix[12];
+         const Float cov_vt = matrix[13];
+
+         // Rotation of the space
+         matrix[0] = c2 * cov_xx + 2*cs * cov_xy + s2 * cov_yy;
+         matrix[1] = (c2-s2) * cov_xy + cs * (cov_yy - cov_xx);
+         matrix[2] = c2 * cov_yy - 2*cs * cov_xy + s2 * cov_xx;
+
+         // Rotation of the angle
+         matrix[5] = c2 * cov_uu + 2*cs * cov_uv + s2 * cov_vv;
+         matrix[8] = (c2-s2) * cov_uv + cs * (cov_vv - cov_uu);
+         matrix[9] = c2 * cov_vv - 2*cs * cov_uv + s2 * cov_uu;
+
+         // Covariances
+         matrix[3] = c2 * cov_xu + cs * (cov_xv + cov_yu) + s2 * cov_yv;
+         matrix[4] = c2 * cov_yu + cs * (cov_yv - cov_xu) - s2 * cov_xv;
+         matrix[6] = c2 * cov_xv + cs * (cov_yv - cov_xu) - s2 * cov_yu;
+         matrix[7] = c2 * cov_yv - cs * (cov_xv + cov_yu) + s2 * cov_xu;
+
+         // Time column
+         matrix[10] = c * cov_xt + s * cov_yt;
+         matrix[11] = c * cov_yt - s * cov_xt;
+         matrix[12] = c * cov_ut + s * cov_vt;
+         matrix[13] = c * cov_vt - s * cov_ut;
+      }
+
+
+      ////////////////////////
+      //   Factorization    //
+      ////////////////////////
+
+      using Factor = SymmetricLDLT<Float, 5>;
+
+      /* Return the packed covariance matrix with an epsilon added to the
+       * diagonal in order to ensure that the matrix can be inverted.
+       */
+      inline std::array<Float, 15> RegularizedMatrix() const {
+         std::array<Float, 15> regular = matrix;
+         regular[0]  += Limits<Float>::CovMin();
+         regular[2]  += Limits<Float>::CovMin();
+         regular[5]  += Limits<Float>::CovMin();
+         regular[9]  += Limits<Float>::CovMin();
+         regular[14] += Limits<Float>::CovMin();
+         return regular;
+      }
+
+      /* Compute the LDL^T factorization of the (regularized) covariance
+       * matrix and its packed inverse. See 'Covariance4D::Factorize'.
+       */
+      Factor Factorize() const {
+         const std::array<Float, 15> regular = RegularizedMatrix();
+         Factor factor;
+         if(factor.Factor(regular.data())) {
+            factor.Invert();
+         }
+         return factor;
+      }
+
+      /* Compute the inverse of the (regularized) covariance matrix.
+       *
+       * 'inverse' needs to be a 5x5 preallocated matrix (25 Floats).
+       */
+      void InverseMatrix(Float* inverse) const {
+         if(!TryInverseMatrix(inverse)) { COV_THROW; }
+      }
+
+      /* Same as above without exception. Return 'false' if the matrix cannot
+       * be inverted, in which case 'inverse' is the isotropic inverse of
+       * maximal bandwidth.
+       */
+      bool TryInverseMatrix(Float* inverse) const noexcept {
+         const Factor factor = Factorize();
+         for(int i=0; i<5; ++i) {
+            for(int j=0; j<5; ++j) {
+               if(factor.positive) {
+                  inverse[5*i+j] = factor.inverse[Factor::Index(i, j)];
+               } else {
+                  inverse[5*i+j] = (i == j) ? Limits<Float>::CovMin() : Float(0.0);
+               }
+            }
+         }
+         return factor.positive;
+      }
+
+
+      ////////////////////////
+      // Product of signals //
+      ////////////////////////
+
+      /* Evaluate the covariance matrix of the product of the local lightfield
+       * and a angularly varying only signal (like a BSDF). This is the rank 2
+       * Woodbury update of 'ProductUVLane' extended to the time column.
+       *
+       * 'su' is the sigma u of the inverse angular signal's covariance matrix.
+       * 'sv' the sigma v of the inverse angular signal's covariance matrix.
+       */
+      inline void ProductUV(Float su, Float sv) {
+         ProductUV(matrix.data(), su, sv);
+      }
+
+      // Same as above on the 15 packed entries 'm'.
+      static inline void ProductUV(Float* m, Float su, Float sv) {
+         if(su == 0.0 && sv == 0.0) { return; }
+
+         const Float xu = m[3], yu = m[4], uu = m[5];
+         const Float xv = m[6], yv = m[7], uv = m[8], vv = m[9];
+         const Float ut = m[12], vt = m[13];
+
+         const Float sig_u = uu+su, sig_v = vv+sv;
+         const Float g     = Float(1.0) / MulAdd(sig_u, sig_v, -uv*uv);
+
+         // Rows of (C_uv + S)^-1 C_uv^T without the 1/det factor
+         const Float ax = MulAdd(sig_v, xu, -uv*xv), bx = MulAdd(sig_u, xv, -uv*xu);
+         const Float ay = MulAdd(sig_v, yu, -uv*yv), by = MulAdd(sig_u, yv, -uv*yu);
+         const Float au = MulAdd(sig_v, uu, -uv*uv), bu = MulAdd(sig_u, uv, -uv*uu);
+         const Float av = MulAdd(sig_v, uv, -uv*vv), bv = MulAdd(sig_u, vv, -uv*uv);
+         const Float at = MulAdd(sig_v, ut, -uv*vt), bt = MulAdd(sig_u, vt, -uv*ut);
+
+         m[0]  -= g*MulAdd(xu, ax, xv*bx);
+         m[1]  -= g*MulAdd(yu, ax, yv*bx);
+         m[2]  -= g*MulAdd(yu, ay, yv*by);
+         m[3]  -= g*MulAdd(uu, ax, uv*bx);
+         m[4]  -= g*MulAdd(uu, ay, uv*by);
+         m[5]  -= g*MulAdd(uu, au, uv*bu);
+         m[6]  -= g*MulAdd(uv, ax, vv*bx);
+         m[7]  -= g*MulAdd(uv, ay, vv*by);
+         m[8]  -= g*MulAdd(uv, au, vv*bu);
+         m[9]  -= g*MulAdd(uv, av, vv*bv);
+         m[10] -= g*MulAdd(ut, ax, vt*bx);
+         m[11] -= g*MulAdd(ut, ay, vt*by);
+         m[12] -= g*MulAdd(uu, at, uv*bt);
+         m[13] -= g*MulAdd(uv, at, vv*bt);
+         m[14] -= g*MulAdd(ut, at, vt*bt);
+      }
+
+
+      /////////////////////////////
+      // Add covariance together //
+      /////////////////////////////
+
+      void Add(const Covariance5D& cov, Float L1=1.0f, Float L2=1.0f) {
+         const Float L = L1+L2;
+         if(L <= 0.0f) return;
+
+         for(unsigned short i=0; i<15; ++i) {
+            matrix[i] = (L1*matrix[i] + L2*cov.matrix[i]) / L;
+         }
+      }
+
+
+      /////////////////////
+      //     Filters     //
+      /////////////////////
+
+      /* Compute the spatio-angular extent of the filter of the matrix. See
+       * 'Covariance4D::Extent'.
+       */
+      void Extent(Vector& Dx, Vector& Dy, Vector& Du, Vector& Dv) const {
+         if(!TryExtent(Dx, Dy, Du, Dv)) { COV_THROW; }
+      }
+
+      /* Same as above without exception. See 'Covariance4D::TryExtent'.
+       */
+      bool TryExtent(Vector& Dx, Vector& Dy, Vector& Du, Vector& Dv) const noexcept {
+         const Factor factor = Factorize();
+         if(factor.positive) {
+            Extent(factor, Dx, Dy, Du, Dv);
+            return true;
+         }
+         FallbackExtent(Dx, Dy);
+         FallbackExtent(Du, Dv);
+         return false;
+      }
+
+      void Extent(const Factor& factor,
+                  Vector& Dx, Vector& Dy, Vector& Du, Vector& Dv) const {
+         SpatialExtent(factor, Dx, Dy);
+         AngularExtent(factor, Du, Dv);
+      }
+
+      /* See 'Covariance4D::FallbackExtent'.
+       */
+      static inline void FallbackExtent(Vector& D1, Vector& D2) {
+         const Float a = 4.0*M_PI*M_PI * Limits<Float>::CovMin();
+         ExtentAxes(a, Float(0.0), a,
+                    Limits<Float>::CovMin(), D1, D2);
+      }
+
+      /* Compute the spatial filter in primal space. See
+       * 'Covariance4D::SpatialFilter'.
+       */
+      void SpatialFilter(Float& sxx, Float& sxy, Float& syy) const {
+         if(!TrySpatialFilter(sxx, sxy, syy)) { COV_THROW; }
+      }
+
+      /* Same as above without exception. See
+       * 'Covariance4D::TrySpatialFilter'.
+       */
+      bool TrySpatialFilter(Float& sxx, Float& sxy, Float& syy) const noexcept {
+         const Factor factor = Factorize();
+         if(factor.positive) {
+            SpatialFilter(factor, sxx, sxy, syy);
+            return true;
+         }
+         sxx = Limits<Float>::CovMax();
+         syy = Limits<Float>::CovMax();
+         sxy = 0.0;
+         return false;
+      }
+
+      void SpatialFilter(const Factor& factor,
+                         Float& sxx, Float& sxy, Float& syy) const {
+         const Float* inverse = factor.inverse;
+         Float det = (inverse[0]*inverse[2]-inverse[1]*inverse[1]) / pow(2.0*M_PI, 2);
+         sxx =  inverse[2] / det;
+         syy =  inverse[0] / det;
+         sxy = -inverse[1] / det;
+      }
+
+      /* Compute the spatial extent of the filter of the matrix. See
+       * 'Covariance4D::SpatialExtent'.
+       */
+      void SpatialExtent(Vector& Dx, Vector& Dy) const {
+         if(!TrySpatialExtent(Dx, Dy)) { COV_THROW; }
+      }
+
+      /* Same as above without exception. See 'TryExtent'.
+       */
+      bool TrySpatialExtent(Vector& Dx, Vector& Dy) const noexcept {
+         const Factor factor = Factorize();
+         if(factor.positive) {
+            SpatialExtent(factor, Dx, Dy);
+            return true;
+         }
+         FallbackExtent(Dx, Dy);
+         return false;
+      }
+
+      void SpatialExtent(const Factor& factor, Vector& Dx, Vector& Dy) const {
+         const Float* inverse = factor.inverse;
+         ExtentAxes(inverse[0], inverse[1], inverse[2],
+                    Limits<Float>::CovMin(), Dx, Dy);
+      }
+
+      /* Compute the angular filter in primal space. See
+       * 'Covariance4D::AngularFilter'. When the angular submatrix is
+       * degenerate, the filter is isotropic with the maximal bandwidth.
+       */
+      void AngularFilter(Float& suu, Float& suv, Float& svv) const {
+         TryAngularFilter(suu, suv, svv);
+      }
+
+      /* Same as above, returning 'false' when the angular submatrix is
+       * degenerate.
+       */
+      bool TryAngularFilter(Float& suu, Float& suv, Float& svv) const noexcept {
+         Float det = (matrix[5]*matrix[9]-matrix[8]*matrix[8]) / pow(2.0*M_PI,2);
+         if(det > 0.0) {
+            suu =  matrix[9] / det;
+            svv =  matrix[5] / det;
+            suv = -matrix[8] / det;
+            return true;
+         } else {
+            suu = Limits<Float>::CovMax();
+            svv = Limits<Float>::CovMax();
+            suv = 0.0;
+            return false;
+         }
+      }
+
+      /* Compute the angular extent of the filter of the matrix. See
+       * 'Covariance4D::AngularExtent'.
+       */
+      void AngularExtent(Vector& Du, Vector& Dv) const {
+         if(!TryAngularExtent(Du, Dv)) { COV_THROW; }
+      }
+
+      /* Same as above without exception. See 'TryExtent'.
+       */
+      bool TryAngularExtent(Vector& Du, Vector& Dv) const noexcept {
+         const Factor factor = Factorize();
+         if(factor.positive) {
+            AngularExtent(factor, Du, Dv);
+            return true;
+         }
+         FallbackExtent(Du, Dv);
+         return false;
+      }
+
+      void AngularExtent(const Factor& factor, Vector& Du, Vector& Dv) const {
+         const Float* inverse = factor.inverse;
+         ExtentAxes(inverse[5], inverse[8], inverse[9],
+                    Limits<Float>::CovMin(), Du, Dv);
+      }
+
+      /* Compute the temporal filter in primal space. The shutter filter is
+       * the 1D Gaussian f(t) = exp(- 0.5 stt t^2). Like the spatial filter,
+       * it is the inverse of the time entry of the inverse matrix.
+       */
+      void TemporalFilter(Float& stt) const {
+         if(!TryTemporalFilter(stt)) { COV_THROW; }
+      }
+
+      /* Same as above without exception. Return 'false' if the matrix cannot
+       * be inverted, in which case the filter has the maximal bandwidth.
+       */
+      bool TryTemporalFilter(Float& stt) const noexcept {
+         const Factor factor = Factorize();
+         if(factor.positive) {
+            TemporalFilter(factor, stt);
+            return true;
+         }
+         stt = Limits<Float>::CovMax();
+         return false;
+      }
+
+      void TemporalFilter(const Factor& factor, Float& stt) const {
+         stt = pow(2.0*M_PI, 2) / factor.inverse[14];
+      }
+
+      /* Compute the volume of the covariance matrix, which is the
+       * determinant of the regularized matrix.
+       */
+      Float Volume() const {
+         const std::array<Float, 15> regular = RegularizedMatrix();
+         Factor factor;
+         factor.Factor(regular.data());
+         return factor.positive ? factor.Determinant() : Float(0.0);
+      }
+
+
+      /////////////////////
+      //   Constructors  //
+      /////////////////////
+
+      Covariance5D() {
+         matrix = { 0.0f,
+                    0.0f, 0.0f,
+                    0.0f, 0.0f, 0.0f,
+                    0.0f, 0.0f, 0.0f, 0.0f,
+                    0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+      }
+      Covariance5D(Float sxx, Float syy, Float suu, Float svv, Float stt) {
+         matrix = {  sxx,
+                    0.0f,  syy,
+                    0.0f, 0.0f,  suu,
+                    0.0f, 0.0f, 0.0f,  svv,
+                    0.0f, 0.0f, 0.0f, 0.0f,  stt};
+      }
+      Covariance5D(std::array<Float, 15> matrix,
+                   const Vector& x,
+                   const Vector& y,
+                   const Vector& z) :
+         matrix(matrix), x(x), y(y), z(z) {}
+   };
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+// STL includes
+#include <cmath>
+#include <cstddef>
+
+// Local includes
+#include "Covariance2D.hpp"
+
+// For 'COV_SIMD'
+#include "Matrix.hpp"
+
+namespace Covariance {
+
+   /* Batch of 'N' 2D covariance matrices stored as structure of arrays.
+    *
+    * This is the packet version of 'Covariance2D', organized like
+    * 'CovarianceBatch4D': each of the 3 entries of the packed matrix and each
+    * component of the local frame is stored in its own array of 'N' lanes,
+    * and operators take one parameter per lane. 2D vectors are passed as
+    * arrays of 2 components of 'N' lanes:
+    *
+    *    Float n[2][N]; // n[0] is the X component of all the lanes, ...
+    *
+    * Use 'Load' and 'Store' to move a lane from and to a 'Covariance2D'.
+    */
+   template<typename Float, int N>
+   struct CovarianceBatch2D {
+
+      alignas(64) Float matrix[3][N];
+      alignas(64) Float x[2][N];
+      alignas(64) Float z[2][N];
+
+
+      /////////////////////////
+      //  Lanes load / store //
+      /////////////////////////
+
+      template<class Vector>
+      inline void Load(int i, const Covariance2D<Vector, Float>& cov) {
+         for(int k=0; k<3; ++k) {
+            matrix[k][i] = cov.matrix[k];
+         }
+         x[0][i] = cov.x.x; x[1][i] = cov.x.y;
+         z[0][i] = cov.z.x; z[1][i] = cov.z.y;
+      }
+
+      template<class Vector>
+      inline void Store(int i, Covariance2D<Vector, Float>& cov) const {
+         for(int k=0; k<3; ++k) {
+            cov.matrix[k] = matrix[k][i];
+         }
+         cov.x.x = x[0][i]; cov.x.y = x[1][i];
+         cov.z.x = z[0][i]; cov.z.y = z[1][i];
+      }
+
+
+      ////////////////////////
+      //  Atomic operators  //
+      ////////////////////////
+
+      inline void Travel(const Float* d) {
+         ShearAngleSpace(d);
+      }
+
+      inline void Curvature(const Float* k) {
+         ShearSpaceAngle(k);
+      }
+
+      inline void Cosine(const Float* wz) {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            const Float theta = acos(wz[i]);
+            const Float dist  = std::abs(0.5*M_PI-theta);
+            const Float freq  = 1.0 / fmax(dist, 1.0E-10);
+            matrix[2][i] += freq*freq;
+         }
+      }
+
+      /* Reflection operator. Lanes with a covariance above 'Limits::CovMax'
+       * are left untouched, as with 'Covariance2D::Reflection'.
+       */
+      inline void Reflection(const Float* s) {
+         const Float cmin = Limits<Float>::CovMin(), cmax = Limits<Float>::CovMax();
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            const Float si = (s[i] < cmax) ? Float(fmax(s[i], cmin)) : Float(0.0);
+            ProductULane(matrix[0][i], matrix[1][i], matrix[2][i], si);
+         }
+      }
+
+      inline void Symmetry() {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            matrix[1][i] = -matrix[1][i];
+         }
+      }
+
+
+      /////////////////////////////
+      //  Local Frame alignment  //
+      /////////////////////////////
+
+      /* See 'Covariance2D::Projection'.
+       */
+      inline void Projection(const Float (&n)[2][N]) {
+         const Float eps = Limits<Float>::CovMin();
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            const Float cz = z[0][i]*n[0][i] + z[1][i]*n[1][i];
+            const Float a  = std::abs(cz);
+            matrix[0][i] *= a*a;
+            matrix[1][i] *= a;
+
+            const Float sg = (cz < 0.0) ? Float(-1.0) : Float(1.0);
+            z[0][i] = sg*n[0][i]; z[1][i] = sg*n[1][i];
+            Tangent(i, eps);
+         }
+      }
+
+      /* See 'Covariance2D::InverseProjection'.
+       */
+      inline void InverseProjection(const Float (&d)[2][N]) {
+         const Float eps = Limits<Float>::CovMin();
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            const Float cz = z[0][i]*d[0][i] + z[1][i]*d[1][i];
+            const Float a  = 1.0 / fmax(std::abs(cz), eps);
+            const Float sg = (cz < 0.0) ? Float(-1.0) : Float(1.0);
+            matrix[0][i] *= a*a;
+            matrix[1][i] *= a*sg;
+
+            z[0][i] = d[0][i]; z[1][i] = d[1][i];
+            Tangent(i, eps);
+         }
+      }
+
+      /* Replace the tangent of lane 'i' by the unit vector orthogonal to its
+       * direction closest to it. See 'Covariance2D::Tangent'.
+       */
+      inline void Tangent(int i, Float eps) {
+         const Float dt = x[0][i]*z[0][i] + x[1][i]*z[1][i];
+         const Float tx = x[0][i] - dt*z[0][i];
+         const Float ty = x[1][i] - dt*z[1][i];
+         const Float l  = sqrt(tx*tx + ty*ty);
+         const bool  ok = l > eps;
+         const Float il = Float(1.0) / (ok ? l : Float(1.0));
+         x[0][i] = ok ? tx*il : x[0][i];
+         x[1][i] = ok ? ty*il : x[1][i];
+      }
+
+
+      ////////////////////////
+      //   Matrix shearing  //
+      ////////////////////////
+
+      inline void ShearSpaceAngle(const Float* c) {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            matrix[0][i] += (matrix[2][i]*c[i] - 2*matrix[1][i])*c[i];
+            matrix[1][i] -=  matrix[2][i]*c[i];
+         }
+      }
+
+      inline void ShearAngleSpace(const Float* c) {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            matrix[2][i] += (matrix[0][i]*c[i] - 2*matrix[1][i])*c[i];
+            matrix[1][i] -=  matrix[0][i]*c[i];
+         }
+      }
+   };
+}
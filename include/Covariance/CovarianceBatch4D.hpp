@@ -0,0 +1,400 @@
+#pragma once
+
+// STL includes
+#include <cmath>
+#include <cstddef>
+
+// Local includes
+#include "Covariance4D.hpp"
+
+namespace Covariance {
+
+   /* Batch of 'N' 4D covariance matrices stored as structure of arrays.
+    *
+    * This is the packet version of 'Covariance4D': each of the 10 entries of
+    * the packed matrix and each component of the local frame is stored in its
+    * own array of 'N' lanes. All operators process the 'N' lanes at once and
+    * take one parameter per lane (as an array of 'N' Floats). Vectors are
+    * passed as arrays of 3 components of 'N' lanes:
+    *
+    *    Float n[3][N]; // n[0] is the X component of all the lanes, ...
+    *
+    * The matrix indexing is the same as the one of 'Covariance4D'. 'N' should
+    * be a multiple of the SIMD width of 'Float' for the target (4 doubles for
+    * AVX2, 8 doubles or 16 floats for AVX-512).
+    *
+    * Use 'Load' and 'Store' to move a lane from and to a 'Covariance4D'.
+    * Transposing the matrices costs more than a single operator saves: to
+    * process arrays of covariances (e.g. wavefront queues), keep them in
+    * batches, load them once for a chain of operators, as the wavefront
+    * integrator of tutorial1 does for 'SurfaceInteraction', or store them as
+    * structure of arrays streams (see 'ProductUV' and 'Reflection' below).
+    */
+   template<typename Float, int N>
+   struct CovarianceBatch4D {
+
+      alignas(64) Float matrix[10][N];
+      alignas(64) Float x[3][N];
+      alignas(64) Float y[3][N];
+      alignas(64) Float z[3][N];
+
+
+      /////////////////////////
+      //  Lanes load / store //
+      /////////////////////////
+
+      template<class Vector>
+      inline void Load(int i, const Covariance4D<Vector, Float>& cov) {
+         for(int k=0; k<10; ++k) {
+            matrix[k][i] = cov.matrix[k];
+         }
+         x[0][i] = cov.x.x; x[1][i] = cov.x.y; x[2][i] = cov.x.z;
+         y[0][i] = cov.y.x; y[1][i] = cov.y.y; y[2][i] = cov.y.z;
+         z[0][i] = cov.z.x; z[1][i] = cov.z.y; z[2][i] = cov.z.z;
+      }
+
+      template<class Vector>
+      inline void Store(int i, Covariance4D<Vector, Float>& cov) const {
+         for(int k=0; k<10; ++k) {
+            cov.matrix[k] = matrix[k][i];
+         }
+         cov.x.x = x[0][i]; cov.x.y = x[1][i]; cov.x.z = x[2][i];
+         cov.y.x = y[0][i]; cov.y.y = y[1][i]; cov.y.z = y[2][i];
+         cov.z.x = z[0][i]; cov.z.y = z[1][i]; cov.z.z = z[2][i];
+         cov.Invalidate();
+      }
+
+
+      ////////////////////////
+      //  Atomic operators  //
+      ////////////////////////
+
+      /* Travel operator
+       *
+       * 'd' distance of travel along the central ray of each lane
+       */
+      inline void Travel(const Float* d) {
+         ShearAngleSpace(d, d);
+      }
+
+      /* Curvature operator
+       *
+       * 'kx' curvature along the X direction of each lane
+       * 'ky' curvature along the Y direction of each lane
+       */
+      inline void Curvature(const Float* kx, const Float* ky) {
+         ShearSpaceAngle(kx, ky);
+      }
+
+      /* Cosine operator
+       *
+       * 'wz' The incident direction's elevation in the local frame
+       */
+      inline void Cosine(const Float* wz) {
+         const Float frequ = 2.0 / M_PI;
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            const Float theta = acos(wz[i]);
+            const Float dist  = std::abs(0.5*M_PI-theta);
+            const Float freqv = 1.0 / fmax(dist, 1.0E-10);
+            matrix[5][i] += frequ*frequ;
+            matrix[9][i] += freqv*freqv;
+         }
+      }
+
+      /* Reflection operator
+       *
+       * 'suu' the covariance of the BRDF along the X axis.
+       * 'svv' the covariance of the BRDF along the Y axis.
+       *
+       * Lanes with a covariance above 'Limits::CovMax' are left untouched,
+       * as with 'Covariance4D::Reflection'.
+       */
+      inline void Reflection(const Float* suu, const Float* svv) {
+         alignas(64) Float su[N];
+         alignas(64) Float sv[N];
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            ReflectionLane(suu[i], svv[i], su[i], sv[i]);
+         }
+         ProductUV(su, sv);
+      }
+
+
+      /////////////////////////////
+      //  Local Frame alignment  //
+      /////////////////////////////
+
+      /* Perform the projection of the incomming lightfield on the surface with
+       * normal n. See 'Covariance4D::Projection'.
+       *
+       * The rotation aligning the frame with the plane is evaluated without
+       * trigonometry (see 'FrameRotation').
+       */
+      inline void Projection(const Float (&n)[3][N]) {
+         alignas(64) Float c[N];
+         alignas(64) Float s[N];
+         alignas(64) Float a[N];
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            const Float cx = x[0][i]*n[0][i] + x[1][i]*n[1][i] + x[2][i]*n[2][i];
+            const Float cy = y[0][i]*n[0][i] + y[1][i]*n[1][i] + y[2][i]*n[2][i];
+            const Float cz = z[0][i]*n[0][i] + z[1][i]*n[1][i] + z[2][i]*n[2][i];
+            FrameRotation<Float>(cx, cy, c[i], s[i]);
+            a[i] = std::abs(cz);
+
+            // Update direction vectors. The tangent Y is n x X whatever the
+            // side of the surface.
+            const Float sg = (cz < 0.0) ? Float(-1.0) : Float(1.0);
+            const Float xx = c[i]*x[0][i] + s[i]*y[0][i];
+            const Float xy = c[i]*x[1][i] + s[i]*y[1][i];
+            const Float xz = c[i]*x[2][i] + s[i]*y[2][i];
+            x[0][i] = xx; x[1][i] = xy; x[2][i] = xz;
+            z[0][i] = sg*n[0][i]; z[1][i] = sg*n[1][i]; z[2][i] = sg*n[2][i];
+            y[0][i] = n[1][i]*xz - n[2][i]*xy;
+            y[1][i] = n[2][i]*xx - n[0][i]*xz;
+            y[2][i] = n[0][i]*xy - n[1][i]*xx;
+         }
+         Rotate(c, s);
+         ScaleY(a);
+      }
+
+      /* Perform the projection of a lightfield defined on a surface to an
+       * outgoing direction. See 'Covariance4D::InverseProjection'.
+       */
+      inline void InverseProjection(const Float (&d)[3][N]) {
+         alignas(64) Float c[N];
+         alignas(64) Float s[N];
+         alignas(64) Float a[N];
+         alignas(64) Float g[N];
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            const Float cx = x[0][i]*d[0][i] + x[1][i]*d[1][i] + x[2][i]*d[2][i];
+            const Float cy = y[0][i]*d[0][i] + y[1][i]*d[1][i] + y[2][i]*d[2][i];
+            const Float cz = z[0][i]*d[0][i] + z[1][i]*d[1][i] + z[2][i]*d[2][i];
+            FrameRotation<Float>(cx, cy, c[i], s[i]);
+            a[i] = 1.0 / fmax(std::abs(cz), Limits<Float>::CovMin());
+            g[i] = (cz < 0.0) ? Float(-1.0) : Float(1.0);
+
+            // Update direction vectors.
+            const Float xx = c[i]*x[0][i] + s[i]*y[0][i];
+            const Float xy = c[i]*x[1][i] + s[i]*y[1][i];
+            const Float xz = c[i]*x[2][i] + s[i]*y[2][i];
+            x[0][i] = xx; x[1][i] = xy; x[2][i] = xz;
+            z[0][i] = d[0][i]; z[1][i] = d[1][i]; z[2][i] = d[2][i];
+            y[0][i] = d[1][i]*xz - d[2][i]*xy;
+            y[1][i] = d[2][i]*xx - d[0][i]*xz;
+            y[2][i] = d[0][i]*xy - d[1][i]*xx;
+         }
+         Rotate(c, s);
+
+         // Flipping both U and V leaves the UV covariance unchanged.
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            matrix[3][i] *= g[i];
+            matrix[4][i] *= g[i];
+            matrix[6][i] *= g[i];
+            matrix[7][i] *= g[i];
+         }
+         ScaleY(a);
+      }
+
+      inline void Symmetry() {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            matrix[3][i] = -matrix[3][i];
+            matrix[4][i] = -matrix[4][i];
+            matrix[6][i] = -matrix[6][i];
+            matrix[7][i] = -matrix[7][i];
+         }
+      }
+
+
+      ////////////////////////
+      //   Matrix scaling   //
+      ////////////////////////
+
+      inline void ScaleX(const Float* alpha) {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            matrix[0][i] *= alpha[i]*alpha[i];
+            matrix[1][i] *= alpha[i];
+            matrix[3][i] *= alpha[i];
+            matrix[6][i] *= alpha[i];
+         }
+      }
+
+      inline void ScaleY(const Float* alpha) {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            matrix[1][i] *= alpha[i];
+            matrix[2][i] *= alpha[i]*alpha[i];
+            matrix[4][i] *= alpha[i];
+            matrix[7][i] *= alpha[i];
+         }
+      }
+
+      inline void ScaleU(const Float* alpha) {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            matrix[3][i] *= alpha[i];
+            matrix[4][i] *= alpha[i];
+            matrix[5][i] *= alpha[i]*alpha[i];
+            matrix[8][i] *= alpha[i];
+         }
+      }
+
+      inline void ScaleV(const Float* alpha) {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            matrix[6][i] *= alpha[i];
+            matrix[7][i] *= alpha[i];
+            matrix[8][i] *= alpha[i];
+            matrix[9][i] *= alpha[i]*alpha[i];
+         }
+      }
+
+
+      ////////////////////////
+      //   Matrix shearing  //
+      ////////////////////////
+
+      // Shear the Spatial (x,y) domain by the Angular (u,v).
+      inline void ShearSpaceAngle(const Float* cx, const Float* cy) {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            matrix[0][i] += (matrix[5][i]*cx[i] - 2*matrix[3][i])*cx[i];
+            matrix[1][i] +=  matrix[8][i]*cx[i]*cy[i] - (matrix[4][i]*cy[i] + matrix[6][i]*cx[i]);
+            matrix[2][i] += (matrix[9][i]*cy[i] - 2*matrix[7][i])*cy[i];
+            matrix[3][i] -=  matrix[5][i]*cx[i];
+            matrix[4][i] -=  matrix[8][i]*cy[i];
+            matrix[6][i] -=  matrix[8][i]*cx[i];
+            matrix[7][i] -=  matrix[9][i]*cy[i];
+         }
+      }
+
+      // Shear the angular (U, V) domain by the spatial (X, Y) domain.
+      inline void ShearAngleSpace(const Float* cu, const Float* cv) {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            matrix[5][i] += (matrix[0][i]*cu[i] - 2*matrix[3][i])*cu[i];
+            matrix[3][i] -=  matrix[0][i]*cu[i];
+            matrix[8][i] +=  matrix[1][i]*cu[i]*cv[i] - (matrix[4][i]*cv[i] + matrix[6][i]*cu[i]);
+            matrix[4][i] -=  matrix[1][i]*cv[i];
+            matrix[6][i] -=  matrix[1][i]*cu[i];
+            matrix[9][i] += (matrix[2][i]*cv[i] - 2*matrix[7][i])*cv[i];
+            matrix[7][i] -=  matrix[2][i]*cv[i];
+         }
+      }
+
+
+      ////////////////////////
+      //   Matrix rotation  //
+      ////////////////////////
+
+      // 'c' the cosine of the rotation angle of each lane
+      // 's' the sine of the rotation angle of each lane
+      inline void Rotate(const Float* c, const Float* s) {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            const Float cs = c[i]*s[i];
+            const Float c2 = c[i]*c[i];
+            const Float s2 = s[i]*s[i];
+
+            const Float cov_xx = matrix[0][i];
+            const Float cov_xy = matrix[1][i];
+            const Float cov_yy = matrix[2][i];
+            const Float cov_xu = matrix[3][i];
+            const Float cov_yu = matrix[4][i];
+            const Float cov_uu = matrix[5][i];
+            const Float cov_xv = matrix[6][i];
+            const Float cov_yv = matrix[7][i];
+            const Float cov_uv = matrix[8][i];
+            const Float cov_vv = matrix[9][i];
+
+            // Rotation of the space
+            matrix[0][i] = c2 * cov_xx + 2*cs * cov_xy + s2 * cov_yy;
+            matrix[1][i] = (c2-s2) * cov_xy + cs * (cov_yy - cov_xx);
+            matrix[2][i] = c2 * cov_yy - 2*cs * cov_xy + s2 * cov_xx;
+
+            // Rotation of the angle
+            matrix[5][i] = c2 * cov_uu + 2*cs * cov_uv + s2 * cov_vv;
+            matrix[8][i] = (c2-s2) * cov_uv + cs * (cov_vv - cov_uu);
+            matrix[9][i] = c2 * cov_vv - 2*cs * cov_uv + s2 * cov_uu;
+
+            // Covariances
+            matrix[3][i] = c2 * cov_xu + cs * (cov_xv + cov_yu) + s2 * cov_yv;
+            matrix[4][i] = c2 * cov_yu + cs * (cov_yv - cov_xu) - s2 * cov_xv;
+            matrix[6][i] = c2 * cov_xv + cs * (cov_yv - cov_xu) - s2 * cov_yu;
+            matrix[7][i] = c2 * cov_yv - cs * (cov_xv + cov_yu) + s2 * cov_xu;
+         }
+      }
+
+
+      ////////////////////////
+      // Product of signals //
+      ////////////////////////
+
+      /* Evaluate the covariance matrix of the product of the local lightfield
+       * and a angularly varying only signal (like a BSDF). See
+       * 'Covariance4D::ProductUV'. Lanes where both 'su' and 'sv' are zero
+       * are left untouched.
+       */
+      inline void ProductUV(const Float* su, const Float* sv) {
+         COV_SIMD
+         for(int i=0; i<N; ++i) {
+            ProductUVLane(matrix[0][i], matrix[1][i], matrix[2][i],
+                          matrix[3][i], matrix[4][i], matrix[5][i],
+                          matrix[6][i], matrix[7][i], matrix[8][i],
+                          matrix[9][i], su[i], sv[i]);
+         }
+      }
+   };
+
+
+   /////////////////////////////////////
+   // Product of signals over streams //
+   /////////////////////////////////////
+
+   /* Apply 'Covariance4D::ProductUV' to 'count' matrices stored as structure
+    * of arrays: 'matrix[k][i]' is the entry 'k' of the i-th matrix. This is
+    * the layout to use for wavefront queues. 'su' and 'sv' hold one value
+    * per matrix.
+    */
+   template<typename Float>
+   void ProductUV(Float* const matrix[10], const Float* su, const Float* sv,
+                  std::size_t count) {
+      Float* m0 = matrix[0]; Float* m1 = matrix[1]; Float* m2 = matrix[2];
+      Float* m3 = matrix[3]; Float* m4 = matrix[4]; Float* m5 = matrix[5];
+      Float* m6 = matrix[6]; Float* m7 = matrix[7]; Float* m8 = matrix[8];
+      Float* m9 = matrix[9];
+      COV_SIMD
+      for(std::size_t i=0; i<count; ++i) {
+         ProductUVLane(m0[i], m1[i], m2[i], m3[i], m4[i],
+                       m5[i], m6[i], m7[i], m8[i], m9[i], su[i], sv[i]);
+      }
+   }
+
+   /* Apply 'Covariance4D::Reflection' to 'count' matrices stored as
+    * structure of arrays, see 'ProductUV'. 'suu' and 'svv' hold one BRDF
+    * covariance per matrix.
+    */
+   template<typename Float>
+   void Reflection(Float* const matrix[10], const Float* suu, const Float* svv,
+                   std::size_t count) {
+      const std::size_t B = 256;
+      alignas(64) Float su[B];
+      alignas(64) Float sv[B];
+      for(std::size_t start=0; start<count; start+=B) {
+         const std::size_t n = (count-start < B) ? count-start : B;
+         COV_SIMD
+         for(std::size_t i=0; i<n; ++i) {
+            ReflectionLane(suu[start+i], svv[start+i], su[i], sv[i]);
+         }
+
+         Float* block[10];
+         for(int k=0; k<10; ++k) { block[k] = matrix[k] + start; }
+         ProductUV(block, su, sv, n);
+      }
+   }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+// Local includes
+#include "Matrix.hpp"
+
+namespace Covariance {
+
+   /* Rotation (c, s) of the local frame that aligns its X axis with the
+    * plane orthogonal to a direction, given the projection (cx, cy) of that
+    * direction on the frame. This is (cos(alpha), -sin(alpha)) with
+    * 'alpha = atan2(cx, cy)', evaluated without trigonometry:
+    *
+    *    (c, s) = (cy, -cx) / sqrt(cx^2 + cy^2)
+    *
+    * Degenerate cases return the identity rotation (1, 0): when 'cx' is zero
+    * the X axis already lies in the plane, and when (cx, cy) is too small to
+    * be normalized the direction is the frame's Z axis, for which any
+    * rotation is valid.
+    */
+   template<typename Float>
+   COV_LANE void FrameRotation(Float cx, Float cy, Float& c, Float& s) {
+      const Float r  = sqrt(cx*cx + cy*cy);
+      const bool  id = (cx == 0.0) || !(r > std::numeric_limits<Float>::min());
+      c = id ? Float(1.0) :  cy / (id ? Float(1.0) : r);
+      s = id ? Float(0.0) : -cx / (id ? Float(1.0) : r);
+   }
+
+   /* Canonical tangent frame (t, b) of the unit vector 'z' such that
+    * (t, b, z) is a right-handed orthonormal basis. It is continuous
+    * everywhere but on the negative Z half-axis [Duff et al. 2017].
+    *
+    * This requires 'Vector' to expose its 'x', 'y' and 'z' components and to
+    * be constructible from them.
+    */
+   template<class Vector>
+   inline void CanonicalBasis(const Vector& z, Vector& t, Vector& b) {
+      const auto sign = std::copysign(decltype(z.z)(1.0), z.z);
+      const auto a    = -1.0 / (sign + z.z);
+      const auto c    = z.x*z.y*a;
+      t = Vector(1.0 + sign*z.x*z.x*a, sign*c, -sign*z.x);
+      b = Vector(c, sign + z.y*z.y*a, -z.y);
+   }
+
+   /* Octahedral encoding of the unit vector 'n' on two 16 bits integers
+    * [Meyer et al. 2010]. The maximum angular error is about 1E-4 radians.
+    */
+   template<class Vector>
+   inline void OctahedralEncode(const Vector& n, uint16_t& u, uint16_t& v) {
+      const double l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+      double px = n.x / l1, py = n.y / l1;
+      if(n.z < 0.0) {
+         const double qx = (1.0 - std::abs(py)) * std::copysign(1.0, px);
+         const double qy = (1.0 - std::abs(px)) * std::copysign(1.0, py);
+         px = qx; py = qy;
+      }
+      u = uint16_t(std::lround((px*0.5 + 0.5) * 65535.0));
+      v = uint16_t(std::lround((py*0.5 + 0.5) * 65535.0));
+   }
+
+   template<class Vector>
+   inline Vector OctahedralDecode(uint16_t u, uint16_t v) {
+      const double px = u / 65535.0 * 2.0 - 1.0;
+      const double py = v / 65535.0 * 2.0 - 1.0;
+      const double z  = 1.0 - std::abs(px) - std::abs(py);
+      const double t  = std::max(-z, 0.0);
+      const double x  = px + ((px >= 0.0) ? -t : t);
+      const double y  = py + ((py >= 0.0) ? -t : t);
+      const double l  = std::sqrt(x*x + y*y + z*z);
+      return Vector(x/l, y/l, z/l);
+   }
+
+   /* Main axes of the footprint of a 2D Gaussian filter in the local
+    * tangent frame. (a, b, c) is the packed 2x2 submatrix of the covariance
+    * in frequency space. The axes are its eigenvectors scaled by the square
+    * root of the eigenvalues over 2 Pi. 'D1' is the major axis, unless the
+    * submatrix is diagonal (|b| <= eps): then 'D1' and 'D2' are the first
+    * and second axes of the frame, whatever their length. Axes are expressed
+    * with their first two components:
+    *    D1 = [x, y, 0]
+    */
+   template<class Vector, typename Float>
+   inline void ExtentAxes(Float a, Float b, Float c, Float eps,
+                          Vector& D1, Vector& D2) {
+      Float l1, l2, ex, ey;
+      SymmetricEigen2x2(a, b, c, l1, l2, ex, ey);
+      const bool diag = !(std::abs(b) > eps);
+      l1 = diag ? a : l1;
+      l2 = diag ? c : l2;
+      ex = diag ? Float(1.0) : ex;
+      ey = diag ? Float(0.0) : ey;
+      const Float s1 = sqrt(fmax(l1, Float(0.0))) / (2.0*M_PI);
+      const Float s2 = sqrt(fmax(l2, Float(0.0))) / (2.0*M_PI);
+      D1.x =  s1*ex; D1.y = s1*ey; D1.z = 0.0;
+      D2.x = -s2*ey; D2.y = s2*ex; D2.z = 0.0;
+   }
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+// STL includes
+#include <array>
+#include <cmath>
+
+// Local includes
+#include "Frame.hpp"
+#include "Covariance4D.hpp"
+#include "InvCovariance4D.hpp"
+
+namespace Covariance {
+
+   /* Covariance matrix without its local frame.
+    *
+    * The local frame of 'Covariance4D' is redundant with the direction of
+    * the ray it is attached to: Z is the ray direction and X is known up to
+    * a rotation around Z. This variant only stores the 10 entries of the
+    * matrix and the angle of X in the canonical tangent frame of Z (see
+    * 'CanonicalBasis'), and derives the frame on demand from the ray
+    * direction. It takes 44 bytes in single precision and 88 bytes in double
+    * precision instead of 152 bytes for a 'Covariance4D<Vector, double>'.
+    *
+    * The frame is always right-handed (Y = Z x X). Left-handed frames are
+    * converted by flipping Y, which scales the matrix by -1 along Y and V
+    * and describes the same local lightfield.
+    *
+    * Only the operators that do not depend on the frame are available. Use
+    * 'Covariance' to expand it into a 'Covariance4D' for the others.
+    */
+   template<typename Float>
+   struct FramelessCovariance4D {
+
+      std::array<Float, 10> matrix;
+      Float angle;
+
+      FramelessCovariance4D() {}
+
+      template<class Vector>
+      FramelessCovariance4D(const Covariance4D<Vector, Float>& cov) :
+         matrix(cov.matrix) {
+         angle = FrameAngle(cov.x, cov.y, cov.z, matrix);
+      }
+
+      /* Restore the frame from the ray direction 'z'.
+       */
+      template<class Vector>
+      void Frame(const Vector& z, Vector& x, Vector& y) const {
+         Vector t, b;
+         CanonicalBasis(z, t, b);
+         x = std::cos(angle)*t + std::sin(angle)*b;
+         y = Vector::Cross(z, x);
+      }
+
+      /* Expand to a 'Covariance4D' along the ray direction 'z'.
+       */
+      template<class Vector>
+      Covariance4D<Vector, Float> Covariance(const Vector& z) const {
+         Vector x, y;
+         Frame(z, x, y);
+         return Covariance4D<Vector, Float>(matrix, x, y, z);
+      }
+
+      // See 'Covariance4D::Travel'
+      inline void Travel(Float d) {
+         matrix[5] += (matrix[0]*d - 2*matrix[3])*d;
+         matrix[3] -=  matrix[0]*d;
+         matrix[8] +=  matrix[1]*d*d - (matrix[4]*d + matrix[6]*d);
+         matrix[4] -=  matrix[1]*d;
+         matrix[6] -=  matrix[1]*d;
+         matrix[9] += (matrix[2]*d - 2*matrix[7])*d;
+         matrix[7] -=  matrix[2]*d;
+      }
+
+      /* Angle of 'x' in the canonical tangent frame of 'z'. The matrix is
+       * scaled by -1 along Y and V if the frame (x, y, z) is left-handed.
+       */
+      template<class Vector>
+      static Float FrameAngle(const Vector& x, const Vector& y, const Vector& z,
+                              std::array<Float, 10>& matrix) {
+         if(Vector::Dot(Vector::Cross(x, y), z) < 0.0) {
+            matrix[1] = -matrix[1];
+            matrix[4] = -matrix[4];
+            matrix[6] = -matrix[6];
+            matrix[8] = -matrix[8];
+         }
+         Vector t, b;
+         CanonicalBasis(z, t, b);
+         return std::atan2(Vector::Dot(x, b), Vector::Dot(x, t));
+      }
+   };
+
+   /* Inverse covariance matrix without its local frame. This is the
+    * counterpart of 'FramelessCovariance4D' for 'InvCovariance4D'.
+    */
+   template<typename Float>
+   struct FramelessInvCovariance4D {
+
+      std::array<Float, 10> matrix;
+      Float angle;
+
+      FramelessInvCovariance4D() {}
+
+      template<class Vector>
+      FramelessInvCovariance4D(const InvCovariance4D<Vector, Float>& cov) :
+         matrix(cov.matrix) {
+         angle = FramelessCovariance4D<Float>::FrameAngle(cov.x, cov.y, cov.z, matrix);
+      }
+
+      /* Restore the frame from the ray direction 'z'.
+       */
+      template<class Vector>
+      void Frame(const Vector& z, Vector& x, Vector& y) const {
+         Vector t, b;
+         CanonicalBasis(z, t, b);
+         x = std::cos(angle)*t + std::sin(angle)*b;
+         y = Vector::Cross(z, x);
+      }
+
+      /* Expand to an 'InvCovariance4D' along the ray direction 'z'.
+       */
+      template<class Vector>
+      InvCovariance4D<Vector, Float> Covariance(const Vector& z) const {
+         Vector x, y;
+         Frame(z, x, y);
+         return InvCovariance4D<Vector, Float>(matrix, x, y, z);
+      }
+
+      // See 'InvCovariance4D::Travel'
+      inline void Travel(Float d) {
+         matrix[0] += (matrix[5]*d + 2*matrix[3])*d;
+         matrix[1] +=  matrix[8]*d*d + (matrix[4]*d + matrix[6]*d);
+         matrix[2] += (matrix[9]*d + 2*matrix[7])*d;
+         matrix[3] +=  matrix[5]*d;
+         matrix[4] +=  matrix[8]*d;
+         matrix[6] +=  matrix[8]*d;
+         matrix[7] +=  matrix[9]*d;
+      }
+   };
+}
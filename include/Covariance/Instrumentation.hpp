@@ -0,0 +1,273 @@
+#pragma once
+
+/* Optional instrumentation of the operators of 'Covariance4D' and
+ * 'InvCovariance4D'. Define 'COV_INSTRUMENT' (before including any header of
+ * this library, and consistently across translation units) to enable it.
+ * Otherwise, the macros below expand to nothing and the operators are left
+ * untouched.
+ *
+ * When enabled, each thread counts the calls of every operator and the
+ * cycles spent in them, the number of 'Reflection' skipped because the BRDF
+ * is specular ('CovMax' guard), the number of failed inversions, and the
+ * histogram of the values returned by 'Volume'. The counters of a thread are
+ * merged into a global registry when the thread exits. The aggregate of all
+ * threads is printed on 'stderr' at program exit (see 'ReportAtExit'), or
+ * can be queried with 'Instrumentation::Total()'.
+ *
+ * Timings are inclusive: 'SurfaceInteraction' also accounts for the
+ * 'Projection', 'InverseProjection' and 'Travel' it calls, which are counted
+ * as well. Cycles are read from the time stamp counter on x86, and are
+ * nanoseconds of the steady clock on other architectures.
+ */
+
+#ifdef COV_INSTRUMENT
+
+// STL includes
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace Covariance {
+namespace Instrumentation {
+
+   /* Instrumented classes and operators.
+    */
+   enum Class { Cov4D = 0, InvCov4D, NbClasses };
+   enum Op {
+      Travel = 0, Curvature, Cosine, Reflection, ReflectionSkipped,
+      Projection, InverseProjection, Symmetry, SurfaceInteraction,
+      Inverse, InverseFailed, Add, Volume, NbOps
+   };
+
+   inline const char* ClassName(int c) {
+      static const char* names[NbClasses] = { "Covariance4D", "InvCovariance4D" };
+      return names[c];
+   }
+   inline const char* OpName(int op) {
+      static const char* names[NbOps] = {
+         "Travel", "Curvature", "Cosine", "Reflection", "ReflectionSkipped",
+         "Projection", "InverseProjection", "Symmetry", "SurfaceInteraction",
+         "Inverse", "InverseFailed", "Add", "Volume"
+      };
+      return names[op];
+   }
+
+   /* 'Volume' histogram: bin 0 holds the non positive volumes, bin 'b' in
+    * [1, NbBins-1] the volumes in [10^(b-1+VolumeMinExp), 10^(b+VolumeMinExp))
+    * clamped to the first and last bins.
+    */
+   const int NbVolumeBins = 34;
+   const int VolumeMinExp = -16;
+
+   inline int VolumeBin(double v) {
+      if(!(v > 0.0)) { return 0; }
+      const int b = int(std::floor(std::log10(v))) - VolumeMinExp + 1;
+      return (b < 1) ? 1 : (b > NbVolumeBins-1) ? NbVolumeBins-1 : b;
+   }
+
+   inline uint64_t Cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+   }
+
+   struct Counters {
+      uint64_t count[NbClasses][NbOps];
+      uint64_t cycles[NbClasses][NbOps];
+      uint64_t volume[NbClasses][NbVolumeBins];
+
+      Counters() {
+         Clear();
+      }
+
+      void Clear() {
+         for(int c=0; c<NbClasses; ++c) {
+            for(int op=0; op<NbOps; ++op) {
+               count[c][op]  = 0;
+               cycles[c][op] = 0;
+            }
+            for(int b=0; b<NbVolumeBins; ++b) {
+               volume[c][b] = 0;
+            }
+         }
+      }
+
+      void Add(const Counters& counters) {
+         for(int c=0; c<NbClasses; ++c) {
+            for(int op=0; op<NbOps; ++op) {
+               count[c][op]  += counters.count[c][op];
+               cycles[c][op] += counters.cycles[c][op];
+            }
+            for(int b=0; b<NbVolumeBins; ++b) {
+               volume[c][b] += counters.volume[c][b];
+            }
+         }
+      }
+
+      /* Print the non empty counters.
+       */
+      void Print(FILE* out) const {
+         fprintf(out, "Covariance instrumentation\n");
+         for(int c=0; c<NbClasses; ++c) {
+            for(int op=0; op<NbOps; ++op) {
+               if(count[c][op] == 0) continue;
+               fprintf(out, "  %-16s %-19s %14llu calls %16llu cycles %10.1f cycles/call\n",
+                       ClassName(c), OpName(op),
+                       (unsigned long long)count[c][op],
+                       (unsigned long long)cycles[c][op],
+                       double(cycles[c][op]) / double(count[c][op]));
+            }
+            for(int b=0; b<NbVolumeBins; ++b) {
+               if(volume[c][b] == 0) continue;
+               if(b == 0) {
+                  fprintf(out, "  %-16s Volume <= 0        %14llu\n",
+                          ClassName(c), (unsigned long long)volume[c][b]);
+               } else {
+                  fprintf(out, "  %-16s Volume ~ 1e%+03d     %14llu\n",
+                          ClassName(c), b-1+VolumeMinExp,
+                          (unsigned long long)volume[c][b]);
+               }
+            }
+         }
+      }
+   };
+
+   /* Global registry of the per thread counters. The counters of live
+    * threads are read without synchronization: query 'Total' when the
+    * instrumented threads are idle (e.g. after a parallel region).
+    */
+   struct Registry {
+      std::mutex mutex;
+      std::vector<const Counters*> live;
+      Counters exited;
+      bool reportAtExit = true;
+
+      ~Registry() {
+         if(!reportAtExit) return;
+         Counters total = exited;
+         for(const Counters* counters : live) {
+            total.Add(*counters);
+         }
+         total.Print(stderr);
+      }
+   };
+
+   inline Registry& GetRegistry() {
+      static Registry registry;
+      return registry;
+   }
+
+   /* Counters of the calling thread. They register themselves on first use
+    * and are merged into the registry when the thread exits.
+    */
+   struct ThreadCounters : public Counters {
+      ThreadCounters() {
+         Registry& registry = GetRegistry();
+         std::lock_guard<std::mutex> lock(registry.mutex);
+         registry.live.push_back(this);
+      }
+      ~ThreadCounters() {
+         Registry& registry = GetRegistry();
+         std::lock_guard<std::mutex> lock(registry.mutex);
+         registry.exited.Add(*this);
+         for(auto it = registry.live.begin(); it != registry.live.end(); ++it) {
+            if(*it == this) { registry.live.erase(it); break; }
+         }
+      }
+   };
+
+   inline Counters& Local() {
+      static thread_local ThreadCounters counters;
+      return counters;
+   }
+
+   /* Aggregate of the counters of all threads, live and exited.
+    */
+   inline Counters Total() {
+      Local();
+      Registry& registry = GetRegistry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      Counters total = registry.exited;
+      for(const Counters* counters : registry.live) {
+         total.Add(*counters);
+      }
+      return total;
+   }
+
+   /* Reset the counters of all threads.
+    */
+   inline void Reset() {
+      Local();
+      Registry& registry = GetRegistry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      registry.exited.Clear();
+      for(const Counters* counters : registry.live) {
+         const_cast<Counters*>(counters)->Clear();
+      }
+   }
+
+   /* Enable or disable the report printed at program exit.
+    */
+   inline void ReportAtExit(bool enable) {
+      GetRegistry().reportAtExit = enable;
+   }
+
+   inline void Count(Class c, Op op) {
+      ++Local().count[c][op];
+   }
+
+   inline void CountVolume(Class c, double v) {
+      Local().volume[c][VolumeBin(v)] += 1;
+   }
+
+   /* Count a call of an operator and the cycles spent until the end of the
+    * scope.
+    */
+   struct ScopedTimer {
+      Counters& counters;
+      const Class c;
+      const Op op;
+      const uint64_t start;
+
+      ScopedTimer(Class c, Op op) :
+         counters(Local()), c(c), op(op), start(Cycles()) {}
+      ~ScopedTimer() {
+         counters.cycles[c][op] += Cycles() - start;
+         counters.count[c][op]  += 1;
+      }
+   };
+}
+}
+
+#define COV_INSTRUMENT_CONCAT_(a, b) a##b
+#define COV_INSTRUMENT_CONCAT(a, b) COV_INSTRUMENT_CONCAT_(a, b)
+
+/* 'COV_TIME(Class, Op)' counts and times the enclosing scope,
+ * 'COV_COUNT(Class, Op)' only counts an event, and
+ * 'COV_COUNT_VOLUME(Class, v)' adds a volume to the histogram.
+ */
+#define COV_TIME(c, op) \
+   const Covariance::Instrumentation::ScopedTimer COV_INSTRUMENT_CONCAT(_cov_timer, __LINE__)( \
+      Covariance::Instrumentation::c, Covariance::Instrumentation::op)
+#define COV_COUNT(c, op) \
+   Covariance::Instrumentation::Count(Covariance::Instrumentation::c, \
+                                      Covariance::Instrumentation::op)
+#define COV_COUNT_VOLUME(c, v) \
+   Covariance::Instrumentation::CountVolume(Covariance::Instrumentation::c, double(v))
+
+#else
+
+#define COV_TIME(c, op)
+#define COV_COUNT(c, op)
+#define COV_COUNT_VOLUME(c, v)
+
+#endif
@@ -8,9 +8,9 @@
 
 // Local includes
 #include "Matrix.hpp"
-
-#define INVCOV_MAX_FLOAT 1.0E+10
-#define INVCOV_MIN_FLOAT 1.0E-10
+#include "Frame.hpp"
+#include "Limits.hpp"
+#include "Instrumentation.hpp"
 
 namespace Covariance {
 
@@ -58,6 +58,7 @@ namespace Covariance {
        * 'd' distance of travel along the central ray
        */
       inline void Travel(Float d) {
+         COV_TIME(InvCov4D, Travel);
          //ShearAngleSpace(-d, -d);
          ShearSpaceAngle(-d, -d);
       }
@@ -68,6 +69,7 @@ namespace Covariance {
        * 'ky' curvature along the Y direction
        */
       inline void Curvature(Float kx, Float ky) {
+         COV_TIME(InvCov4D, Curvature);
          ShearAngleSpace(-kx, -ky);
          //ShearSpaceAngle(-kx, -ky);
       }
@@ -80,6 +82,8 @@ namespace Covariance {
        */
       inline void Cosine(Float wz) {
       }
+      inline void Cosine() {
+      }
 
       /* Reflection operator
        *
@@ -87,8 +91,9 @@ namespace Covariance {
        * 'svv' the covariance of the BRDF along the Y axis.
        */
       inline void Reflection(Float suu, Float svv) {
-         matrix[5] += 1.0f/std::max<Float>(svv, INVCOV_MIN_FLOAT);
-         matrix[9] += 1.0f/std::max<Float>(suu, INVCOV_MIN_FLOAT);
+         COV_TIME(InvCov4D, Reflection);
+         matrix[5] += 1.0f/std::max<Float>(svv, Limits<Float>::InvMin());
+         matrix[9] += 1.0f/std::max<Float>(suu, Limits<Float>::InvMin());
       }
 
 
@@ -103,18 +108,19 @@ namespace Covariance {
        * 'n' the surface normal.
        */
       inline void Projection(const Vector& n) {
+         COV_TIME(InvCov4D, Projection);
          const auto cx = Vector::Dot(x, n);
          const auto cy = Vector::Dot(y, n);
 
          // Rotate the Frame to be aligned with plane.
-         const Float alpha = (cx != 0.0) ? atan2(cx, cy) : 0.0;
-         const Float c = cos(alpha), s = -sin(alpha);
+         Float c, s;
+         FrameRotation<Float>(cx, cy, c, s);
          Rotate(c, s);
 
          // Scale the componnent that project by the cosine of the ray direction
          // and the normal.
          const Float cosine = Vector::Dot(z, n);
-         ScaleY(1.0/fmax(fabs(cosine), INVCOV_MIN_FLOAT));
+         ScaleY(1.0/fmax(fabs(cosine), Limits<Float>::InvMin()));
 
          // Update direction vectors.
          x = c*x + s*y;
@@ -130,13 +136,14 @@ namespace Covariance {
        * 'd' the outgoing direction.
        */
       inline void InverseProjection(const Vector& d) {
+         COV_TIME(InvCov4D, InverseProjection);
 
          const auto cx = Vector::Dot(x, d);
          const auto cy = Vector::Dot(y, d);
 
          // Rotate the Frame to be aligned with plane.
-         const Float alpha = (cx != 0.0) ? atan2(cx, cy) : 0.0;
-         const Float c = cos(alpha), s = -sin(alpha);
+         Float c, s;
+         FrameRotation<Float>(cx, cy, c, s);
          Rotate(c, s); // Rotate of -alpha
 
          // Scale the componnent that project by the inverse cosine of the ray
@@ -160,6 +167,7 @@ namespace Covariance {
        * is ajusted with respect to symmetry.
        */
       inline void Symmetry() {
+         COV_TIME(InvCov4D, Symmetry);
          matrix[3] = -matrix[3];
          matrix[4] = -matrix[4];
          matrix[6] = -matrix[6];
@@ -167,6 +175,79 @@ namespace Covariance {
       }
 
 
+      /////////////////////////
+      //   Fused operators   //
+      /////////////////////////
+
+      /* Surface interaction operator
+       *
+       * Apply the standard chain of operators of a reflection on a surface
+       * in a single call. This is equivalent to:
+       *
+       *    Projection(n);
+       *    Curvature(k, k);
+       *    Cosine(wz);
+       *    Symmetry();
+       *    Reflection(rho_u, rho_v);
+       *    Curvature(-k, -k);
+       *    InverseProjection(wo);
+       *    Travel(t);
+       *
+       * but the operators between the two projections are evaluated on
+       * local copies of the matrix entries, which are only loaded and stored
+       * once.
+       *
+       * The elevation 'wz' is only kept for the signature to match the one of
+       * 'Covariance4D': like 'Cosine', the cosine term is skipped as it would
+       * require to invert the matrix.
+       */
+      inline void SurfaceInteraction(const Vector& n, Float k, const Vector& wo,
+                                     Float rho_u, Float rho_v, Float t,
+                                     Float /*wz*/ = 1.0) {
+         COV_TIME(InvCov4D, SurfaceInteraction);
+         Projection(n);
+
+         Float cov_xx = matrix[0], cov_xy = matrix[1], cov_yy = matrix[2];
+         Float cov_xu = matrix[3], cov_yu = matrix[4], cov_uu = matrix[5];
+         Float cov_xv = matrix[6], cov_yv = matrix[7], cov_uv = matrix[8];
+         Float cov_vv = matrix[9];
+
+         // Curvature(k, k), the angular domain is sheared by -k
+         cov_uu += (cov_xx*k + 2*cov_xu)*k;
+         cov_xu +=  cov_xx*k;
+         cov_uv +=  cov_xy*k*k + (cov_yu*k + cov_xv*k);
+         cov_yu +=  cov_xy*k;
+         cov_xv +=  cov_xy*k;
+         cov_vv += (cov_yy*k + 2*cov_yv)*k;
+         cov_yv +=  cov_yy*k;
+
+         // Symmetry()
+         cov_xu = -cov_xu; cov_yu = -cov_yu;
+         cov_xv = -cov_xv; cov_yv = -cov_yv;
+
+         // Reflection(rho_u, rho_v)
+         cov_uu += 1.0f/std::max<Float>(rho_v, Limits<Float>::InvMin());
+         cov_vv += 1.0f/std::max<Float>(rho_u, Limits<Float>::InvMin());
+
+         // Curvature(-k, -k), the angular domain is sheared by k
+         cov_uu += (cov_xx*k - 2*cov_xu)*k;
+         cov_xu -=  cov_xx*k;
+         cov_uv +=  cov_xy*k*k - (cov_yu*k + cov_xv*k);
+         cov_yu -=  cov_xy*k;
+         cov_xv -=  cov_xy*k;
+         cov_vv += (cov_yy*k - 2*cov_yv)*k;
+         cov_yv -=  cov_yy*k;
+
+         matrix[0] = cov_xx; matrix[1] = cov_xy; matrix[2] = cov_yy;
+         matrix[3] = cov_xu; matrix[4] = cov_yu; matrix[5] = cov_uu;
+         matrix[6] = cov_xv; matrix[7] = cov_yv; matrix[8] = cov_uv;
+         matrix[9] = cov_vv;
+
+         InverseProjection(wo);
+         Travel(t);
+      }
+
+
       ////////////////////////
       //   Matrix scaling   //
       ////////////////////////
@@ -290,22 +371,37 @@ namespace Covariance {
        * 'inverse' needs to be a 4x4 preallocated matrix (16 Floats)..
        */
       void InverseMatrix(Float* inverse) const {
+         if(!TryInverseMatrix(inverse)) { COV_THROW; }
+      }
+
+      /* Same as above without exception. Return 'false' if the matrix cannot
+       * be inverted, in which case 'inverse' is the isotropic covariance of
+       * maximal bandwidth.
+       */
+      bool TryInverseMatrix(Float* inverse) const noexcept {
+         COV_TIME(InvCov4D, Inverse);
          // Compute the inverse matrix. We need to add an epsilon to the
          // diagonal in order to ensure that the matrix can be inverted.
-         inverse[ 0] = matrix[ 0] + COV_MIN_FLOAT;
-         inverse[ 1] = matrix[ 1]; inverse[ 4] = matrix[ 1];
-         inverse[ 5] = matrix[ 2] + COV_MIN_FLOAT;
-         inverse[ 2] = matrix[ 3]; inverse[ 8] = matrix[ 3];
-         inverse[ 6] = matrix[ 4]; inverse[ 9] = matrix[ 4];
-         inverse[10] = matrix[ 5] + COV_MIN_FLOAT;
-         inverse[ 3] = matrix[ 6]; inverse[12] = matrix[ 6];
-         inverse[ 7] = matrix[ 7]; inverse[13] = matrix[ 7];
-         inverse[11] = matrix[ 8]; inverse[14] = matrix[ 8];
-         inverse[15] = matrix[ 9] + COV_MIN_FLOAT;
-
-         if(!Inverse<Float>(inverse, 4)) { throw 1; }
+         std::array<Float, 10> regular = matrix;
+         regular[0] += Limits<Float>::InvMin();
+         regular[2] += Limits<Float>::InvMin();
+         regular[5] += Limits<Float>::InvMin();
+         regular[9] += Limits<Float>::InvMin();
+
+         if(SymmetricInverse4<Float>(regular.data(), inverse)) { return true; }
+         COV_COUNT(InvCov4D, InverseFailed);
+         for(int i=0; i<16; ++i) {
+            inverse[i] = (i % 5 == 0) ? Limits<Float>::InvMax() : Float(0.0);
+         }
+         return false;
       }
 
+      /* Nothing is cached from the matrix in this representation. This is
+       * provided for interface parity with 'Covariance4D' when the matrix is
+       * written directly.
+       */
+      inline void Invalidate() {}
+
 
       ////////////////////////
       // Product of signals //
@@ -328,39 +424,49 @@ namespace Covariance {
 
       /* Add two covariance matrices together. Since we are using inverse
        * covariance storage here, we need to invert the matrices before doing
-       * the addition (geometric mean). Using this routine is not recommended,
-       * prefer storing covariances directly using 'Covariance4D' if you need
-       * to perform many additions.
+       * the addition and invert the result back. This costs three 4x4
+       * inversions: to accumulate many matrices, prefer the deferred
+       * 'CovarianceAccumulator4D' that inverts each matrix once and the sum
+       * once at the end.
        */
       void Add(const InvCovariance4D& cov, Float L1=1.0f, Float L2=1.0f) {
-         const Float L = L1+L2;
-         if(L <= 0.0f) return;
+         if(!TryAdd(cov, L1, L2)) { COV_THROW; }
+      }
 
-         // Compute the inverse matrix
-         Float inverse[16];
-         this->InverseMatrix(inverse);
+      /* Same as above without exception. Return 'false' if one of the three
+       * inversions fails, in which case the matrix is left unchanged.
+       */
+      bool TryAdd(const InvCovariance4D& cov, Float L1=1.0f, Float L2=1.0f) noexcept {
+         COV_TIME(InvCov4D, Add);
+         const Float L = L1+L2;
+         if(L <= 0.0f) return true;
 
-         // Compute the inverse of matrix cov.matrix
-         Float inverseB[16];
-         cov.InverseMatrix(inverseB);
+         // Covariance matrices of both operands
+         Float inverseA[16], inverseB[16];
+         if(!this->TryInverseMatrix(inverseA)) { return false; }
+         if(!cov.TryInverseMatrix(inverseB))   { return false; }
 
          // Add the two covariance matrices together
-         for(unsigned short i=0; i<15; ++i) {
-            inverse[i] = (L1*inverse[i] + L2*inverseB[i]) / L;
+         Float packed[10];
+         for(unsigned short i=0; i<10; ++i) {
+            const int k = Unpacked(i);
+            packed[i] = (L1*inverseA[k] + L2*inverseB[k]) / L;
          }
 
          // Get the inverse covariance back
-         if(!Inverse<Float>(inverse, 4)) { throw 1; }
-         matrix[ 0] = inverse[ 0];
-         matrix[ 1] = inverse[ 1];
-         matrix[ 2] = inverse[ 5];
-         matrix[ 3] = inverse[ 2];
-         matrix[ 4] = inverse[ 6];
-         matrix[ 5] = inverse[10];
-         matrix[ 6] = inverse[ 3];
-         matrix[ 7] = inverse[ 7];
-         matrix[ 8] = inverse[11];
-         matrix[ 9] = inverse[15];
+         Float inverse[16];
+         if(!SymmetricInverse4<Float>(packed, inverse)) { return false; }
+         for(unsigned short i=0; i<10; ++i) {
+            matrix[i] = inverse[Unpacked(i)];
+         }
+         return true;
+      }
+
+      /* Index in a 4x4 matrix (16 Floats) of the packed entry 'i'.
+       */
+      static inline int Unpacked(int i) {
+         static const int index[10] = { 0, 1, 5, 2, 6, 10, 3, 7, 11, 15 };
+         return index[i];
       }
 
 
@@ -386,71 +492,8 @@ namespace Covariance {
        *  equivalent ray differential [Igehy 1999].
        */
       void Extent(Vector& Dx, Vector& Dy, Vector& Du, Vector& Dv) const {
-          // T = trace and D = det of the spatial submatrix
-          Float T = matrix[0]+matrix[2];
-          Float D = matrix[0]*matrix[2] - matrix[1]*matrix[1];
-
-          // Solve the 2nd order polynomial roots of p(l) = l^2 - l T + D.
-          // This gives us the eigen values.
-          Float d  = 0.25*T*T - D;
-          if(d < 0.0) { throw 1; } // No solution exists
-          Float l1 = 0.5*T + sqrt(d);
-          Float l2 = 0.5*T - sqrt(d);
-
-          if(abs(matrix[1]) > COV_MIN_FLOAT) {
-            Dx.x = l1 - matrix[2];
-            Dx.y = matrix[1];
-            Dx.z = 0.0;
-            Dy.x = l2 - matrix[2];
-            Dy.y = matrix[1];
-            Dy.z = 0.0;
-
-            Dx.Normalize();
-            Dy.Normalize();
-
-            Dx = sqrt(l1)/(2.0*M_PI) * Dx;
-            Dy = sqrt(l2)/(2.0*M_PI) * Dy;
-          } else {
-            Dx.x = sqrt(matrix[0])/(2.0*M_PI);
-            Dx.y = 0.0;
-            Dx.z = 0.0;
-            Dy.x = 0.0;
-            Dy.y = sqrt(matrix[2])/(2.0*M_PI);
-            Dy.z = 0.0;
-          }
-
-          // T = trace and D = det of the angluar submatrix
-          T = matrix[5]+matrix[9];
-          D = matrix[5]*matrix[9] - matrix[8]*matrix[8];
-
-          // Solve the 2nd order polynomial roots of p(l) = l^2 - l T + D.
-          // This gives us the eigen values.
-          d  = 0.25*T*T - D;
-          if(d < 0.0) { throw 1; } // No solution exists
-          l1 = 0.5*T + sqrt(d);
-          l2 = 0.5*T - sqrt(d);
-
-          if(abs(matrix[8]) > COV_MIN_FLOAT) {
-            Du.x = l1 - matrix[9];
-            Du.y = matrix[8];
-            Du.z = 0.0;
-            Dv.x = l2 - matrix[9];
-            Dv.y = matrix[8];
-            Dv.z = 0.0;
-
-            Du.Normalize();
-            Dv.Normalize();
-
-            Du = sqrt(l1)/(2.0*M_PI) * Du;
-            Dv = sqrt(l2)/(2.0*M_PI) * Dv;
-          } else {
-            Du.x = sqrt(matrix[5])/(2.0*M_PI);
-            Du.y = 0.0;
-            Du.z = 0.0;
-            Dv.x = 0.0;
-            Dv.y = sqrt(matrix[9])/(2.0*M_PI);
-            Dv.z = 0.0;
-          }
+         SpatialExtent(Dx, Dy);
+         AngularExtent(Du, Dv);
       }
 
 
@@ -467,7 +510,14 @@ namespace Covariance {
        * the inverse covariance matrix in frequency space.
        */
       void SpatialFilter(Float& sxx, Float& sxy, Float& syy) const {
+         TrySpatialFilter(sxx, sxy, syy);
+      }
 
+      /* Same as above, returning 'false' when the spatial submatrix is
+       * degenerate, in which case the filter is isotropic with the maximal
+       * bandwidth.
+       */
+      bool TrySpatialFilter(Float& sxx, Float& sxy, Float& syy) const noexcept {
          // The outgoing filter is the inverse submatrix of this inverse
          // matrix.
          Float det = (matrix[0]*matrix[2]-matrix[1]*matrix[1]) / pow(2.0*M_PI,2);
@@ -475,10 +525,12 @@ namespace Covariance {
             sxx =  matrix[2] / det;
             syy =  matrix[0] / det;
             sxy = -matrix[1] / det;
+            return true;
          } else {
-            sxx = INVCOV_MAX_FLOAT;
-            syy = INVCOV_MAX_FLOAT;
+            sxx = Limits<Float>::InvMax();
+            syy = Limits<Float>::InvMax();
             sxy = 0.0;
+            return false;
          }
       }
 
@@ -496,38 +548,8 @@ namespace Covariance {
           of the polygonal shape.
        */
       void SpatialExtent(Vector& Dx, Vector& Dy) const {
-          // T = trace and D = det of the spatial submatrix
-          Float T = matrix[0]+matrix[2];
-          Float D = matrix[0]*matrix[2] - matrix[1]*matrix[1];
-
-          // Solve the 2nd order polynomial roots of p(l) = l^2 - l T + D.
-          // This gives us the eigen values.
-          Float d  = 0.25*T*T - D;
-          if(d < 0.0) { throw 1; } // No solution exists
-          Float l1 = 0.5*T + sqrt(d);
-          Float l2 = 0.5*T - sqrt(d);
-
-          if(abs(matrix[1]) > INVCOV_MIN_FLOAT) {
-            Dx.x = l1 - matrix[2];
-            Dx.y = matrix[1];
-            Dx.z = 0.0;
-            Dy.x = l2 - matrix[2];
-            Dy.y = matrix[1];
-            Dy.z = 0.0;
-
-            Dx.Normalize();
-            Dy.Normalize();
-
-            Dx = sqrt(l1)/(2.0*M_PI) * Dx;
-            Dy = sqrt(l2)/(2.0*M_PI) * Dy;
-          } else {
-            Dx.x = sqrt(matrix[0])/(2.0*M_PI);
-            Dx.y = 0.0;
-            Dx.z = 0.0;
-            Dy.x = 0.0;
-            Dy.y = sqrt(matrix[2])/(2.0*M_PI);
-            Dy.z = 0.0;
-          }
+         ExtentAxes(matrix[0], matrix[1], matrix[2],
+                    Limits<Float>::InvMin(), Dx, Dy);
       }
 
 
@@ -545,7 +567,14 @@ namespace Covariance {
        * the inverse covariance matrix in frequency space.
        */
       void AngularFilter(Float& suu, Float& suv, Float& svv) const {
+         TryAngularFilter(suu, suv, svv);
+      }
 
+      /* Same as above, returning 'false' when the angular submatrix is
+       * degenerate, in which case the filter is isotropic with the maximal
+       * bandwidth.
+       */
+      bool TryAngularFilter(Float& suu, Float& suv, Float& svv) const noexcept {
          // The outgoing filter is the inverse submatrix of this inverse
          // matrix.
          Float det = (matrix[5]*matrix[9]-matrix[8]*matrix[8]) / pow(2.0*M_PI,2);
@@ -553,10 +582,12 @@ namespace Covariance {
             suu =  matrix[9] / det;
             svv =  matrix[5] / det;
             suv = -matrix[8] / det;
+            return true;
          } else {
-            suu = INVCOV_MAX_FLOAT;
-            svv = INVCOV_MAX_FLOAT;
+            suu = Limits<Float>::InvMax();
+            svv = Limits<Float>::InvMax();
             suv = 0.0;
+            return false;
          }
       }
 
@@ -574,58 +605,25 @@ namespace Covariance {
           of the polygonal shape.
        */
       void AngularExtent(Vector& Du, Vector& Dv) const {
-          // T = trace and D = det of the spatial submatrix
-          Float T = matrix[10]+matrix[15];
-          Float D = matrix[10]*matrix[15] - matrix[11]*matrix[11];
-
-          // Solve the 2nd order polynomial roots of p(l) = l^2 - l T + D.
-          // This gives us the eigen values.
-          Float d  = 0.25*T*T - D;
-          if(d < 0.0) { throw 1; } // No solution exists
-          Float l1 = 0.5*T + sqrt(d);
-          Float l2 = 0.5*T - sqrt(d);
-
-          if(abs(matrix[11]) > INVCOV_MIN_FLOAT) {
-            Du.x = l1 - matrix[15];
-            Du.y = matrix[11];
-            Du.z = 0.0;
-            Dv.x = l2 - matrix[15];
-            Dv.y = matrix[11];
-            Dv.z = 0.0;
-
-            Du.Normalize();
-            Dv.Normalize();
-
-            Du = sqrt(l1)/(2.0*M_PI) * Du;
-            Dv = sqrt(l2)/(2.0*M_PI) * Dv;
-          } else {
-            Du.x = sqrt(matrix[10])/(2.0*M_PI);
-            Du.y = 0.0;
-            Du.z = 0.0;
-            Dv.x = 0.0;
-            Dv.y = sqrt(matrix[15])/(2.0*M_PI);
-            Dv.z = 0.0;
-          }
+         ExtentAxes(matrix[5], matrix[8], matrix[9],
+                    Limits<Float>::InvMin(), Du, Dv);
       }
 
       /* Compute the volume (in frequency domain) spanned by the matrix.
        * Note: this volume should always be positive.
        */
       Float Volume() const {
+         COV_TIME(InvCov4D, Volume);
 
-         Float fmatrix[16];
-         fmatrix[ 0] = matrix[ 0] + INVCOV_MIN_FLOAT;
-         fmatrix[ 1] = matrix[ 1]; fmatrix[ 4] = matrix[ 1];
-         fmatrix[ 5] = matrix[ 2] + INVCOV_MIN_FLOAT;
-         fmatrix[ 2] = matrix[ 3]; fmatrix[ 8] = matrix[ 3];
-         fmatrix[ 6] = matrix[ 4]; fmatrix[ 9] = matrix[ 4];
-         fmatrix[10] = matrix[ 5] + INVCOV_MIN_FLOAT;
-         fmatrix[ 3] = matrix[ 6]; fmatrix[12] = matrix[ 6];
-         fmatrix[ 7] = matrix[ 7]; fmatrix[13] = matrix[ 7];
-         fmatrix[11] = matrix[ 8]; fmatrix[14] = matrix[ 8];
-         fmatrix[15] = matrix[ 9] + INVCOV_MIN_FLOAT;
+         std::array<Float, 10> regular = matrix;
+         regular[0] += Limits<Float>::InvMin();
+         regular[2] += Limits<Float>::InvMin();
+         regular[5] += Limits<Float>::InvMin();
+         regular[9] += Limits<Float>::InvMin();
 
-         return 1.0f/Determinant<Float>(fmatrix, 4);
+         const Float volume = 1.0f/SymmetricDeterminant4<Float>(regular.data());
+         COV_COUNT_VOLUME(InvCov4D, volume);
+         return volume;
       }
 
       /////////////////////
@@ -633,16 +631,16 @@ namespace Covariance {
       /////////////////////
 
       InvCovariance4D() {
-         matrix = { INVCOV_MAX_FLOAT,
-                    0.0f, INVCOV_MAX_FLOAT,
-                    0.0f, 0.0f, INVCOV_MAX_FLOAT,
-                    0.0f, 0.0f, 0.0f, INVCOV_MAX_FLOAT};
+         matrix = { Limits<Float>::InvMax(),
+                    0.0f, Limits<Float>::InvMax(),
+                    0.0f, 0.0f, Limits<Float>::InvMax(),
+                    0.0f, 0.0f, 0.0f, Limits<Float>::InvMax()};
       }
       InvCovariance4D(Float sxx, Float syy, Float suu, Float svv) {
-         matrix = { 1.0/std::max<Float>(sxx, INVCOV_MIN_FLOAT),
-                    0.0f,  1.0/std::max<Float>(syy, INVCOV_MIN_FLOAT),
-                    0.0f, 0.0f,  1.0/std::max<Float>(suu, INVCOV_MIN_FLOAT),
-                    0.0f, 0.0f, 0.0f,  1.0/std::max<Float>(svv, INVCOV_MIN_FLOAT)};
+         matrix = { Float(1.0)/std::max<Float>(sxx, Limits<Float>::InvMin()),
+                    0.0f,  Float(1.0)/std::max<Float>(syy, Limits<Float>::InvMin()),
+                    0.0f, 0.0f,  Float(1.0)/std::max<Float>(suu, Limits<Float>::InvMin()),
+                    0.0f, 0.0f, 0.0f,  Float(1.0)/std::max<Float>(svv, Limits<Float>::InvMin())};
       }
       InvCovariance4D(std::array<Float, 10> matrix, const Vector& z) :
          matrix(matrix), z(z) {
@@ -0,0 +1,43 @@
+#pragma once
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Covariance {
+
+   /* Numerical thresholds of the covariance operators for a given 'Float'
+    * type. They are derived from the machine epsilon so that they remain
+    * representable and meaningful in single precision, while keeping the
+    * historical values in double precision:
+    *
+    *                  double     float
+    *    CovMin()      1.0E-5     3.5E-4   max(1.0E-5, sqrt(eps))
+    *    CovMax()      1.0E+5     2.9E+3   1 / CovMin()
+    *    InvMin()      1.0E-10    1.2E-7   max(1.0E-10, eps)
+    *    InvMax()      1.0E+10    8.4E+6   1 / InvMin()
+    *
+    * 'CovMin' regularizes the covariance matrix before inversion and clamps
+    * the covariances of the BRDF and the cosines. Covariances above 'CovMax'
+    * are considered infinite (specular BRDF). 'InvMin' and 'InvMax' play the
+    * same role for the inverse covariance matrix.
+    */
+   template<typename Float>
+   struct Limits {
+      static inline Float CovMin() {
+         return std::max<Float>(Float(1.0E-5),
+                                std::sqrt(std::numeric_limits<Float>::epsilon()));
+      }
+      static inline Float CovMax() {
+         return Float(1.0) / CovMin();
+      }
+      static inline Float InvMin() {
+         return std::max<Float>(Float(1.0E-10),
+                                std::numeric_limits<Float>::epsilon());
+      }
+      static inline Float InvMax() {
+         return Float(1.0) / InvMin();
+      }
+   };
+}
@@ -2,6 +2,48 @@
 
 // STL
 #include <cmath>
+#include <cstddef>
+#include <cstdlib>
+
+/* Loops over the lanes of a batch are annotated with 'COV_SIMD' so that the
+ * compiler vectorizes them for the instruction set it targets (SSE, AVX2 or
+ * AVX-512 depending on the '-m' flags). When OpenMP is not enabled, the
+ * annotation vanishes and the loops are left to the auto-vectorizer, which
+ * is also the scalar fallback.
+ */
+#ifndef COV_SIMD
+#if defined(_OPENMP)
+#define COV_SIMD _Pragma("omp simd")
+#else
+#define COV_SIMD
+#endif
+#endif
+
+/* Lane kernels (e.g. 'ProductUVLane') are called in the 'COV_SIMD' loops
+ * and only vectorize once inlined. 'COV_LANE' forces the inlining, which
+ * the compiler otherwise drops in large translation units.
+ */
+#ifndef COV_LANE
+#if defined(__GNUC__) || defined(__clang__)
+#define COV_LANE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define COV_LANE __forceinline
+#else
+#define COV_LANE inline
+#endif
+#endif
+
+/* Queries that cannot be evaluated on a degenerate matrix throw '1'. When
+ * exceptions are disabled ('-fno-exceptions'), they abort instead. Use the
+ * 'Try*' variants of the queries, which never fail, in that case.
+ */
+#ifndef COV_THROW
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define COV_THROW throw 1
+#else
+#define COV_THROW std::abort()
+#endif
+#endif
 
 namespace Covariance {
 
@@ -102,4 +144,296 @@ namespace Covariance {
    T Determinant(T* A, int size) {
       return recurse_determinant<T>(A, size);
    }
+
+   /* Symmetric 4x4 matrices are stored as their packed upper triangle
+    * (10 elements) using the following indexing:
+    *
+    * A =  ( 0  1  3  6)
+    *      ( 1  2  4  7)
+    *      ( 3  4  5  8)
+    *      ( 6  7  8  9)
+    *
+    * The following routines are closed-form expressions for this layout.
+    * They do not allocate and are meant to be used in the inner loop of a
+    * renderer.
+    */
+
+   /* Compute the determinant of the packed symmetric 4x4 matrix A using the
+    * Laplace expansion over the 2x2 minors of the first two rows.
+    */
+   template<typename T>
+   T SymmetricDeterminant4(const T* A) {
+      // 2x2 minors of the first two rows
+      const T s0 = A[0]*A[2] - A[1]*A[1];
+      const T s1 = A[0]*A[4] - A[1]*A[3];
+      const T s2 = A[0]*A[7] - A[1]*A[6];
+      const T s3 = A[1]*A[4] - A[2]*A[3];
+      const T s4 = A[1]*A[7] - A[2]*A[6];
+      const T s5 = A[3]*A[7] - A[4]*A[6];
+
+      // 2x2 minors of the last two rows
+      const T c0 = A[3]*A[7] - A[6]*A[4];
+      const T c1 = A[3]*A[8] - A[6]*A[5];
+      const T c2 = A[3]*A[9] - A[6]*A[8];
+      const T c3 = A[4]*A[8] - A[7]*A[5];
+      const T c4 = A[4]*A[9] - A[7]*A[8];
+      const T c5 = A[5]*A[9] - A[8]*A[8];
+
+      return s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
+   }
+
+   /* Calculate the inverse of the packed symmetric 4x4 matrix A and store it
+    * in the 4x4 matrix B (16 elements, the full matrix is written). Return
+    * 'false' if the determinant is negative, following 'Inverse'.
+    */
+   template<typename T>
+   bool SymmetricInverse4(const T* A, T* B) {
+      const T s0 = A[0]*A[2] - A[1]*A[1];
+      const T s1 = A[0]*A[4] - A[1]*A[3];
+      const T s2 = A[0]*A[7] - A[1]*A[6];
+      const T s3 = A[1]*A[4] - A[2]*A[3];
+      const T s4 = A[1]*A[7] - A[2]*A[6];
+      const T s5 = A[3]*A[7] - A[4]*A[6];
+
+      const T c0 = A[3]*A[7] - A[6]*A[4];
+      const T c1 = A[3]*A[8] - A[6]*A[5];
+      const T c2 = A[3]*A[9] - A[6]*A[8];
+      const T c3 = A[4]*A[8] - A[7]*A[5];
+      const T c4 = A[4]*A[9] - A[7]*A[8];
+      const T c5 = A[5]*A[9] - A[8]*A[8];
+
+      const T det = s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
+      if(det < T(0.0)) {
+         return false;
+      }
+      const T idet = T(1.0) / det;
+
+      // Only the upper triangle of the adjugate is evaluated, the lower part
+      // is obtained by symmetry.
+      B[ 0] = ( A[2]*c5 - A[4]*c4 + A[7]*c3) * idet;
+      B[ 1] = (-A[1]*c5 + A[3]*c4 - A[6]*c3) * idet;
+      B[ 2] = ( A[7]*s5 - A[8]*s4 + A[9]*s3) * idet;
+      B[ 3] = (-A[4]*s5 + A[5]*s4 - A[8]*s3) * idet;
+      B[ 5] = ( A[0]*c5 - A[3]*c2 + A[6]*c1) * idet;
+      B[ 6] = (-A[6]*s5 + A[8]*s2 - A[9]*s1) * idet;
+      B[ 7] = ( A[3]*s5 - A[5]*s2 + A[8]*s1) * idet;
+      B[10] = ( A[6]*s4 - A[7]*s2 + A[9]*s0) * idet;
+      B[11] = (-A[3]*s4 + A[4]*s2 - A[8]*s0) * idet;
+      B[15] = ( A[3]*s3 - A[4]*s1 + A[5]*s0) * idet;
+
+      B[ 4] = B[ 1];
+      B[ 8] = B[ 2]; B[ 9] = B[ 6];
+      B[12] = B[ 3]; B[13] = B[ 7]; B[14] = B[11];
+      return true;
+   }
+
+   /* LDL^T factorization of a packed symmetric NxN matrix. The packed
+    * storage generalizes the 4x4 layout above: element (i,j) with i <= j is
+    * stored at index j*(j+1)/2 + i.
+    *
+    * The unit lower triangular factor L is stored transposed in 'U' using the
+    * same packed layout (its diagonal is not stored and always equal to 1),
+    * 'D' is the diagonal factor. 'positive' tells if the matrix is positive
+    * definite, which is the case for any valid covariance matrix. When it is
+    * false the content of 'U', 'D' and 'inverse' is meaningless.
+    *
+    * Once factored, the determinant is the product of 'D' and the inverse
+    * (packed) can be evaluated by 'Invert' without computing any cofactor.
+    */
+   template<typename T, int N>
+   struct SymmetricLDLT {
+
+      static const int Size = N*(N+1)/2;
+
+      T    U[Size];
+      T    D[N];
+      T    inverse[Size];
+      bool positive;
+
+      static inline int Index(int i, int j) {
+         return (i <= j) ? j*(j+1)/2 + i : i*(i+1)/2 + j;
+      }
+
+      /* Factor the packed matrix A. Return 'true' if A is positive definite.
+       */
+      bool Factor(const T* A) {
+         positive = true;
+         for(int j=0; j<N; ++j) {
+            T d = A[Index(j, j)];
+            for(int k=0; k<j; ++k) {
+               d -= U[Index(k, j)]*U[Index(k, j)]*D[k];
+            }
+            D[j] = d;
+            if(!(d > T(0.0))) {
+               positive = false;
+               return false;
+            }
+
+            const T id = T(1.0) / d;
+            for(int i=j+1; i<N; ++i) {
+               T l = A[Index(j, i)];
+               for(int k=0; k<j; ++k) {
+                  l -= U[Index(k, i)]*U[Index(k, j)]*D[k];
+               }
+               U[Index(j, i)] = l * id;
+            }
+         }
+         return true;
+      }
+
+      /* Compute the packed inverse of the factored matrix in 'inverse'. This
+       * requires the factorization to be valid.
+       */
+      void Invert() {
+         // X = L^-1 is unit lower triangular, it is stored transposed.
+         T X[Size];
+         for(int j=0; j<N; ++j) {
+            X[Index(j, j)] = T(1.0);
+            for(int i=j+1; i<N; ++i) {
+               T x = -U[Index(j, i)];
+               for(int k=j+1; k<i; ++k) {
+                  x -= U[Index(k, i)]*X[Index(j, k)];
+               }
+               X[Index(j, i)] = x;
+            }
+         }
+
+         // A^-1 = X^T D^-1 X
+         for(int j=0; j<N; ++j) {
+            for(int i=0; i<=j; ++i) {
+               T a = X[Index(i, j)] / D[j];
+               for(int k=j+1; k<N; ++k) {
+                  a += X[Index(i, k)]*X[Index(j, k)] / D[k];
+               }
+               inverse[Index(i, j)] = a;
+            }
+         }
+      }
+
+      /* Determinant of the factored matrix.
+       */
+      T Determinant() const {
+         T det = D[0];
+         for(int i=1; i<N; ++i) {
+            det *= D[i];
+         }
+         return det;
+      }
+   };
+
+   /* Closed-form factorization of a packed symmetric 4x4 matrix, with the
+    * interface of 'SymmetricLDLT<T, 4>'. 'Factor' evaluates the 2x2 minors
+    * of 'SymmetricInverse4' and checks that the matrix is positive definite
+    * with its leading principal minors (Sylvester's criterion). 'Invert'
+    * reuses the minors to write the packed inverse.
+    *
+    * This is the factorization of the 4D covariance queries: it is several
+    * times faster than the generic LDL^T for this size.
+    */
+   template<typename T>
+   struct SymmetricFactor4 {
+
+      T    a[10];        // Copy of the factored matrix
+      T    s[6], c[6];   // 2x2 minors of the first and last two rows
+      T    det;
+      T    inverse[10];
+      bool positive;
+
+      /* Factor the packed matrix A. Return 'true' if A is positive definite.
+       */
+      bool Factor(const T* A) {
+         for(int i=0; i<10; ++i) {
+            a[i] = A[i];
+         }
+         s[0] = A[0]*A[2] - A[1]*A[1];
+         s[1] = A[0]*A[4] - A[1]*A[3];
+         s[2] = A[0]*A[7] - A[1]*A[6];
+         s[3] = A[1]*A[4] - A[2]*A[3];
+         s[4] = A[1]*A[7] - A[2]*A[6];
+         s[5] = A[3]*A[7] - A[4]*A[6];
+
+         c[0] = A[3]*A[7] - A[6]*A[4];
+         c[1] = A[3]*A[8] - A[6]*A[5];
+         c[2] = A[3]*A[9] - A[6]*A[8];
+         c[3] = A[4]*A[8] - A[7]*A[5];
+         c[4] = A[4]*A[9] - A[7]*A[8];
+         c[5] = A[5]*A[9] - A[8]*A[8];
+
+         det = s[0]*c[5] - s[1]*c[4] + s[2]*c[3] + s[3]*c[2] - s[4]*c[1] + s[5]*c[0];
+
+         // Leading principal minors of order 1, 2, 3 and 4
+         const T m3 = A[5]*s[0] - A[4]*s[1] + A[3]*s[3];
+         positive = A[0] > T(0.0) && s[0] > T(0.0) && m3 > T(0.0) && det > T(0.0);
+         return positive;
+      }
+
+      /* Compute the packed inverse of the factored matrix in 'inverse'. This
+       * requires the factorization to be valid.
+       */
+      void Invert() {
+         const T* A = a;
+         const T idet = T(1.0) / det;
+         inverse[0] = ( A[2]*c[5] - A[4]*c[4] + A[7]*c[3]) * idet;
+         inverse[1] = (-A[1]*c[5] + A[3]*c[4] - A[6]*c[3]) * idet;
+         inverse[2] = ( A[0]*c[5] - A[3]*c[2] + A[6]*c[1]) * idet;
+         inverse[3] = ( A[7]*s[5] - A[8]*s[4] + A[9]*s[3]) * idet;
+         inverse[4] = (-A[6]*s[5] + A[8]*s[2] - A[9]*s[1]) * idet;
+         inverse[5] = ( A[6]*s[4] - A[7]*s[2] + A[9]*s[0]) * idet;
+         inverse[6] = (-A[4]*s[5] + A[5]*s[4] - A[8]*s[3]) * idet;
+         inverse[7] = ( A[3]*s[5] - A[5]*s[2] + A[8]*s[1]) * idet;
+         inverse[8] = (-A[3]*s[4] + A[4]*s[2] - A[8]*s[0]) * idet;
+         inverse[9] = ( A[3]*s[3] - A[4]*s[1] + A[5]*s[0]) * idet;
+      }
+
+      /* Determinant of the factored matrix.
+       */
+      T Determinant() const {
+         return det;
+      }
+   };
+
+   /* Eigen-decomposition of the symmetric 2x2 matrix
+    *
+    * A =  ( a  b )
+    *      ( b  c )
+    *
+    * 'l1 >= l2' are the eigenvalues and (ex, ey) is the unit eigenvector of
+    * 'l1'. The eigenvector of 'l2' is (-ey, ex).
+    *
+    * The eigenvalues are evaluated from the half difference of the diagonal
+    * rather than from the trace and determinant, so that the discriminant is
+    * a sum of squares and never negative. The eigenvector is taken from the
+    * row of (A - l2 I) without cancellation. When A is isotropic, any
+    * direction is an eigenvector and (1, 0) is returned. There is no branch
+    * other than selects, and the kernel can be used in vectorized loops.
+    */
+   template<typename T>
+   inline void SymmetricEigen2x2(T a, T b, T c, T& l1, T& l2, T& ex, T& ey) {
+      const T m = T(0.5)*(a + c);
+      const T h = T(0.5)*(a - c);
+      const T r = sqrt(h*h + b*b);
+      l1 = m + r;
+      l2 = m - r;
+
+      const bool pos = (h >= T(0.0));
+      const T    vx  = pos ? h + r : b;
+      const T    vy  = pos ? b     : r - h;
+      const T    n   = sqrt(vx*vx + vy*vy);
+      const bool iso = !(n > T(0.0));
+      const T    in  = T(1.0) / (iso ? T(1.0) : n);
+      ex = iso ? T(1.0) : vx*in;
+      ey = iso ? T(0.0) : vy*in;
+   }
+
+   /* Apply 'SymmetricEigen2x2' to 'count' matrices stored as structure of
+    * arrays: the i-th matrix is (a[i], b[i], c[i]).
+    */
+   template<typename T>
+   void SymmetricEigen2x2(const T* a, const T* b, const T* c,
+                          T* l1, T* l2, T* ex, T* ey, std::size_t count) {
+      COV_SIMD
+      for(std::size_t i=0; i<count; ++i) {
+         SymmetricEigen2x2(a[i], b[i], c[i], l1[i], l2[i], ex[i], ey[i]);
+      }
+   }
 }
@@ -0,0 +1,221 @@
+#pragma once
+
+// STL includes
+#include <type_traits>
+
+namespace Covariance {
+
+   /* Compile-time chains of covariance operators.
+    *
+    * Each operator of 'Covariance4D' (and 'InvCovariance4D') has a small
+    * function object counterpart storing its parameters. Operators are
+    * composed with '>>' into a 'Chain' type that applies them from left to
+    * right:
+    *
+    *    using namespace Covariance::Operators;
+    *    const auto phong = Projection(n) >> Curvature(k, k) >> Cosine()
+    *                    >> Symmetry() >> Reflection(rho, rho)
+    *                    >> Curvature(-k, -k) >> InverseProjection(wo)
+    *                    >> Travel(t);
+    *    phong(cov);
+    *
+    * The whole chain is a single type, so its application is inlined into
+    * one specialized function. Composition also simplifies the chain when
+    * it can be done statically:
+    *
+    *  + 'Symmetry() >> Symmetry()' is the identity and vanishes.
+    *  + Two consecutive 'Travel' (or 'Curvature') are merged into one shear.
+    *  + 'Cosine()' is the normal incidence cosine and costs two additions.
+    *  + 'Identity' vanishes from any chain.
+    */
+   namespace Operators {
+
+      /* Tag base class of all operators. Only types deriving from it can be
+       * composed with '>>'.
+       */
+      struct Operator {};
+
+      template<class T>
+      using IsOperator = std::is_base_of<Operator, T>;
+
+      struct Identity : Operator {
+         template<class Cov>
+         inline void operator()(Cov&) const {}
+      };
+
+      template<typename Float>
+      struct TravelOp : Operator {
+         Float d;
+         TravelOp(Float d) : d(d) {}
+         template<class Cov>
+         inline void operator()(Cov& cov) const { cov.Travel(d); }
+      };
+
+      template<typename Float>
+      struct CurvatureOp : Operator {
+         Float kx, ky;
+         CurvatureOp(Float kx, Float ky) : kx(kx), ky(ky) {}
+         template<class Cov>
+         inline void operator()(Cov& cov) const { cov.Curvature(kx, ky); }
+      };
+
+      template<typename Float>
+      struct CosineOp : Operator {
+         Float wz;
+         CosineOp(Float wz) : wz(wz) {}
+         template<class Cov>
+         inline void operator()(Cov& cov) const { cov.Cosine(wz); }
+      };
+
+      struct NormalCosineOp : Operator {
+         template<class Cov>
+         inline void operator()(Cov& cov) const { cov.Cosine(); }
+      };
+
+      struct SymmetryOp : Operator {
+         template<class Cov>
+         inline void operator()(Cov& cov) const { cov.Symmetry(); }
+      };
+
+      template<typename Float>
+      struct ReflectionOp : Operator {
+         Float suu, svv;
+         ReflectionOp(Float suu, Float svv) : suu(suu), svv(svv) {}
+         template<class Cov>
+         inline void operator()(Cov& cov) const { cov.Reflection(suu, svv); }
+      };
+
+      template<class Vector>
+      struct ProjectionOp : Operator {
+         Vector n;
+         ProjectionOp(const Vector& n) : n(n) {}
+         template<class Cov>
+         inline void operator()(Cov& cov) const { cov.Projection(n); }
+      };
+
+      template<class Vector>
+      struct InverseProjectionOp : Operator {
+         Vector d;
+         InverseProjectionOp(const Vector& d) : d(d) {}
+         template<class Cov>
+         inline void operator()(Cov& cov) const { cov.InverseProjection(d); }
+      };
+
+      /* Sequence of two operators: 'A' is applied first, then 'B'. Longer
+       * chains are nested on the left: 'Chain<Chain<A, B>, C>'.
+       */
+      template<class A, class B>
+      struct Chain : Operator {
+         A first;
+         B second;
+         Chain(const A& first, const B& second) : first(first), second(second) {}
+         template<class Cov>
+         inline void operator()(Cov& cov) const {
+            first(cov);
+            second(cov);
+         }
+      };
+
+
+      ////////////////////////
+      //   Operator makers  //
+      ////////////////////////
+
+      template<typename Float>
+      inline TravelOp<Float> Travel(Float d) {
+         return TravelOp<Float>(d);
+      }
+
+      template<typename Float>
+      inline CurvatureOp<Float> Curvature(Float kx, Float ky) {
+         return CurvatureOp<Float>(kx, ky);
+      }
+
+      template<typename Float>
+      inline CosineOp<Float> Cosine(Float wz) {
+         return CosineOp<Float>(wz);
+      }
+
+      inline NormalCosineOp Cosine() {
+         return NormalCosineOp();
+      }
+
+      inline SymmetryOp Symmetry() {
+         return SymmetryOp();
+      }
+
+      template<typename Float>
+      inline ReflectionOp<Float> Reflection(Float suu, Float svv) {
+         return ReflectionOp<Float>(suu, svv);
+      }
+
+      template<class Vector>
+      inline ProjectionOp<Vector> Projection(const Vector& n) {
+         return ProjectionOp<Vector>(n);
+      }
+
+      template<class Vector>
+      inline InverseProjectionOp<Vector> InverseProjection(const Vector& d) {
+         return InverseProjectionOp<Vector>(d);
+      }
+
+
+      ////////////////////////
+      //    Composition     //
+      ////////////////////////
+
+      // Generic composition
+      template<class A, class B,
+               typename = typename std::enable_if<IsOperator<A>::value &&
+                                                  IsOperator<B>::value>::type>
+      inline Chain<A, B> operator>>(const A& a, const B& b) {
+         return Chain<A, B>(a, b);
+      }
+
+      // The identity vanishes
+      template<class A,
+               typename = typename std::enable_if<IsOperator<A>::value>::type>
+      inline A operator>>(const A& a, const Identity&) {
+         return a;
+      }
+      template<class B,
+               typename = typename std::enable_if<IsOperator<B>::value>::type>
+      inline B operator>>(const Identity&, const B& b) {
+         return b;
+      }
+      inline Identity operator>>(const Identity&, const Identity&) {
+         return Identity();
+      }
+
+      // The symmetry is an involution
+      inline Identity operator>>(const SymmetryOp&, const SymmetryOp&) {
+         return Identity();
+      }
+      template<class A>
+      inline A operator>>(const Chain<A, SymmetryOp>& a, const SymmetryOp&) {
+         return a.first;
+      }
+
+      // Shears along the same axes are additive
+      template<typename Float>
+      inline TravelOp<Float> operator>>(const TravelOp<Float>& a,
+                                        const TravelOp<Float>& b) {
+         return TravelOp<Float>(a.d + b.d);
+      }
+      template<class A, typename Float>
+      inline Chain<A, TravelOp<Float>> operator>>(
+            const Chain<A, TravelOp<Float>>& a, const TravelOp<Float>& b) {
+         return Chain<A, TravelOp<Float>>(a.first, a.second >> b);
+      }
+      template<typename Float>
+      inline CurvatureOp<Float> operator>>(const CurvatureOp<Float>& a,
+                                           const CurvatureOp<Float>& b) {
+         return CurvatureOp<Float>(a.kx + b.kx, a.ky + b.ky);
+      }
+      template<class A, typename Float>
+      inline Chain<A, CurvatureOp<Float>> operator>>(
+            const Chain<A, CurvatureOp<Float>>& a, const CurvatureOp<Float>& b) {
+         return Chain<A, CurvatureOp<Float>>(a.first, a.second >> b);
+      }
+   }
+}
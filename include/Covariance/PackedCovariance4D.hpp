@@ -0,0 +1,146 @@
+#pragma once
+
+// STL includes
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+// Local includes
+#include "Frame.hpp"
+
+namespace Covariance {
+
+   /* Compact storage of a 4D covariance matrix and its local frame in 26
+    * bytes, to cache covariance information along with many path vertices.
+    * It can store both a 'Covariance4D' and an 'InvCovariance4D' (or any
+    * type with the same 'matrix', 'x', 'y' and 'z' members).
+    *
+    * The record stores:
+    *
+    *  + The 4 variances (diagonal entries) as 16 bits codes of their base 2
+    *    logarithm over [2^-64, 2^64]. Code 0 is reserved for null (or
+    *    negative) variances. The relative error is below 0.07%.
+    *
+    *  + The 6 correlations C_ij / sqrt(C_ii C_jj) as 16 bits normalized
+    *    integers. The absolute error on the correlation is below 2E-5.
+    *
+    *  + The frame's Z axis with an octahedral encoding and the angle of the
+    *    X axis in the canonical tangent frame of Z (see 'Frame.hpp'). The Y
+    *    axis is rebuilt as Z x X. The angular error is about 1E-4 radians.
+    *
+    * Left-handed frames are stored as the equivalent right-handed frame by
+    * flipping the Y axis, which scales the matrix by -1 along Y and V.
+    *
+    * The 'Vector' type must expose its 'x', 'y' and 'z' components and be
+    * constructible from them.
+    */
+   struct PackedCovariance4D {
+
+      uint16_t variance[4];     // Codes of the XX, YY, UU, VV entries
+      int16_t  correlation[6];  // XY, XU, YU, XV, YV, UV correlations
+      uint16_t frame[3];        // Octahedral Z and angle of X
+
+      static constexpr double LogMin = -64.0;
+      static constexpr double LogMax =  64.0;
+
+      PackedCovariance4D() {}
+
+      template<class Cov>
+      PackedCovariance4D(const Cov& cov) {
+         Pack(cov);
+      }
+
+      /* Store 'cov' in the record.
+       */
+      template<class Cov>
+      void Pack(const Cov& cov) {
+         using Vector = decltype(cov.x);
+
+         // Normalize the frame handedness
+         const bool left = Vector::Dot(Vector::Cross(cov.x, cov.y), cov.z) < 0.0;
+         std::array<double, 10> m;
+         for(int k=0; k<10; ++k) { m[k] = cov.matrix[k]; }
+         if(left) {
+            m[1] = -m[1]; m[4] = -m[4]; m[6] = -m[6]; m[8] = -m[8];
+         }
+
+         const int diag[4] = { 0, 2, 5, 9 };
+         double sigma[4];
+         for(int i=0; i<4; ++i) {
+            const double var = m[diag[i]];
+            variance[i] = EncodeVariance(var);
+            sigma[i]    = (var > 0.0) ? std::sqrt(var) : 0.0;
+         }
+
+         // Off-diagonal packed indices and their rows and columns
+         const int offd[6] = { 1, 3, 4, 6, 7, 8 };
+         const int row[6]  = { 0, 0, 1, 0, 1, 2 };
+         const int col[6]  = { 1, 2, 2, 3, 3, 3 };
+         for(int k=0; k<6; ++k) {
+            const double s = sigma[row[k]]*sigma[col[k]];
+            const double r = (s > 0.0) ? m[offd[k]] / s : 0.0;
+            correlation[k] = int16_t(std::lround(std::max(-1.0, std::min(1.0, r)) * 32767.0));
+         }
+
+         // Encode Z and the angle of X in the canonical tangent frame of the
+         // decoded Z so that both ends use the same tangent frame.
+         OctahedralEncode(cov.z, frame[0], frame[1]);
+         const Vector z = OctahedralDecode<Vector>(frame[0], frame[1]);
+         Vector t, b;
+         CanonicalBasis(z, t, b);
+         const double alpha = std::atan2(Vector::Dot(cov.x, b), Vector::Dot(cov.x, t));
+         frame[2] = uint16_t(std::lround((alpha / (2.0*M_PI) + 0.5) * 65535.0));
+      }
+
+      /* Restore the record into 'cov'.
+       */
+      template<class Cov>
+      void Unpack(Cov& cov) const {
+         using Vector = decltype(cov.x);
+
+         const int diag[4] = { 0, 2, 5, 9 };
+         double sigma[4];
+         for(int i=0; i<4; ++i) {
+            const double var = DecodeVariance(variance[i]);
+            cov.matrix[diag[i]] = var;
+            sigma[i] = std::sqrt(var);
+         }
+
+         const int offd[6] = { 1, 3, 4, 6, 7, 8 };
+         const int row[6]  = { 0, 0, 1, 0, 1, 2 };
+         const int col[6]  = { 1, 2, 2, 3, 3, 3 };
+         for(int k=0; k<6; ++k) {
+            cov.matrix[offd[k]] = (correlation[k] / 32767.0) * sigma[row[k]]*sigma[col[k]];
+         }
+
+         const Vector z = OctahedralDecode<Vector>(frame[0], frame[1]);
+         Vector t, b;
+         CanonicalBasis(z, t, b);
+         const double alpha = (frame[2] / 65535.0 - 0.5) * 2.0*M_PI;
+         cov.z = z;
+         cov.x = std::cos(alpha)*t + std::sin(alpha)*b;
+         cov.y = Vector::Cross(z, cov.x);
+
+         cov.Invalidate();
+      }
+
+      template<class Cov>
+      Cov Unpack() const {
+         Cov cov;
+         Unpack(cov);
+         return cov;
+      }
+
+      static uint16_t EncodeVariance(double var) {
+         if(!(var > 0.0)) { return 0; }
+         const double t = (std::log2(var) - LogMin) / (LogMax - LogMin);
+         return uint16_t(1 + std::lround(std::max(0.0, std::min(1.0, t)) * 65534.0));
+      }
+
+      static double DecodeVariance(uint16_t code) {
+         if(code == 0) { return 0.0; }
+         return std::exp2(LogMin + (code - 1) / 65534.0 * (LogMax - LogMin));
+      }
+   };
+}
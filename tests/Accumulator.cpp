@@ -0,0 +1,163 @@
+// STL includes
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// Covariance includes
+#include <Covariance/Covariance4D.hpp>
+#include <Covariance/Accumulator.hpp>
+using namespace Covariance;
+
+struct Vector {
+   double x, y, z;
+   Vector() {}
+   Vector(double x, double y, double z) : x(x), y(y), z(z) {}
+   static double Dot(const Vector& w1, const Vector& w2) {
+      return w1.x*w2.x + w1.y*w2.y + w1.z*w2.z;
+   }
+   static Vector Cross(const Vector& u, const Vector& v) {
+      return Vector(u.y*v.z - u.z*v.y, u.z*v.x - u.x*v.z, u.x*v.y - u.y*v.x);
+   }
+   friend Vector operator*(double a, const Vector& w) {
+      return Vector(a*w.x, a*w.y, a*w.z);
+   }
+   friend Vector operator+(const Vector& a, const Vector& w) {
+      return Vector(a.x+w.x, a.y+w.y, a.z+w.z);
+   }
+   friend Vector operator-(const Vector& w) {
+      return Vector(-w.x, -w.y, -w.z);
+   }
+};
+
+using Cov = Covariance4D<Vector, double>;
+using Acc = CovarianceAccumulator4D<Vector, double, true>;
+
+bool IsApprox(double a, double b, double Eps=1.0E-10) {
+   return std::abs(a - b) < Eps*std::max(std::abs(a), 1.0);
+}
+
+/* Random covariance matrices and weights.
+ */
+void Samples(std::vector<Cov>& covs, std::vector<double>& weights, int n) {
+   std::mt19937 gen(0);
+   std::uniform_real_distribution<double> dist(0.0, 1.0);
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   for(int k=0; k<n; ++k) {
+      Cov cov(1.0+dist(gen), 1.0+dist(gen), 1.0+dist(gen), 1.0+dist(gen));
+      cov.x = x; cov.y = y; cov.z = z;
+      cov.Travel(dist(gen));
+      cov.Curvature(dist(gen), dist(gen));
+      covs.push_back(cov);
+      weights.push_back((k % 7 == 0) ? 0.0 : dist(gen));
+   }
+}
+
+/* The mean and variance must match the two-pass weighted estimates, and
+ * the mean must match the chain of 'Covariance4D::Add'.
+ */
+int TestMoments() {
+   int nb_fails = 0;
+
+   std::vector<Cov> covs;
+   std::vector<double> weights;
+   Samples(covs, weights, 100);
+
+   Acc acc;
+   Cov chain = covs[0];
+   double W = 0.0;
+   for(size_t k=0; k<covs.size(); ++k) {
+      acc.Add(covs[k], weights[k]);
+      if(k > 0) { chain.Add(covs[k], W, weights[k]); }
+      W += weights[k];
+   }
+
+   const auto mean = acc.Mean();
+   const auto var  = acc.Variance();
+   for(int i=0; i<10; ++i) {
+      double m = 0.0, v = 0.0;
+      for(size_t k=0; k<covs.size(); ++k) { m += weights[k]*covs[k].matrix[i]; }
+      m /= W;
+      for(size_t k=0; k<covs.size(); ++k) {
+         v += weights[k]*pow(covs[k].matrix[i] - m, 2);
+      }
+      v /= W;
+
+      if(!IsApprox(mean[i], m) || !IsApprox(mean[i], chain.matrix[i]) ||
+         !IsApprox(var[i], v)) {
+         std::cerr << "Error: accumulated moments of entry " << i << " are incorrect: "
+                   << mean[i] << " ≠ " << m << ", " << var[i] << " ≠ " << v << std::endl;
+         ++nb_fails;
+      }
+   }
+
+   return nb_fails;
+}
+
+/* Merging partial accumulators (tiles) must give the same result as a
+ * single accumulation, and the same result for the same merge order.
+ */
+int TestMerge() {
+   int nb_fails = 0;
+
+   std::vector<Cov> covs;
+   std::vector<double> weights;
+   Samples(covs, weights, 100);
+
+   Acc full, tiles[4];
+   for(size_t k=0; k<covs.size(); ++k) {
+      full.Add(covs[k], weights[k]);
+      tiles[(k*k) % 4].Add(covs[k], weights[k]);
+   }
+
+   Acc A, B;
+   for(int t=0; t<4; ++t) { A.Add(tiles[t]); }
+   for(int t=0; t<4; ++t) { B.Add(tiles[t]); }
+
+   const auto fm = full.Mean(), fv = full.Variance();
+   const auto am = A.Mean(),    av = A.Variance();
+   const auto bm = B.Mean(),    bv = B.Variance();
+   for(int i=0; i<10; ++i) {
+      if(!IsApprox(fm[i], am[i]) || !IsApprox(fv[i], av[i])) {
+         std::cerr << "Error: merged moments of entry " << i << " are incorrect" << std::endl;
+         ++nb_fails;
+      }
+      if(am[i] != bm[i] || av[i] != bv[i]) {
+         std::cerr << "Error: merge of entry " << i << " is not deterministic" << std::endl;
+         ++nb_fails;
+      }
+   }
+   if(!IsApprox(full.weight, A.weight)) {
+      std::cerr << "Error: merged weight is incorrect" << std::endl;
+      ++nb_fails;
+   }
+
+   // Empty accumulators
+   Acc E;
+   if(E.Covariance().matrix[0] != 0.0) {
+      std::cerr << "Error: empty accumulator is not null" << std::endl;
+      ++nb_fails;
+   }
+   E.Add(A);
+   if(E.Mean() != A.Mean() || E.Variance() != A.Variance()) {
+      std::cerr << "Error: merge into an empty accumulator is incorrect" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+int main(int argc, char** argv) {
+   int nb_fails = 0;
+
+   nb_fails += TestMoments();
+   nb_fails += TestMerge();
+
+   if(nb_fails > 0) {
+      return EXIT_FAILURE;
+   } else {
+      return EXIT_SUCCESS;
+   }
+}
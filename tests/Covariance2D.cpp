@@ -0,0 +1,225 @@
+// STL includes
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+// Covariance includes
+#include <Covariance/Covariance4D.hpp>
+#include <Covariance/Covariance2D.hpp>
+#include <Covariance/CovarianceBatch2D.hpp>
+using namespace Covariance;
+
+struct Vector2 {
+   double x, y;
+   Vector2() {}
+   Vector2(double x, double y) : x(x), y(y) {}
+   static double Dot(const Vector2& w1, const Vector2& w2) {
+      return w1.x*w2.x + w1.y*w2.y;
+   }
+   void Normalize() {
+      double norm = sqrt(Dot(*this, *this));
+      x /= norm;
+      y /= norm;
+   }
+   friend Vector2 operator*(double a, const Vector2& w) {
+      return Vector2(a*w.x, a*w.y);
+   }
+   friend Vector2 operator+(const Vector2& a, const Vector2& w) {
+      return Vector2(a.x+w.x, a.y+w.y);
+   }
+};
+
+struct Vector {
+   double x, y, z;
+   Vector() {}
+   Vector(double x, double y, double z) : x(x), y(y), z(z) {}
+   static double Dot(const Vector& w1, const Vector& w2) {
+      return w1.x*w2.x + w1.y*w2.y + w1.z*w2.z;
+   }
+   static Vector Cross(const Vector& u, const Vector& v) {
+      Vector r;
+      r.x = u.y*v.z - u.z*v.y;
+      r.y = u.z*v.x - u.x*v.z;
+      r.z = u.x*v.y - u.y*v.x;
+      return r;
+   }
+   friend Vector operator*(double a, const Vector& w) {
+      return Vector(a*w.x, a*w.y, a*w.z);
+   }
+   friend Vector operator+(const Vector& a, const Vector& w) {
+      return Vector(a.x+w.x, a.y+w.y, a.z+w.z);
+   }
+   friend Vector operator-(const Vector& w) {
+      return Vector(-w.x, -w.y, -w.z);
+   }
+};
+
+using Cov2D = Covariance2D<Vector2, double>;
+using Cov4D = Covariance4D<Vector, double>;
+using Batch = CovarianceBatch2D<double, 8>;
+const int N = 8;
+
+bool IsApprox(double a, double b, double Eps=1.0E-8) {
+   return std::abs(a - b) < Eps;
+}
+
+bool IsApprox(const Cov2D& A, const Cov2D& B, double Eps=1.0E-8) {
+   bool IsApprox = true;
+   for(int i=0; i<3; ++i) {
+      IsApprox &= std::abs(A.matrix[i] - B.matrix[i]) < Eps;
+   }
+   return IsApprox;
+}
+
+/* The 2D operators must match the 4D ones restricted to the (X, U) block of
+ * a matrix where (X, U) and (Y, V) are decorrelated.
+ */
+int TestMatrixOperators() {
+   int nb_fails = 0;
+
+   Cov2D A({ 2.0, 0.3, 1.5 }, Vector2(1,0), Vector2(0,1));
+   Cov4D B({ 2.0,
+             0.0, 1.0,
+             0.3, 0.0, 1.5,
+             0.0, 0.0, 0.0, 1.0 }, Vector(1,0,0), Vector(0,1,0), Vector(0,0,1));
+
+   A.Travel(2.5);      B.Travel(2.5);
+   A.Curvature(0.7);   B.Curvature(0.7, 0.0);
+   A.Symmetry();       B.Symmetry();
+   A.Reflection(5.0);  B.Reflection(5.0, 5.0);
+   A.Curvature(-0.7);  B.Curvature(-0.7, 0.0);
+
+   if(!IsApprox(A.matrix[0], B.matrix[0]) ||
+      !IsApprox(A.matrix[1], B.matrix[3]) ||
+      !IsApprox(A.matrix[2], B.matrix[5])) {
+      std::cerr << "Error: 2D operators differ from the 4D ones" << std::endl;
+      ++nb_fails;
+   }
+
+   // Travel is reversible
+   Cov2D C = A;
+   C.Travel(3.0);
+   C.Travel(-3.0);
+   if(!IsApprox(A, C)) {
+      std::cerr << "Error: Travel back and forth is not the identity" << std::endl;
+      ++nb_fails;
+   }
+
+   // Specular reflection is the identity
+   C.Reflection(std::numeric_limits<double>::max());
+   if(!IsApprox(A, C)) {
+      std::cerr << "Error: specular reflection is not the identity" << std::endl;
+      ++nb_fails;
+   }
+
+   // Filters and volume of a diagonal matrix
+   const Cov2D D(2.0, 0.5);
+   double sxx, suu;
+   D.SpatialFilter(sxx);
+   D.AngularFilter(suu);
+   if(!IsApprox(sxx, 4*M_PI*M_PI*2.0, 1.0E-3) ||
+      !IsApprox(suu, 4*M_PI*M_PI/0.5, 1.0E-3) ||
+      !IsApprox(D.Volume(), 1.0, 1.0E-3)) {
+      std::cerr << "Error: filters of a diagonal matrix are incorrect" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+/* Projection on a surface and back along the same direction restores the
+ * matrix and the frame.
+ */
+int TestProjection() {
+   int nb_fails = 0;
+
+   Vector2 n(0.4, -1.0); n.Normalize();
+   Cov2D A({ 2.0, 0.3, 1.5 }, Vector2(1,0), Vector2(0,1));
+   Cov2D B = A;
+   B.Projection(n);
+   if(!IsApprox(Vector2::Dot(B.x, B.z), 0.0) || Vector2::Dot(A.x, B.x) <= 0.0) {
+      std::cerr << "Error: projected tangent is incorrect" << std::endl;
+      ++nb_fails;
+   }
+   B.InverseProjection(A.z);
+   if(!IsApprox(A, B) || !IsApprox(Vector2::Dot(A.x, B.x), 1.0)) {
+      std::cerr << "Error: inverse projection does not restore the matrix" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+/* Each lane of a batch must match the scalar operators on a full bounce.
+ */
+int TestBatch() {
+   int nb_fails = 0;
+
+   std::mt19937 gen(0);
+   std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+   Cov2D covs[N];
+   Batch batch;
+   alignas(64) double d[N], k[N], rho[N], wz[N];
+   alignas(64) double n[2][N], wo[2][N];
+   for(int i=0; i<N; ++i) {
+      const double a = 0.5*dist(gen);
+      Vector2 z(sin(a), cos(a));
+      covs[i] = Cov2D({ 2.0+dist(gen), 0.3*dist(gen), 1.5+dist(gen) },
+                      Vector2(z.y, -z.x), z);
+      batch.Load(i, covs[i]);
+
+      d[i]   = 2.0 + dist(gen);
+      k[i]   = dist(gen);
+      rho[i] = (i % 4 == 0) ? std::numeric_limits<double>::max() : 5.0 + dist(gen);
+      wz[i]  = 0.5 + 0.4*dist(gen);
+      Vector2 ni(0.3*dist(gen), -1.0); ni.Normalize();
+      Vector2 wi(0.3*dist(gen), -1.0); wi.Normalize();
+      n[0][i]  = ni.x; n[1][i]  = ni.y;
+      wo[0][i] = wi.x; wo[1][i] = wi.y;
+
+      covs[i].Travel(d[i]);
+      covs[i].Projection(ni);
+      covs[i].Curvature(k[i]);
+      covs[i].Cosine(wz[i]);
+      covs[i].Symmetry();
+      covs[i].Reflection(rho[i]);
+      covs[i].InverseProjection(wi);
+   }
+
+   batch.Travel(d);
+   batch.Projection(n);
+   batch.Curvature(k);
+   batch.Cosine(wz);
+   batch.Symmetry();
+   batch.Reflection(rho);
+   batch.InverseProjection(wo);
+
+   for(int i=0; i<N; ++i) {
+      Cov2D B;
+      batch.Store(i, B);
+      if(!IsApprox(covs[i], B) ||
+         !IsApprox(covs[i].x.x, B.x.x) || !IsApprox(covs[i].x.y, B.x.y)) {
+         std::cerr << "Error: batch lane " << i << " differs from the scalar operators" << std::endl;
+         ++nb_fails;
+      }
+   }
+
+   return nb_fails;
+}
+
+int main(int argc, char** argv) {
+   int nb_fails = 0;
+
+   nb_fails += TestMatrixOperators();
+   nb_fails += TestProjection();
+   nb_fails += TestBatch();
+
+   if(nb_fails > 0) {
+      return EXIT_FAILURE;
+   } else {
+      return EXIT_SUCCESS;
+   }
+}
@@ -5,6 +5,7 @@
 
 // Covariance includes
 #include <Covariance/Covariance4D.hpp>
+#include <Covariance/Operators.hpp>
 using namespace Covariance;
 
 struct Vector {
@@ -61,9 +62,32 @@ struct Vector {
    }
 };
 
-using Cov = Covariance4D<Vector, double>;
-
-bool IsApprox(const Cov& A, const Cov& B, double Eps=1.0E-3) {
+/* The checks run in double precision, and in single precision when
+ * 'COV_TEST_FLOAT' is defined (TestCovariance4DFloat). The tolerances are
+ * derived from the thresholds of the operators, 'Limits<Float>', and are
+ * the historical ones in double precision. 'Exact' is at least a few ulps
+ * of the 2x2 entries, which are up to 5:
+ *
+ *             double   float
+ *    Exact    1.0E-10  1.9E-6   closed-form 2x2 computations
+ *    Tight    1.0E-8   1.2E-5   closed-form 4x4 computations and fusions
+ *    Extent   1.0E-5   3.5E-4   regularized queries
+ *    Loose    1.0E-3   3.5E-2   chains of operators
+ */
+#ifdef COV_TEST_FLOAT
+using Float = float;
+#else
+using Float = double;
+#endif
+using Cov = Covariance4D<Vector, Float>;
+
+const double Exact  = std::max<double>(Limits<Float>::InvMin(),
+                                       16.0*std::numeric_limits<Float>::epsilon());
+const double Tight  = 100.0*Limits<Float>::InvMin();
+const double Extent = Limits<Float>::CovMin();
+const double Loose  = 100.0*Limits<Float>::CovMin();
+
+bool IsApprox(const Cov& A, const Cov& B, double Eps=Loose) {
    bool IsApprox = true;
    for(int i=0; i<10; ++i) {
       IsApprox &= std::abs(A.matrix[i] - B.matrix[i]) < Eps;
@@ -71,7 +95,7 @@ bool IsApprox(const Cov& A, const Cov& B, double Eps=1.0E-3) {
    return IsApprox;
 }
 
-bool IsApprox(double a, double b, double Eps=1.0E-3) {
+bool IsApprox(double a, double b, double Eps=Loose) {
    return std::abs(a - b) < Eps;
 }
 
@@ -82,6 +106,36 @@ std::ostream& operator<<(std::ostream& out, const Cov& A) {
    return out;
 }
 
+/* Thresholds must be finite and their squares representable, as they are
+ * added to and multiplied with matrix entries, and a regularized diagonal
+ * entry must differ from the original one.
+ */
+int TestLimits() {
+   int nb_fails = 0;
+
+   const Float cmin = Limits<Float>::CovMin(), cmax = Limits<Float>::CovMax();
+   const Float imin = Limits<Float>::InvMin(), imax = Limits<Float>::InvMax();
+   if(!(cmax*cmax < std::numeric_limits<Float>::max()) ||
+      !(imax*imax < std::numeric_limits<Float>::max()) ||
+      !(cmin*cmin > Float(0.0)) || !(imin > Float(0.0))) {
+      std::cerr << "Error: limits are not representable" << std::endl;
+      ++nb_fails;
+   }
+
+   if(Float(1.0) + cmin == Float(1.0) || Float(1.0) + imin == Float(1.0)) {
+      std::cerr << "Error: limits are below the epsilon" << std::endl;
+      ++nb_fails;
+   }
+
+   // Double limits are the historical values
+   if(Limits<double>::CovMin() != 1.0E-5 || Limits<double>::InvMin() != 1.0E-10) {
+      std::cerr << "Error: double limits have changed" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
 int TestRotation() {
    int nb_fails = 0;
 
@@ -119,8 +173,8 @@ int TestShear() {
    int nb_fails = 0;
 
    Cov A, B;
-   double c = 123.456;
-   double d = 765.432;
+   Float c = 123.456;
+   Float d = 765.432;
 
    A = B = Cov(1.0, 2.0, 3.0, 4.0);
    A.ShearAngleSpace( c,  d);
@@ -172,7 +226,7 @@ int TestShear() {
 }
 
 int TestProjection() {
-   std::array<double, 10> matrix = {1.0,
+   std::array<Float, 10> matrix = {1.0,
                                    0.1, 1.0,
                                    0.0, 0.0, 1.0,
                                    0.0, 0.0, 0.1, 1.0};
@@ -197,8 +251,8 @@ int TestProjection() {
 
    /* Perform a specular reflection on the identity covariance */
    {
-   const double rho = std::numeric_limits<double>::max();
-   const double k   = 0.0;
+   const Float rho = std::numeric_limits<Float>::max();
+   const Float k   = 0.0;
    x = Vector(0.0, 1.0,  0.0);
    y = Vector(0.5, 0.0,  0.5); y.Normalize();
    z = Vector(0.5, 0.0, -0.5); z.Normalize();
@@ -228,8 +282,8 @@ int TestProjection() {
    }
 
    {
-   const double rho = std::numeric_limits<double>::max();
-   const double k   = 1.0;
+   const Float rho = std::numeric_limits<Float>::max();
+   const Float k   = 1.0;
    matrix[0] = 0.0;
    matrix[1] = 0.0;
    matrix[2] = 0.0;
@@ -285,7 +339,7 @@ int TestReflection() {
    }
 
    A = B;
-   double rho = std::numeric_limits<double>::max();
+   Float rho = std::numeric_limits<Float>::max();
    A.Reflection(rho, rho);
    if(!IsApprox(A, B)) {
       std::cerr << "Error: Specular reflection reduces angular freqs" << std::endl;
@@ -300,8 +354,8 @@ int TestReflection() {
 int TestOrientation() {
    int nb_fails = 0;
 
-   std::array<double, 10> matrix;
-   double r, k;
+   std::array<Float, 10> matrix;
+   Float r, k;
    Vector x, y, z, n, o;
    Cov A, B;
 
@@ -310,7 +364,7 @@ int TestOrientation() {
              0.0, 3.0,
              0.0, 0.0, 5.0,
              0.0, 0.0, 0.0, 7.0};
-   r = std::numeric_limits<double>::max();
+   r = std::numeric_limits<Float>::max();
    k = 0.0;
    x = Vector( 0, 1, 0);
    y = Vector( 1, 0, 1); y.Normalize();
@@ -347,9 +401,9 @@ int TestOrientation() {
 int TestVolume() {
    int nb_fails = 0;
 
-   std::array<double, 10> matrix;
+   std::array<Float, 10> matrix;
    Vector x, y, z;
-   double t, k, vol;
+   Float t, k, vol;
    Cov A;
 
    x = Vector( 1, 0, 0);
@@ -403,17 +457,444 @@ int TestVolume() {
    return nb_fails;
 }
 
+int TestInverse() {
+   int nb_fails = 0;
+
+   // Symmetric positive definite matrix in packed form and its full 4x4
+   // counterpart.
+   const Float packed[10] = { 4.0,
+                               1.0, 3.0,
+                               0.5, 0.2, 2.0,
+                               0.1, 0.3, 0.4, 1.5};
+   Float full[16] = { packed[0], packed[1], packed[3], packed[6],
+                       packed[1], packed[2], packed[4], packed[7],
+                       packed[3], packed[4], packed[5], packed[8],
+                       packed[6], packed[7], packed[8], packed[9] };
+
+   const Float det = SymmetricDeterminant4<Float>(packed);
+   if(!IsApprox(det, Determinant<Float>(full, 4))) {
+      std::cerr << "Error: closed-form determinant differs from the cofactor one" << std::endl;
+      std::cerr << det << " ≠ " << Determinant<Float>(full, 4) << std::endl;
+      ++nb_fails;
+   }
+
+   Float inverse[16];
+   if(!SymmetricInverse4<Float>(packed, inverse) || !Inverse<Float>(full, 4)) {
+      std::cerr << "Error: unable to invert a positive definite matrix" << std::endl;
+      return ++nb_fails;
+   }
+
+   for(int i=0; i<16; ++i) {
+      if(!IsApprox(inverse[i], full[i], Tight)) {
+         std::cerr << "Error: closed-form inverse differs from the cofactor one at " << i << std::endl;
+         std::cerr << inverse[i] << " ≠ " << full[i] << std::endl;
+         ++nb_fails;
+         break;
+      }
+   }
+
+   return nb_fails;
+}
+
+int TestFactorization() {
+   int nb_fails = 0;
+
+   const std::array<Float, 10> matrix = { 4.0,
+                                          1.0, 3.0,
+                                          0.5, 0.2, 2.0,
+                                          0.1, 0.3, 0.4, 1.5};
+   const Cov A(matrix, Vector(1,0,0), Vector(0,1,0), Vector(0,0,1));
+
+   const auto factor = A.Factorize();
+   if(!factor.positive || !A.IsPositiveDefinite()) {
+      std::cerr << "Error: positive definite matrix not detected as such" << std::endl;
+      return ++nb_fails;
+   }
+
+   if(!IsApprox(A.Volume(factor), A.Volume(), Tight)) {
+      std::cerr << "Error: factored determinant differs from the closed-form one" << std::endl;
+      std::cerr << A.Volume(factor) << " ≠ " << A.Volume() << std::endl;
+      ++nb_fails;
+   }
+
+   Float inverse[16];
+   A.InverseMatrix(inverse);
+   const int full[10] = { 0, 1, 5, 2, 6, 10, 3, 7, 11, 15 };
+   for(int i=0; i<10; ++i) {
+      if(!IsApprox(factor.inverse[i], inverse[full[i]], Tight)) {
+         std::cerr << "Error: factored inverse differs from the closed-form one at " << i << std::endl;
+         std::cerr << factor.inverse[i] << " ≠ " << inverse[full[i]] << std::endl;
+         ++nb_fails;
+         break;
+      }
+   }
+
+   // The closed-form factor must match the generic LDLT
+   SymmetricLDLT<Float, 4> ldlt;
+   ldlt.Factor(factor.a);
+   ldlt.Invert();
+   if(!IsApprox(ldlt.Determinant(), factor.Determinant(), Tight)) {
+      std::cerr << "Error: closed-form determinant differs from the LDLT one" << std::endl;
+      std::cerr << factor.Determinant() << " ≠ " << ldlt.Determinant() << std::endl;
+      ++nb_fails;
+   }
+   for(int i=0; i<10; ++i) {
+      if(!IsApprox(factor.inverse[i], ldlt.inverse[i], Tight)) {
+         std::cerr << "Error: closed-form inverse differs from the LDLT one at " << i << std::endl;
+         std::cerr << factor.inverse[i] << " ≠ " << ldlt.inverse[i] << std::endl;
+         ++nb_fails;
+         break;
+      }
+   }
+
+   // Indefinite matrix must be reported without exception
+   const Cov B({ 1.0, 2.0, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 },
+               Vector(1,0,0), Vector(0,1,0), Vector(0,0,1));
+   if(B.Factorize().positive || B.IsPositiveDefinite()) {
+      std::cerr << "Error: indefinite matrix detected as positive definite" << std::endl;
+      ++nb_fails;
+   }
+
+   // Two negative eigenvalues give a positive determinant
+   const Cov C({ -1.0, 0.0, -1.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 },
+               Vector(1,0,0), Vector(0,1,0), Vector(0,0,1));
+   if(C.Factorize().positive || C.IsPositiveDefinite()) {
+      std::cerr << "Error: indefinite matrix with a positive determinant detected as positive definite" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+int TestFrameRotation() {
+   int nb_fails = 0;
+
+   // Compare with the trigonometric rotation on the unit circle
+   for(int i=0; i<64; ++i) {
+      const Float theta = 2.0*M_PI*(i+0.5) / 64.0;
+      const Float cx = 0.3*sin(theta), cy = 0.3*cos(theta);
+      const Float alpha = atan2(cx, cy);
+      Float c, s;
+      FrameRotation(cx, cy, c, s);
+      if(!IsApprox(c, cos(alpha), Exact) || !IsApprox(s, -sin(alpha), Exact)) {
+         std::cerr << "Error: frame rotation differs from atan2 for theta = " << theta << std::endl;
+         std::cerr << c << ", " << s << " ≠ " << cos(alpha) << ", " << -sin(alpha) << std::endl;
+         ++nb_fails;
+         break;
+      }
+   }
+
+   // Degenerate cases are the identity
+   const Float cases[3][2] = { {0.0, -1.0}, {0.0, 0.0}, {std::numeric_limits<Float>::denorm_min(), 0.0} };
+   for(int i=0; i<3; ++i) {
+      Float c, s;
+      FrameRotation(cases[i][0], cases[i][1], c, s);
+      if(c != 1.0 || s != 0.0) {
+         std::cerr << "Error: degenerate frame rotation is not the identity" << std::endl;
+         std::cerr << c << ", " << s << std::endl;
+         ++nb_fails;
+      }
+   }
+
+   return nb_fails;
+}
+
+int TestSurfaceInteraction() {
+   int nb_fails = 0;
+
+   const std::array<Float, 10> matrix = { 4.0,
+                                          1.0, 3.0,
+                                          0.5, 0.2, 2.0,
+                                          0.1, 0.3, 0.4, 1.5};
+   Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   Vector n(0.3, -0.2, -1.0);   n.Normalize();
+   Vector wo(-0.4, 0.1, -1.0); wo.Normalize();
+   const Float k = 0.7, t = 2.5;
+
+   // Glossy and specular reflections
+   const Float rhos[2] = { 5.0, std::numeric_limits<Float>::max() };
+   for(Float rho : rhos) {
+      Cov A(matrix, x, y, z), B(matrix, x, y, z);
+
+      A.Projection(n);
+      A.Curvature(k, k);
+      A.Cosine(0.8);
+      A.Symmetry();
+      A.Reflection(rho, rho);
+      A.Curvature(-k, -k);
+      A.InverseProjection(wo);
+      A.Travel(t);
+
+      B.SurfaceInteraction(n, k, wo, rho, rho, t, 0.8);
+
+      if(!IsApprox(A, B, Tight)) {
+         std::cerr << "Error: fused surface interaction differs from the operator chain" << std::endl;
+         std::cerr << A << std::endl;
+         std::cerr << B << std::endl;
+         ++nb_fails;
+      }
+   }
+
+   return nb_fails;
+}
+
+int TestOperatorChain() {
+   int nb_fails = 0;
+
+   namespace Op = Covariance::Operators;
+
+   // Static simplifications
+   static_assert(std::is_same<decltype(Op::Symmetry() >> Op::Symmetry()),
+                              Op::Identity>::value,
+                 "Symmetry is not an involution");
+   static_assert(std::is_same<decltype(Op::Travel(1.0) >> Op::Travel(2.0)),
+                              Op::TravelOp<double>>::value,
+                 "Travels are not merged");
+   static_assert(std::is_same<decltype(Op::Cosine() >> Op::Symmetry()
+                                                    >> Op::Symmetry()),
+                              Op::NormalCosineOp>::value,
+                 "Symmetries are not removed from the chain");
+
+   const std::array<Float, 10> matrix = { 4.0,
+                                          1.0, 3.0,
+                                          0.5, 0.2, 2.0,
+                                          0.1, 0.3, 0.4, 1.5};
+   Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   Vector n(0.3, -0.2, -1.0);   n.Normalize();
+   Vector wo(-0.4, 0.1, -1.0); wo.Normalize();
+   const Float k = 0.7, t = 2.5, rho = 5.0;
+
+   Cov A(matrix, x, y, z), B(matrix, x, y, z);
+   A.Travel(1.0);
+   A.Travel(t);
+   A.Projection(n);
+   A.Curvature(k, k);
+   A.Cosine(1.0);
+   A.Symmetry();
+   A.Reflection(rho, rho);
+   A.Curvature(-k, -k);
+   A.InverseProjection(wo);
+
+   const auto chain = Op::Travel(1.0) >> Op::Travel(t) >> Op::Projection(n)
+                   >> Op::Curvature(k, k) >> Op::Cosine() >> Op::Symmetry()
+                   >> Op::Reflection(rho, rho) >> Op::Curvature(-k, -k)
+                   >> Op::InverseProjection(wo);
+   chain(B);
+
+   if(!IsApprox(A, B, Tight)) {
+      std::cerr << "Error: operator chain differs from the sequential operators" << std::endl;
+      std::cerr << A << std::endl;
+      std::cerr << B << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+/* The 2x2 eigen-decomposition must reconstruct the matrix, including the
+ * diagonal and isotropic cases, and its batched form must match the scalar
+ * one.
+ */
+int TestSymmetricEigen2x2() {
+   int nb_fails = 0;
+
+   const int n = 6;
+   Float a[n] = { 2.0, 1.0, 3.0, 2.0, 1.0E-8, 5.0 };
+   Float b[n] = { 0.5, 0.0, 0.0, 0.0, 1.0E-9, -2.0 };
+   Float c[n] = { 1.0, 3.0, 1.0, 2.0, 1.0E-8, 0.2 };
+   Float l1[n], l2[n], ex[n], ey[n];
+   SymmetricEigen2x2(a, b, c, l1, l2, ex, ey, n);
+
+   for(int i=0; i<n; ++i) {
+      Float s1, s2, sx, sy;
+      SymmetricEigen2x2(a[i], b[i], c[i], s1, s2, sx, sy);
+
+      // A = l1 e e^T + l2 e' e'^T with e' = (-ey, ex)
+      const Float ra = l1[i]*ex[i]*ex[i] + l2[i]*ey[i]*ey[i];
+      const Float rb = (l1[i] - l2[i])*ex[i]*ey[i];
+      const Float rc = l1[i]*ey[i]*ey[i] + l2[i]*ex[i]*ex[i];
+      if(!IsApprox(ra, a[i], Exact) || !IsApprox(rb, b[i], Exact) ||
+         !IsApprox(rc, c[i], Exact) || l1[i] < l2[i] ||
+         !IsApprox(ex[i]*ex[i] + ey[i]*ey[i], 1.0, Exact)) {
+         std::cerr << "Error: eigen-decomposition " << i << " is incorrect" << std::endl;
+         ++nb_fails;
+      }
+      if(s1 != l1[i] || s2 != l2[i] || sx != ex[i] || sy != ey[i]) {
+         std::cerr << "Error: batched eigen-decomposition " << i << " differs" << std::endl;
+         ++nb_fails;
+      }
+   }
+
+   // The axes of a decoupled spatial filter are returned in the order of
+   // the frame, whatever their length.
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   Vector Dx, Dy;
+   const Float sxx[2] = { 1.0, 4.0 };
+   for(Float s : sxx) {
+      Cov A({ s, 0.0, Float(5.0)-s, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 }, x, y, z);
+      A.SpatialExtent(Dx, Dy);
+      if(Dx.y != 0.0 || Dy.x != 0.0 ||
+         !IsApprox(Dx.x, 1.0/(2.0*M_PI*sqrt(s)), Extent) ||
+         !IsApprox(Dy.y, 1.0/(2.0*M_PI*sqrt(5.0-s)), Extent)) {
+         std::cerr << "Error: decoupled extent axes are not in the frame order" << std::endl;
+         std::cerr << Dx << ", " << Dy << std::endl;
+         ++nb_fails;
+      }
+   }
+
+   // Otherwise, the major axis of the spatial extent is along the smallest
+   // variance of the spatial filter.
+   Cov A({ 1.0, 0.5, 4.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 }, x, y, z);
+   A.SpatialExtent(Dx, Dy);
+   if(!(std::abs(Dx.x) > std::abs(Dx.y)) ||
+      !(Vector::Dot(Dx, Dx) > Vector::Dot(Dy, Dy))) {
+      std::cerr << "Error: spatial extent axes are incorrect" << std::endl;
+      std::cerr << Dx << ", " << Dy << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+/* The 'Try*' queries must match the throwing ones on a valid matrix, and
+ * return the isotropic fallback of maximal bandwidth on a degenerate one.
+ */
+int TestTryQueries() {
+   int nb_fails = 0;
+
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   const Cov A({ 4.0, 1.0, 3.0, 0.5, 0.2, 2.0, 0.1, 0.3, 0.4, 1.5 }, x, y, z);
+
+   Float sxx, sxy, syy, txx, txy, tyy;
+   Vector Dx, Dy, Tx, Ty;
+   A.SpatialFilter(sxx, sxy, syy);
+   A.SpatialExtent(Dx, Dy);
+   if(!A.TrySpatialFilter(txx, txy, tyy) || !A.TrySpatialExtent(Tx, Ty) ||
+      sxx != txx || sxy != txy || syy != tyy ||
+      Dx.x != Tx.x || Dx.y != Tx.y || Dy.x != Ty.x || Dy.y != Ty.y) {
+      std::cerr << "Error: Try queries differ from the throwing ones" << std::endl;
+      ++nb_fails;
+   }
+
+   // Negative variance along X
+   const Cov B({ -1.0, 0.0, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 }, x, y, z);
+   Float inverse[16];
+   Vector Du, Dv;
+   const bool ok = B.TrySpatialFilter(sxx, sxy, syy) ||
+                   B.TryExtent(Dx, Dy, Du, Dv) ||
+                   B.TryInverseMatrix(inverse);
+   const Float cmax = Limits<Float>::CovMax();
+   const Float ext  = sqrt(Limits<Float>::CovMin());
+   if(ok || sxx != cmax || syy != cmax || sxy != 0.0 ||
+      !IsApprox(Dx.x, ext, Tight) || !IsApprox(Dy.y, ext, Tight) ||
+      !IsApprox(Du.x, ext, Tight) || !IsApprox(Dv.y, ext, Tight) ||
+      inverse[0] != Limits<Float>::CovMin() || inverse[1] != 0.0) {
+      std::cerr << "Error: Try queries fallback is incorrect" << std::endl;
+      ++nb_fails;
+   }
+
+   bool thrown = false;
+   try {
+      B.SpatialFilter(sxx, sxy, syy);
+   } catch(...) {
+      thrown = true;
+   }
+   if(!thrown) {
+      std::cerr << "Error: SpatialFilter does not throw on a degenerate matrix" << std::endl;
+      ++nb_fails;
+   }
+
+   // Degenerate angular submatrix of an invertible matrix: the angular
+   // filter falls back to the maximal bandwidth without throwing.
+   const Cov C({ 1.0, 0.0, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0, 1.0, 1.0 }, x, y, z);
+   Float suu = 0.0, suv = 1.0, svv = 0.0;
+   thrown = false;
+   try {
+      C.AngularFilter(suu, suv, svv);
+   } catch(...) {
+      thrown = true;
+   }
+   if(thrown || suu != cmax || svv != cmax || suv != 0.0) {
+      std::cerr << "Error: AngularFilter does not fall back on a degenerate angular submatrix" << std::endl;
+      ++nb_fails;
+   }
+   if(C.TryAngularFilter(suu, suv, svv) || suu != cmax || svv != cmax || suv != 0.0) {
+      std::cerr << "Error: TryAngularFilter does not fall back on a degenerate angular submatrix" << std::endl;
+      ++nb_fails;
+   }
+
+   // A matrix that cannot be inverted throws
+   thrown = false;
+   try {
+      B.AngularFilter(suu, suv, svv);
+   } catch(...) {
+      thrown = true;
+   }
+   if(!thrown) {
+      std::cerr << "Error: AngularFilter does not throw on a degenerate matrix" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+#ifdef COV_CACHE_INVERSE
+int TestCache() {
+   int nb_fails = 0;
+
+   Cov A({ 4.0, 1.0, 3.0, 0.5, 0.2, 2.0, 0.1, 0.3, 0.4, 1.5 },
+         Vector(1,0,0), Vector(0,1,0), Vector(0,0,1));
+
+   Float sxx, sxy, syy;
+   A.SpatialFilter(sxx, sxy, syy);
+   if(A._dirty) {
+      std::cerr << "Error: query does not fill the cached inverse" << std::endl;
+      ++nb_fails;
+   }
+
+   A.Travel(0.5);
+   if(!A._dirty) {
+      std::cerr << "Error: Travel does not invalidate the cached inverse" << std::endl;
+      ++nb_fails;
+   }
+
+   // The cached result must match a freshly computed one
+   A.SpatialFilter(sxx, sxy, syy);
+   Cov B(A.matrix, A.x, A.y, A.z);
+   Float bxx, bxy, byy;
+   B.SpatialFilter(bxx, bxy, byy);
+   A.SpatialFilter(sxx, sxy, syy);
+   if(!IsApprox(sxx, bxx) || !IsApprox(sxy, bxy) || !IsApprox(syy, byy)) {
+      std::cerr << "Error: cached spatial filter differs from the direct one" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+#endif
+
 
 int main(int argc, char** argv) {
    int nb_fails = 0;
    std::cout << std::fixed << std::showpos << std::setprecision(2);
 
+   nb_fails += TestLimits();
    nb_fails += TestRotation();
    nb_fails += TestShear();
    nb_fails += TestProjection();
    nb_fails += TestReflection();
    nb_fails += TestOrientation();
    nb_fails += TestVolume();
+   nb_fails += TestInverse();
+   nb_fails += TestFactorization();
+   nb_fails += TestFrameRotation();
+   nb_fails += TestSurfaceInteraction();
+   nb_fails += TestOperatorChain();
+   nb_fails += TestSymmetricEigen2x2();
+   nb_fails += TestTryQueries();
+#ifdef COV_CACHE_INVERSE
+   nb_fails += TestCache();
+#endif
 
    if(nb_fails > 0) {
       return EXIT_FAILURE;
@@ -0,0 +1,333 @@
+// STL includes
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+// Covariance includes
+#include <Covariance/Covariance4D.hpp>
+#include <Covariance/Covariance5D.hpp>
+using namespace Covariance;
+
+struct Vector {
+   double x, y, z;
+   Vector() {}
+   Vector(double x, double y, double z) : x(x), y(y), z(z) {}
+   static double Dot(const Vector& w1, const Vector& w2) {
+      return w1.x*w2.x + w1.y*w2.y + w1.z*w2.z;
+   }
+   static Vector Cross(const Vector& u, const Vector& v) {
+      return Vector(u.y*v.z - u.z*v.y, u.z*v.x - u.x*v.z, u.x*v.y - u.y*v.x);
+   }
+   void Normalize() {
+      const double norm = sqrt(Dot(*this, *this));
+      x /= norm; y /= norm; z /= norm;
+   }
+   friend Vector operator*(double a, const Vector& w) {
+      return Vector(a*w.x, a*w.y, a*w.z);
+   }
+   friend Vector operator+(const Vector& a, const Vector& w) {
+      return Vector(a.x+w.x, a.y+w.y, a.z+w.z);
+   }
+   friend Vector operator-(const Vector& w) {
+      return Vector(-w.x, -w.y, -w.z);
+   }
+};
+
+using Cov4D = Covariance4D<Vector, double>;
+using Cov5D = Covariance5D<Vector, double>;
+
+bool IsApprox(double a, double b, double Eps=1.0E-8) {
+   return std::abs(a - b) < Eps;
+}
+
+bool IsApprox(const Cov5D& A, const Cov5D& B, double Eps=1.0E-8) {
+   bool IsApprox = true;
+   for(int i=0; i<15; ++i) {
+      IsApprox &= std::abs(A.matrix[i] - B.matrix[i]) < Eps;
+   }
+   return IsApprox;
+}
+
+/* Full 5x5 matrix of a packed 5D covariance.
+ */
+void Unpack(const Cov5D& A, double M[5][5]) {
+   for(int i=0; i<5; ++i) {
+      for(int j=0; j<5; ++j) {
+         M[i][j] = A.matrix[Cov5D::Factor::Index(i, j)];
+      }
+   }
+}
+
+/* On a matrix where time is decorrelated from the 4D lightfield, the 5D
+ * operators must match the 4D ones on the spatio-angular block, and leave
+ * the time entries untouched.
+ */
+int TestDecorrelatedTime() {
+   int nb_fails = 0;
+
+   Vector n(0.2, -0.3, -1.0); n.Normalize();
+   Vector wo(-0.1, 0.4, 1.0); wo.Normalize();
+
+   const std::array<double, 10> m4 = { 4.0,
+                                       1.0, 3.0,
+                                       0.5, 0.2, 2.0,
+                                       0.1, 0.3, 0.4, 1.5 };
+   std::array<double, 15> m5;
+   std::copy(m4.begin(), m4.end(), m5.begin());
+   m5[10] = m5[11] = m5[12] = m5[13] = 0.0;
+   m5[14] = 0.7;
+
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   Cov4D A(m4, x, y, z);
+   Cov5D B(m5, x, y, z);
+
+   A.Travel(2.0);          B.Travel(2.0);
+   A.Projection(n);        B.Projection(n);
+   A.Curvature(0.3, -0.2); B.Curvature(0.3, -0.2);
+   A.Cosine(0.8);          B.Cosine(0.8);
+   A.Symmetry();           B.Symmetry();
+   A.Reflection(5.0, 2.0); B.Reflection(5.0, 2.0);
+   A.InverseProjection(wo);B.InverseProjection(wo);
+
+   bool same = IsApprox(B.matrix[14], 0.7);
+   for(int i=0; i<10; ++i) {
+      same &= IsApprox(A.matrix[i], B.matrix[i]);
+   }
+   for(int i=10; i<14; ++i) {
+      same &= IsApprox(B.matrix[i], 0.0);
+   }
+   if(!same) {
+      std::cerr << "Error: 5D operators differ from the 4D ones" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+/* Motion is a shear: moving back and forth is the identity, and a static
+ * signal (no time frequency) moving at velocity 'v' gets a time frequency
+ * of 'v' times its spatial frequency.
+ */
+int TestMotion() {
+   int nb_fails = 0;
+
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   Cov5D A(4.0, 3.0, 2.0, 1.5, 0.0);
+   A.matrix[1] = 0.5;
+
+   Cov5D B = A;
+   B.Motion(0.3, -0.7);
+   const double tt = 0.09*4.0 - 2*0.21*0.5 + 0.49*3.0;
+   if(!IsApprox(B.matrix[14], tt)) {
+      std::cerr << "Error: motion of a static signal is incorrect" << std::endl;
+      ++nb_fails;
+   }
+
+   B.Travel(1.5);
+   B.Motion(-0.3, 0.7);
+   A.Travel(1.5);
+   if(!IsApprox(A, B)) {
+      std::cerr << "Error: motion back and forth is not the identity" << std::endl;
+      ++nb_fails;
+   }
+
+   // The temporal filter of a diagonal matrix only depends on its time entry
+   double stt;
+   Cov5D C(2.0, 2.0, 1.0, 1.0, 0.5);
+   C.TemporalFilter(stt);
+   if(!IsApprox(stt, 4*M_PI*M_PI*0.5, 1.0E-3)) {
+      std::cerr << "Error: temporal filter of a diagonal matrix is incorrect" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+/* The product with an angular signal is the conditioning of the 5D
+ * Gaussian on its angular part:
+ *
+ *    C' = C - C[:,uv] (C[uv,uv] + S)^-1 C[uv,:]
+ */
+int TestProductUV() {
+   int nb_fails = 0;
+
+   std::array<double, 15> m = { 4.0,
+                                1.0, 3.0,
+                                0.5, 0.2, 2.0,
+                                0.1, 0.3, 0.4, 1.5,
+                                0.3, -0.2, 0.6, 0.1, 2.5 };
+   Cov5D A(m, Vector(1,0,0), Vector(0,1,0), Vector(0,0,1));
+   const double su = 0.7, sv = 1.3;
+
+   double M[5][5];
+   Unpack(A, M);
+   const double a = M[2][2]+su, b = M[2][3], d = M[3][3]+sv;
+   const double det = a*d - b*b;
+   const double S[2][2] = { { d/det, -b/det }, { -b/det, a/det } };
+
+   A.ProductUV(su, sv);
+
+   bool same = true;
+   for(int i=0; i<5; ++i) {
+      for(int j=i; j<5; ++j) {
+         double r = M[i][j];
+         for(int k=0; k<2; ++k) {
+            for(int l=0; l<2; ++l) {
+               r -= M[i][2+k]*S[k][l]*M[2+l][j];
+            }
+         }
+         same &= IsApprox(A.matrix[Cov5D::Factor::Index(i, j)], r);
+      }
+   }
+   if(!same) {
+      std::cerr << "Error: 5D product with an angular signal is incorrect" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+/* The fused surface interaction must match the chain of operators it
+ * replaces, including on the time column.
+ */
+int TestSurfaceInteraction() {
+   int nb_fails = 0;
+
+   Vector n(0.2, -0.3, -1.0); n.Normalize();
+   Vector wo(-0.1, 0.4, 1.0); wo.Normalize();
+
+   std::array<double, 15> m = { 4.0,
+                                1.0, 3.0,
+                                0.5, 0.2, 2.0,
+                                0.1, 0.3, 0.4, 1.5,
+                                0.3, -0.2, 0.6, 0.1, 2.5 };
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+
+   const double rhos[2] = { 5.0, 2.0E+6 };
+   for(double rho : rhos) {
+      Cov5D A(m, x, y, z), B(m, x, y, z);
+      A.Projection(n);
+      A.Curvature(0.3, 0.3);
+      A.Cosine(0.8);
+      A.Symmetry();
+      A.Reflection(rho, 2.0);
+      A.Curvature(-0.3, -0.3);
+      A.InverseProjection(wo);
+      A.Travel(1.5);
+
+      B.SurfaceInteraction(n, 0.3, wo, rho, 2.0, 1.5, 0.8);
+      if(!IsApprox(A, B)) {
+         std::cerr << "Error: fused surface interaction differs from the chain"
+                   << " (rho = " << rho << ")" << std::endl;
+         ++nb_fails;
+      }
+   }
+
+   Cov5D C(m, x, y, z), D(m, x, y, z);
+   C.Cosine();
+   D.Cosine(1.0);
+   if(!IsApprox(C, D)) {
+      std::cerr << "Error: Cosine() differs from Cosine(1)" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+/* The inverse matrix must be the inverse of the regularized matrix, and
+ * with time decorrelated, the extents must match the 4D ones. Degenerate
+ * matrices fall back to the isotropic filter of maximal bandwidth.
+ */
+int TestQueries() {
+   int nb_fails = 0;
+
+   const std::array<double, 10> m4 = { 4.0,
+                                       1.0, 3.0,
+                                       0.5, 0.2, 2.0,
+                                       0.1, 0.3, 0.4, 1.5 };
+   std::array<double, 15> m5;
+   std::copy(m4.begin(), m4.end(), m5.begin());
+   m5[10] = 0.3; m5[11] = -0.2; m5[12] = 0.6; m5[13] = 0.1;
+   m5[14] = 2.5;
+
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   Cov5D A(m5, x, y, z);
+
+   double M[5][5], I[25];
+   Unpack(A, M);
+   A.InverseMatrix(I);
+   bool identity = true;
+   for(int i=0; i<5; ++i) {
+      for(int j=0; j<5; ++j) {
+         double r = 0.0;
+         for(int k=0; k<5; ++k) {
+            r += (M[i][k] + (i == k ? Limits<double>::CovMin() : 0.0)) * I[5*k+j];
+         }
+         identity &= IsApprox(r, (i == j) ? 1.0 : 0.0, 1.0E-6);
+      }
+   }
+   if(!identity) {
+      std::cerr << "Error: 5D inverse matrix is incorrect" << std::endl;
+      ++nb_fails;
+   }
+
+   m5[10] = m5[11] = m5[12] = m5[13] = 0.0;
+   Cov4D B4(m4, x, y, z);
+   Cov5D B5(m5, x, y, z);
+   Vector Dx4, Dy4, Du4, Dv4, Dx5, Dy5, Du5, Dv5;
+   B4.Extent(Dx4, Dy4, Du4, Dv4);
+   B5.Extent(Dx5, Dy5, Du5, Dv5);
+   bool same = true;
+   const Vector D4[4] = { Dx4, Dy4, Du4, Dv4 };
+   const Vector D5[4] = { Dx5, Dy5, Du5, Dv5 };
+   for(int i=0; i<4; ++i) {
+      same &= IsApprox(D4[i].x, D5[i].x) && IsApprox(D4[i].y, D5[i].y);
+   }
+   double suu4, suv4, svv4, suu5, suv5, svv5;
+   B4.AngularFilter(suu4, suv4, svv4);
+   same &= B5.TryAngularFilter(suu5, suv5, svv5);
+   same &= IsApprox(suu4, suu5) && IsApprox(suv4, suv5) && IsApprox(svv4, svv5);
+   if(!same) {
+      std::cerr << "Error: 5D extents differ from the 4D ones" << std::endl;
+      ++nb_fails;
+   }
+
+   // Degenerate matrix
+   Cov5D N(-1.0, -1.0, 0.0, 0.0, -1.0);
+   Vector Dx, Dy;
+   double suu, suv, svv;
+   bool fallback = !N.TryInverseMatrix(I) && IsApprox(I[0], Limits<double>::CovMin())
+                && IsApprox(I[1], 0.0);
+   fallback &= !N.TrySpatialExtent(Dx, Dy);
+   fallback &= !N.TryAngularFilter(suu, suv, svv) && suu == Limits<double>::CovMax();
+   bool thrown = false;
+   try {
+      N.InverseMatrix(I);
+   } catch(...) {
+      thrown = true;
+   }
+   if(!fallback || !thrown) {
+      std::cerr << "Error: 5D queries on a degenerate matrix are incorrect" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+int main(int argc, char** argv) {
+   int nb_fails = 0;
+
+   nb_fails += TestDecorrelatedTime();
+   nb_fails += TestMotion();
+   nb_fails += TestProductUV();
+   nb_fails += TestSurfaceInteraction();
+   nb_fails += TestQueries();
+
+   if(nb_fails > 0) {
+      return EXIT_FAILURE;
+   } else {
+      return EXIT_SUCCESS;
+   }
+}
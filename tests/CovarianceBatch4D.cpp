@@ -0,0 +1,281 @@
+// STL includes
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Covariance includes
+#include <Covariance/CovarianceBatch4D.hpp>
+using namespace Covariance;
+
+struct Vector {
+   double x, y, z;
+   Vector() {}
+   Vector(double x, double y, double z) : x(x), y(y), z(z) {}
+   static double Dot(const Vector& w1, const Vector& w2) {
+      return w1.x*w2.x + w1.y*w2.y + w1.z*w2.z;
+   }
+   static Vector Cross(const Vector& u, const Vector& v) {
+      Vector r;
+      r.x = u.y*v.z - u.z*v.y;
+      r.y = u.z*v.x - u.x*v.z;
+      r.z = u.x*v.y - u.y*v.x;
+      return r;
+   }
+   void Normalize() {
+      double norm = sqrt(Dot(*this, *this));
+      x /= norm;
+      y /= norm;
+      z /= norm;
+   }
+   friend Vector operator*(double a, const Vector& w) {
+      Vector v;
+      v.x = a*w.x;
+      v.y = a*w.y;
+      v.z = a*w.z;
+      return v;
+   }
+   friend Vector operator+(const Vector& a, const Vector& w) {
+      Vector v;
+      v.x = a.x+w.x;
+      v.y = a.y+w.y;
+      v.z = a.z+w.z;
+      return v;
+   }
+   friend Vector operator-(const Vector& a, const Vector& w) {
+      Vector v;
+      v.x = a.x-w.x;
+      v.y = a.y-w.y;
+      v.z = a.z-w.z;
+      return v;
+   }
+   friend Vector operator-(const Vector& w) {
+      Vector v;
+      v.x = -w.x;
+      v.y = -w.y;
+      v.z = -w.z;
+      return v;
+   }
+   friend std::ostream& operator<<(std::ostream& out, const Vector& w) {
+      out << "[" << w.x << ", " << w.y << ", " << w.z << "]";
+      return out;
+   }
+};
+
+using Cov   = Covariance4D<Vector, double>;
+using Batch = CovarianceBatch4D<double, 8>;
+const int N = 8;
+
+bool IsApprox(double a, double b, double Eps=1.0E-8) {
+   return std::abs(a - b) < Eps*std::max(std::abs(a), 1.0);
+}
+
+bool IsApprox(const Cov& A, const Cov& B, double Eps=1.0E-8) {
+   bool isApprox = true;
+   for(int i=0; i<10; ++i) {
+      isApprox &= IsApprox(A.matrix[i], B.matrix[i], Eps);
+   }
+   isApprox &= IsApprox(A.x.x, B.x.x, Eps) && IsApprox(A.x.y, B.x.y, Eps) && IsApprox(A.x.z, B.x.z, Eps);
+   isApprox &= IsApprox(A.y.x, B.y.x, Eps) && IsApprox(A.y.y, B.y.y, Eps) && IsApprox(A.y.z, B.y.z, Eps);
+   isApprox &= IsApprox(A.z.x, B.z.x, Eps) && IsApprox(A.z.y, B.z.y, Eps) && IsApprox(A.z.z, B.z.z, Eps);
+   return isApprox;
+}
+
+std::ostream& operator<<(std::ostream& out, const Cov& A) {
+   for(int i=0; i<10; ++i) {
+      out << A.matrix[i] << ", ";
+   }
+   return out;
+}
+
+std::default_random_engine gen(0);
+std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+Vector RandomDirection() {
+   Vector d(dist(gen), dist(gen), dist(gen));
+   d.Normalize();
+   return d;
+}
+
+/* Generate random positive covariance matrices with a random orthonormal
+ * frame for each lane of the batch.
+ */
+void RandomLanes(Cov* covs, Batch& batch) {
+   for(int i=0; i<N; ++i) {
+      Vector z = RandomDirection();
+      Vector x = Vector::Cross(z, RandomDirection()); x.Normalize();
+      Vector y = Vector::Cross(z, x);
+      std::array<double, 10> m;
+      for(int k=0; k<10; ++k) { m[k] = 0.1*dist(gen); }
+      m[0] += 2.0; m[2] += 2.0; m[5] += 2.0; m[9] += 2.0;
+      covs[i] = Cov(m, x, y, z);
+      batch.Load(i, covs[i]);
+   }
+}
+
+int Compare(const Cov* covs, const Batch& batch, const std::string& name) {
+   for(int i=0; i<N; ++i) {
+      Cov B = covs[i];
+      batch.Store(i, B);
+      if(!IsApprox(covs[i], B)) {
+         std::cerr << "Error: batched " << name << " differs from the scalar one at lane " << i << std::endl;
+         std::cerr << covs[i] << std::endl;
+         std::cerr << B << std::endl;
+         return 1;
+      }
+   }
+   return 0;
+}
+
+int TestMatrixOperators() {
+   int nb_fails = 0;
+
+   Cov   covs[N];
+   Batch batch;
+   double a[N], b[N];
+   for(int i=0; i<N; ++i) { a[i] = dist(gen); b[i] = dist(gen); }
+
+   RandomLanes(covs, batch);
+   batch.Travel(a);
+   for(int i=0; i<N; ++i) { covs[i].Travel(a[i]); }
+   nb_fails += Compare(covs, batch, "Travel");
+
+   batch.Curvature(a, b);
+   for(int i=0; i<N; ++i) { covs[i].Curvature(a[i], b[i]); }
+   nb_fails += Compare(covs, batch, "Curvature");
+
+   batch.Rotate(a, b);
+   for(int i=0; i<N; ++i) { covs[i].Rotate(a[i], b[i]); }
+   nb_fails += Compare(covs, batch, "Rotate");
+
+   batch.ScaleX(a); batch.ScaleY(b); batch.ScaleU(a); batch.ScaleV(b);
+   for(int i=0; i<N; ++i) {
+      covs[i].ScaleX(a[i]); covs[i].ScaleY(b[i]);
+      covs[i].ScaleU(a[i]); covs[i].ScaleV(b[i]);
+   }
+   nb_fails += Compare(covs, batch, "Scale");
+
+   batch.Symmetry();
+   for(int i=0; i<N; ++i) { covs[i].Symmetry(); }
+   nb_fails += Compare(covs, batch, "Symmetry");
+
+   for(int i=0; i<N; ++i) { a[i] = std::abs(a[i]); }
+   batch.Cosine(a);
+   for(int i=0; i<N; ++i) { covs[i].Cosine(a[i]); }
+   nb_fails += Compare(covs, batch, "Cosine");
+
+   // Mix diffuse, glossy and specular lanes
+   const double rho = std::numeric_limits<double>::max();
+   for(int i=0; i<N; ++i) {
+      a[i] = (i%3 == 0) ? 0.0 : ((i%3 == 1) ? rho : 10.0*std::abs(b[i]));
+      b[i] = (i%3 == 0) ? 0.0 : 10.0*std::abs(b[i]);
+   }
+   batch.Reflection(a, b);
+   for(int i=0; i<N; ++i) { covs[i].Reflection(a[i], b[i]); }
+   nb_fails += Compare(covs, batch, "Reflection");
+
+   for(int i=0; i<N; ++i) { a[i] = (i%2 == 0) ? 0.0 : 1.0 + i; }
+   batch.ProductUV(a, a);
+   for(int i=0; i<N; ++i) { covs[i].ProductUV(a[i], a[i]); }
+   nb_fails += Compare(covs, batch, "ProductUV");
+
+   return nb_fails;
+}
+
+int TestFrameOperators() {
+   int nb_fails = 0;
+
+   Cov   covs[N];
+   Batch batch;
+   double n[3][N], d[3][N];
+
+   RandomLanes(covs, batch);
+   Vector ns[N], ds[N];
+   for(int i=0; i<N; ++i) {
+      ns[i] = RandomDirection();
+      ds[i] = RandomDirection();
+      n[0][i] = ns[i].x; n[1][i] = ns[i].y; n[2][i] = ns[i].z;
+      d[0][i] = ds[i].x; d[1][i] = ds[i].y; d[2][i] = ds[i].z;
+   }
+
+   batch.Projection(n);
+   for(int i=0; i<N; ++i) { covs[i].Projection(ns[i]); }
+   nb_fails += Compare(covs, batch, "Projection");
+
+   batch.InverseProjection(d);
+   for(int i=0; i<N; ++i) { covs[i].InverseProjection(ds[i]); }
+   nb_fails += Compare(covs, batch, "InverseProjection");
+
+   return nb_fails;
+}
+
+/* The structure of arrays streams must match the scalar operators, for a
+ * count that is not a multiple of the SIMD width and with null and
+ * specular lanes.
+ */
+int TestStream() {
+   int nb_fails = 0;
+
+   const int count = 1001;
+   std::vector<Cov> covs(count);
+   std::vector<double> su(count), sv(count);
+   Cov   lanes[N];
+   Batch batch;
+   for(int i=0; i<count; ++i) {
+      if(i%N == 0) { RandomLanes(lanes, batch); }
+      covs[i] = lanes[i%N];
+      su[i] = (i%5 == 0) ? 0.0 : 10.0*std::abs(dist(gen));
+      sv[i] = (i%5 == 0) ? 0.0 : 10.0*std::abs(dist(gen));
+      if(i%7 == 0) { su[i] = std::numeric_limits<double>::max(); }
+   }
+
+   std::vector<double> soa[10];
+   double* rows[10];
+   for(int k=0; k<10; ++k) {
+      soa[k].resize(count);
+      for(int i=0; i<count; ++i) { soa[k][i] = covs[i].matrix[k]; }
+      rows[k] = soa[k].data();
+   }
+
+   Reflection(rows, su.data(), sv.data(), count);
+   for(int i=0; i<count; ++i) {
+      covs[i].Reflection(su[i], sv[i]);
+      for(int k=0; k<10; ++k) {
+         if(!IsApprox(soa[k][i], covs[i].matrix[k])) {
+            std::cerr << "Error: streamed Reflection differs from the scalar one at " << i << std::endl;
+            std::cerr << covs[i] << std::endl;
+            return ++nb_fails;
+         }
+      }
+   }
+
+   ProductUV(rows, sv.data(), sv.data(), count);
+   for(int i=0; i<count; ++i) {
+      covs[i].ProductUV(sv[i], sv[i]);
+      for(int k=0; k<10; ++k) {
+         if(!IsApprox(soa[k][i], covs[i].matrix[k])) {
+            std::cerr << "Error: streamed ProductUV differs from the scalar one at " << i << std::endl;
+            std::cerr << covs[i] << std::endl;
+            return ++nb_fails;
+         }
+      }
+   }
+
+   return nb_fails;
+}
+
+int main(int argc, char** argv) {
+   int nb_fails = 0;
+   std::cout << std::fixed << std::showpos << std::setprecision(2);
+
+   nb_fails += TestMatrixOperators();
+   nb_fails += TestFrameOperators();
+   nb_fails += TestStream();
+
+   if(nb_fails > 0) {
+      return EXIT_FAILURE;
+   } else {
+      return EXIT_SUCCESS;
+   }
+}
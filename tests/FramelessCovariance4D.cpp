@@ -0,0 +1,127 @@
+// STL includes
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstdlib>
+
+// Covariance includes
+#include <Covariance/FramelessCovariance4D.hpp>
+using namespace Covariance;
+
+struct Vector {
+   double x, y, z;
+   Vector() {}
+   Vector(double x, double y, double z) : x(x), y(y), z(z) {}
+   static double Dot(const Vector& w1, const Vector& w2) {
+      return w1.x*w2.x + w1.y*w2.y + w1.z*w2.z;
+   }
+   static Vector Cross(const Vector& u, const Vector& v) {
+      Vector r;
+      r.x = u.y*v.z - u.z*v.y;
+      r.y = u.z*v.x - u.x*v.z;
+      r.z = u.x*v.y - u.y*v.x;
+      return r;
+   }
+   void Normalize() {
+      double norm = sqrt(Dot(*this, *this));
+      x /= norm;
+      y /= norm;
+      z /= norm;
+   }
+   friend Vector operator*(double a, const Vector& w) {
+      Vector v;
+      v.x = a*w.x;
+      v.y = a*w.y;
+      v.z = a*w.z;
+      return v;
+   }
+   friend Vector operator+(const Vector& a, const Vector& w) {
+      Vector v;
+      v.x = a.x+w.x;
+      v.y = a.y+w.y;
+      v.z = a.z+w.z;
+      return v;
+   }
+   friend Vector operator-(const Vector& a, const Vector& w) {
+      Vector v;
+      v.x = a.x-w.x;
+      v.y = a.y-w.y;
+      v.z = a.z-w.z;
+      return v;
+   }
+   friend Vector operator-(const Vector& w) {
+      Vector v;
+      v.x = -w.x;
+      v.y = -w.y;
+      v.z = -w.z;
+      return v;
+   }
+};
+
+using Cov    = Covariance4D<Vector, double>;
+using InvCov = InvCovariance4D<Vector, double>;
+
+template<class C>
+bool IsApprox(const C& A, const C& B, double Eps=1.0E-8) {
+   bool IsApprox = true;
+   for(int i=0; i<10; ++i) {
+      IsApprox &= std::abs(A.matrix[i] - B.matrix[i]) < Eps;
+   }
+   IsApprox &= Vector::Dot(A.x, B.x) > 1.0-Eps;
+   IsApprox &= Vector::Dot(A.y, B.y) > 1.0-Eps;
+   IsApprox &= Vector::Dot(A.z, B.z) > 1.0-Eps;
+   return IsApprox;
+}
+
+const std::array<double, 10> Matrix = { 4.0,
+                                       1.0, 3.0,
+                                       0.5, 0.2, 2.0,
+                                       0.1, 0.3, 0.4, 1.5};
+
+/* Convert to the frameless variant, travel and expand back. This must give
+ * the same result as travelling with the full type. The frame is either
+ * right or left-handed.
+ */
+template<class C, class F>
+int TestTravel(const char* name, bool left) {
+   int nb_fails = 0;
+
+   Vector z(0.3, -0.2, 0.9); z.Normalize();
+   Vector x = Vector::Cross(z, Vector(1, 0, 0)); x.Normalize();
+   Vector y = Vector::Cross(z, x);
+   if(left) { y = -y; }
+
+   C A(Matrix, x, y, z);
+   F packed(A);
+   packed.Travel(2.5);
+   A.Travel(2.5);
+   if(left) {
+      A.ScaleY(-1.0);
+      A.ScaleV(-1.0);
+      A.y = -A.y;
+   }
+
+   const C B = packed.Covariance(z);
+   if(!IsApprox(A, B)) {
+      std::cerr << "Error: " << name << " frameless travel differs from the full one"
+                << (left ? " (left-handed frame)" : "") << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+int main(int argc, char** argv) {
+   int nb_fails = 0;
+
+   nb_fails += TestTravel<Cov, FramelessCovariance4D<double>>("Covariance4D", false);
+   nb_fails += TestTravel<Cov, FramelessCovariance4D<double>>("Covariance4D", true);
+   nb_fails += TestTravel<InvCov, FramelessInvCovariance4D<double>>("InvCovariance4D", false);
+   nb_fails += TestTravel<InvCov, FramelessInvCovariance4D<double>>("InvCovariance4D", true);
+
+   if(nb_fails > 0) {
+      return EXIT_FAILURE;
+   } else {
+      return EXIT_SUCCESS;
+   }
+}
@@ -0,0 +1,135 @@
+// STL includes
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+// Covariance includes
+#define COV_INSTRUMENT
+#include <Covariance/Covariance4D.hpp>
+#include <Covariance/InvCovariance4D.hpp>
+using namespace Covariance;
+
+struct Vector {
+   double x, y, z;
+   Vector() {}
+   Vector(double x, double y, double z) : x(x), y(y), z(z) {}
+   static double Dot(const Vector& w1, const Vector& w2) {
+      return w1.x*w2.x + w1.y*w2.y + w1.z*w2.z;
+   }
+   static Vector Cross(const Vector& u, const Vector& v) {
+      return Vector(u.y*v.z - u.z*v.y, u.z*v.x - u.x*v.z, u.x*v.y - u.y*v.x);
+   }
+   friend Vector operator*(double a, const Vector& w) {
+      return Vector(a*w.x, a*w.y, a*w.z);
+   }
+   friend Vector operator+(const Vector& a, const Vector& w) {
+      return Vector(a.x+w.x, a.y+w.y, a.z+w.z);
+   }
+   friend Vector operator-(const Vector& w) {
+      return Vector(-w.x, -w.y, -w.z);
+   }
+};
+
+using Cov    = Covariance4D<Vector, double>;
+using InvCov = InvCovariance4D<Vector, double>;
+namespace Ins = Covariance::Instrumentation;
+
+/* Operators, skipped reflections, failed inversions and volumes must be
+ * counted for each class.
+ */
+int TestCounters() {
+   int nb_fails = 0;
+   Ins::Reset();
+
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   Cov A({ 4.0, 1.0, 3.0, 0.5, 0.2, 2.0, 0.1, 0.3, 0.4, 1.5 }, x, y, z);
+   A.Travel(1.0);
+   A.Travel(2.0);
+   A.Curvature(0.5, 0.5);
+   A.Reflection(1.0, 1.0);
+   A.Reflection(std::numeric_limits<double>::max(), 1.0);
+   A.Volume();
+
+   const Cov B({ -1.0, 0.0, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 }, x, y, z);
+   double inverse[16];
+   B.TryInverseMatrix(inverse);
+
+   InvCov C(1.0, 1.0, 1.0, 1.0);
+   C.x = x; C.y = y; C.z = z;
+   C.Travel(1.0);
+   C.Volume();
+
+   const Ins::Counters total = Ins::Total();
+   if(total.count[Ins::Cov4D][Ins::Travel]            != 2 ||
+      total.count[Ins::Cov4D][Ins::Curvature]         != 1 ||
+      total.count[Ins::Cov4D][Ins::Reflection]        != 2 ||
+      total.count[Ins::Cov4D][Ins::ReflectionSkipped] != 1 ||
+      total.count[Ins::Cov4D][Ins::Inverse]           != 1 ||
+      total.count[Ins::Cov4D][Ins::InverseFailed]     != 1 ||
+      total.count[Ins::Cov4D][Ins::Volume]            != 1 ||
+      total.count[Ins::InvCov4D][Ins::Travel]         != 1 ||
+      total.count[Ins::InvCov4D][Ins::Volume]         != 1) {
+      std::cerr << "Error: operator counts are incorrect" << std::endl;
+      ++nb_fails;
+   }
+
+   // Volumes are binned by their decimal exponent
+   int nb_volumes = 0;
+   for(int b=0; b<Ins::NbVolumeBins; ++b) {
+      nb_volumes += total.volume[Ins::Cov4D][b];
+   }
+   const double vol = C.Volume();
+   const int bin = Ins::VolumeBin(vol);
+   if(nb_volumes != 1 || Ins::Total().volume[Ins::InvCov4D][bin] != 2 ||
+      Ins::VolumeBin(-1.0) != 0 || Ins::VolumeBin(1.0) != 1-Ins::VolumeMinExp) {
+      std::cerr << "Error: volume histogram is incorrect" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+/* Counters of exited threads are merged into the total.
+ */
+int TestThreads() {
+   int nb_fails = 0;
+   Ins::Reset();
+
+   const int nb_threads = 4;
+   std::thread threads[nb_threads];
+   for(int k=0; k<nb_threads; ++k) {
+      threads[k] = std::thread([]() {
+         Cov A(1.0, 1.0, 1.0, 1.0);
+         A.x = Vector(1,0,0); A.y = Vector(0,1,0); A.z = Vector(0,0,1);
+         for(int i=0; i<100; ++i) {
+            A.Travel(0.1);
+         }
+      });
+   }
+   for(int k=0; k<nb_threads; ++k) {
+      threads[k].join();
+   }
+
+   const Ins::Counters total = Ins::Total();
+   if(total.count[Ins::Cov4D][Ins::Travel] != 100*nb_threads ||
+      total.cycles[Ins::Cov4D][Ins::Travel] == 0) {
+      std::cerr << "Error: counters of the threads are not merged" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+int main(int argc, char** argv) {
+   int nb_fails = 0;
+
+   nb_fails += TestCounters();
+   nb_fails += TestThreads();
+
+   if(nb_fails > 0) {
+      return EXIT_FAILURE;
+   } else {
+      return EXIT_SUCCESS;
+   }
+}
@@ -6,6 +6,7 @@
 // Covariance includes
 #include <Covariance/Covariance4D.hpp>
 #include <Covariance/InvCovariance4D.hpp>
+#include <Covariance/Accumulator.hpp>
 using namespace Covariance;
 
 struct Vector {
@@ -404,6 +405,143 @@ int TestVolume() {
    return nb_fails;
 }
 
+/* The weighted sum of inverse matrices must be the inverse of the weighted
+ * sum of the covariance matrices, using either 'Add' or the accumulator.
+ */
+int TestAdd() {
+   int nb_fails = 0;
+
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   const Covariance4D<Vector, double> A({ 4.0,
+                                          1.0, 3.0,
+                                          0.5, 0.2, 2.0,
+                                          0.1, 0.3, 0.4, 1.5 }, x, y, z);
+   const Covariance4D<Vector, double> B({ 1.0,
+                                         -0.2, 2.0,
+                                          0.1, 0.0, 3.0,
+                                          0.0, 0.4, 0.3, 2.5 }, x, y, z);
+   Covariance4D<Vector, double> C = A;
+   C.Add(B, 0.3, 0.7);
+
+   auto Inverse = [&](const Covariance4D<Vector, double>& cov) {
+      double inverse[16];
+      cov.InverseMatrix(inverse);
+      std::array<double, 10> m;
+      for(int i=0; i<10; ++i) { m[i] = inverse[Cov::Unpacked(i)]; }
+      return Cov(m, x, y, z);
+   };
+
+   Cov IA = Inverse(A);
+   const Cov IB = Inverse(B), IC = Inverse(C);
+   CovarianceAccumulator4D<Vector, double> acc;
+   acc.Add(IA, 0.3);
+   acc.Add(IB, 0.7);
+   IA.Add(IB, 0.3, 0.7);
+
+   if(!IsApprox(IA, IC)) {
+      std::cerr << "Error: Add is not the inverse of the weighted sum: "
+                << IA << " ≠ " << IC << std::endl;
+      ++nb_fails;
+   }
+   if(!IsApprox(acc.InvCovariance(), IC)) {
+      std::cerr << "Error: accumulator is not the inverse of the weighted sum: "
+                << acc.InvCovariance() << " ≠ " << IC << std::endl;
+      ++nb_fails;
+   }
+
+   // A singular operand is reported and leaves the matrix unchanged
+   Cov S = IB;
+   const Cov N({ -1.0,
+                  0.0, 1.0,
+                  0.0, 0.0, 1.0,
+                  0.0, 0.0, 0.0, 1.0 }, x, y, z);
+   bool thrown = false;
+   try {
+      S.Add(N);
+   } catch(...) {
+      thrown = true;
+   }
+   if(S.TryAdd(N) || !IsApprox(S, IB) || !thrown) {
+      std::cerr << "Error: Add of a singular matrix is not reported" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+/* The extent of the inverse matrix must match the one of the covariance
+ * matrix it is the inverse of.
+ */
+int TestExtent() {
+   int nb_fails = 0;
+
+   const Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   const Covariance4D<Vector, double> A({ 4.0,
+                                          1.0, 3.0,
+                                          0.5, 0.2, 2.0,
+                                          0.1, 0.3, 0.4, 1.5 }, x, y, z);
+   const auto factor = A.Factorize();
+   std::array<double, 10> inverse;
+   std::copy(factor.inverse, factor.inverse+10, inverse.begin());
+   const Cov B(inverse, x, y, z);
+
+   Vector Ax, Ay, Au, Av, Bx, By, Bu, Bv;
+   A.Extent(Ax, Ay, Au, Av);
+   B.Extent(Bx, By, Bu, Bv);
+
+   const Vector a[4] = { Ax, Ay, Au, Av };
+   const Vector b[4] = { Bx, By, Bu, Bv };
+   for(int i=0; i<4; ++i) {
+      // Axes are defined up to their sign
+      const double s = (Vector::Dot(a[i], b[i]) < 0.0) ? -1.0 : 1.0;
+      if(!IsApprox(a[i].x, s*b[i].x) || !IsApprox(a[i].y, s*b[i].y)) {
+         std::cerr << "Error: extent axis " << i << " differs from the covariance one: "
+                   << a[i] << " ≠ " << b[i] << std::endl;
+         ++nb_fails;
+      }
+   }
+
+   return nb_fails;
+}
+
+int TestSurfaceInteraction() {
+   int nb_fails = 0;
+
+   const std::array<double, 10> matrix = { 4.0,
+                                          1.0, 3.0,
+                                          0.5, 0.2, 2.0,
+                                          0.1, 0.3, 0.4, 1.5};
+   Vector x(1,0,0), y(0,1,0), z(0,0,1);
+   Vector n(0.3, -0.2, -1.0);   n.Normalize();
+   Vector wo(-0.4, 0.1, -1.0); wo.Normalize();
+   const double k = 0.7, t = 2.5;
+
+   // Glossy and specular reflections
+   const double rhos[2] = { 5.0, std::numeric_limits<double>::max() };
+   for(double rho : rhos) {
+      Cov A(matrix, x, y, z), B(matrix, x, y, z);
+
+      A.Projection(n);
+      A.Curvature(k, k);
+      A.Cosine(0.8);
+      A.Symmetry();
+      A.Reflection(rho, rho);
+      A.Curvature(-k, -k);
+      A.InverseProjection(wo);
+      A.Travel(t);
+
+      B.SurfaceInteraction(n, k, wo, rho, rho, t, 0.8);
+
+      if(!IsApprox(A, B, 1.0E-8)) {
+         std::cerr << "Error: fused surface interaction differs from the operator chain" << std::endl;
+         std::cerr << A << std::endl;
+         std::cerr << B << std::endl;
+         ++nb_fails;
+      }
+   }
+
+   return nb_fails;
+}
 
 int main(int argc, char** argv) {
    int nb_fails = 0;
@@ -415,6 +553,9 @@ int main(int argc, char** argv) {
    nb_fails += TestReflection();
    nb_fails += TestOrientation();
    nb_fails += TestVolume();
+   nb_fails += TestExtent();
+   nb_fails += TestAdd();
+   nb_fails += TestSurfaceInteraction();
 
    if(nb_fails > 0) {
       return EXIT_FAILURE;
@@ -0,0 +1,188 @@
+// STL includes
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+// Covariance includes
+#include <Covariance/Covariance4D.hpp>
+#include <Covariance/InvCovariance4D.hpp>
+#include <Covariance/PackedCovariance4D.hpp>
+using namespace Covariance;
+
+struct Vector {
+   double x, y, z;
+   Vector() {}
+   Vector(double x, double y, double z) : x(x), y(y), z(z) {}
+   static double Dot(const Vector& w1, const Vector& w2) {
+      return w1.x*w2.x + w1.y*w2.y + w1.z*w2.z;
+   }
+   static Vector Cross(const Vector& u, const Vector& v) {
+      Vector r;
+      r.x = u.y*v.z - u.z*v.y;
+      r.y = u.z*v.x - u.x*v.z;
+      r.z = u.x*v.y - u.y*v.x;
+      return r;
+   }
+   void Normalize() {
+      double norm = sqrt(Dot(*this, *this));
+      x /= norm;
+      y /= norm;
+      z /= norm;
+   }
+   friend Vector operator*(double a, const Vector& w) {
+      Vector v;
+      v.x = a*w.x;
+      v.y = a*w.y;
+      v.z = a*w.z;
+      return v;
+   }
+   friend Vector operator+(const Vector& a, const Vector& w) {
+      Vector v;
+      v.x = a.x+w.x;
+      v.y = a.y+w.y;
+      v.z = a.z+w.z;
+      return v;
+   }
+   friend Vector operator-(const Vector& a, const Vector& w) {
+      Vector v;
+      v.x = a.x-w.x;
+      v.y = a.y-w.y;
+      v.z = a.z-w.z;
+      return v;
+   }
+   friend Vector operator-(const Vector& w) {
+      Vector v;
+      v.x = -w.x;
+      v.y = -w.y;
+      v.z = -w.z;
+      return v;
+   }
+};
+
+using Cov    = Covariance4D<Vector, double>;
+using InvCov = InvCovariance4D<Vector, double>;
+
+static_assert(sizeof(PackedCovariance4D) <= 32, "Packed record is too large");
+
+std::mt19937 gen(0);
+std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+// Random symmetric positive matrix with variances spanning several orders of
+// magnitude, in a random frame of random handedness.
+template<class C>
+C RandomCovariance() {
+   double G[4][4];
+   for(int i=0; i<4; ++i) {
+      const double scale = pow(10.0, 3.0*dist(gen));
+      for(int j=0; j<4; ++j) { G[i][j] = scale*dist(gen); }
+   }
+   std::array<double, 10> matrix;
+   int k = 0;
+   for(int j=0; j<4; ++j) {
+      for(int i=0; i<=j; ++i) {
+         matrix[k] = 0.0;
+         for(int l=0; l<4; ++l) { matrix[k] += G[i][l]*G[j][l]; }
+         ++k;
+      }
+   }
+
+   Vector z(dist(gen), dist(gen), dist(gen)); z.Normalize();
+   Vector x = Vector::Cross(z, Vector(dist(gen), dist(gen), dist(gen)));
+   x.Normalize();
+   Vector y = Vector::Cross(z, x);
+   if(dist(gen) < 0.0) { y = -y; }
+   return C(matrix, x, y, z);
+}
+
+// Error of the round trip of 'A' through a packed record. Matrix errors are
+// relative to the variances: |C_ij - C'_ij| / sqrt(C_ii C_jj).
+template<class C>
+void RoundTripError(const C& A, double& matrix_error, double& frame_error) {
+   const PackedCovariance4D record(A);
+   C B = record.Unpack<C>();
+
+   // Compare in the right-handed version of the original frame
+   C R = A;
+   if(Vector::Dot(Vector::Cross(R.x, R.y), R.z) < 0.0) {
+      R.ScaleY(-1.0);
+      R.ScaleV(-1.0);
+      R.y = -R.y;
+   }
+
+   const int diag[4] = { 0, 2, 5, 9 };
+   matrix_error = 0.0;
+   int k = 0;
+   for(int j=0; j<4; ++j) {
+      for(int i=0; i<=j; ++i) {
+         const double s = sqrt(R.matrix[diag[i]]*R.matrix[diag[j]]);
+         matrix_error = std::max(matrix_error, std::abs(R.matrix[k] - B.matrix[k]) / s);
+         ++k;
+      }
+   }
+
+   frame_error = 0.0;
+   const Vector dx = R.x - B.x, dy = R.y - B.y, dz = R.z - B.z;
+   frame_error = std::max(frame_error, sqrt(Vector::Dot(dx, dx)));
+   frame_error = std::max(frame_error, sqrt(Vector::Dot(dy, dy)));
+   frame_error = std::max(frame_error, sqrt(Vector::Dot(dz, dz)));
+}
+
+template<class C>
+int TestRoundTrip(const char* name) {
+   int nb_fails = 0;
+
+   double max_matrix = 0.0, max_frame = 0.0;
+   for(int n=0; n<10000; ++n) {
+      double matrix_error, frame_error;
+      RoundTripError(RandomCovariance<C>(), matrix_error, frame_error);
+      max_matrix = std::max(max_matrix, matrix_error);
+      max_frame  = std::max(max_frame,  frame_error);
+   }
+
+   std::cout << name << " round trip: matrix error " << std::scientific
+             << std::setprecision(2) << max_matrix << ", frame error "
+             << max_frame << std::endl;
+
+   if(!(max_matrix < 1.0E-3)) {
+      std::cerr << "Error: " << name << " packed matrix error is " << max_matrix << std::endl;
+      ++nb_fails;
+   }
+   if(!(max_frame < 2.0E-4)) {
+      std::cerr << "Error: " << name << " packed frame error is " << max_frame << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+int TestNullMatrix() {
+   int nb_fails = 0;
+
+   const Cov A({0,0,0,0,0,0,0,0,0,0}, Vector(1,0,0), Vector(0,1,0), Vector(0,0,1));
+   const Cov B = PackedCovariance4D(A).Unpack<Cov>();
+   for(int k=0; k<10; ++k) {
+      if(B.matrix[k] != 0.0) {
+         std::cerr << "Error: null matrix is not restored exactly" << std::endl;
+         ++nb_fails;
+         break;
+      }
+   }
+
+   return nb_fails;
+}
+
+int main(int argc, char** argv) {
+   int nb_fails = 0;
+
+   nb_fails += TestRoundTrip<Cov>("Covariance4D");
+   nb_fails += TestRoundTrip<InvCov>("InvCovariance4D");
+   nb_fails += TestNullMatrix();
+
+   if(nb_fails > 0) {
+      return EXIT_FAILURE;
+   } else {
+      return EXIT_SUCCESS;
+   }
+}
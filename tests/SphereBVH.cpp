@@ -0,0 +1,208 @@
+// STL includes
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Tutorials includes
+#include <tutorials/bvh.hpp>
+
+/* Random scene of 'n' spheres in the [-10, 10]^3 box. A quarter of the
+ * spheres are exact duplicates of previous ones and another quarter are
+ * centered inside a previous sphere, so that the BVH has to resolve ties
+ * and overlaps like the linear 'Intersect'.
+ */
+std::vector<Sphere> RandomScene(int n, std::mt19937& gen) {
+   std::uniform_real_distribution<double> pos(-10.0, 10.0);
+   std::uniform_real_distribution<double> rad(0.1, 3.0);
+   std::uniform_real_distribution<double> unit(-1.0, 1.0);
+
+   std::vector<Sphere> spheres;
+   for(int i=0; i<n; ++i) {
+      const int kind = (i > 0) ? int(gen() % 4) : 0;
+      if(kind == 1) {
+         spheres.push_back(spheres[gen() % spheres.size()]);
+      } else if(kind == 2) {
+         const Sphere& s = spheres[gen() % spheres.size()];
+         const Vector c = s.c + 0.5*s.r*Vector(unit(gen), unit(gen), unit(gen));
+         spheres.push_back(Sphere(c, rad(gen), Vector(), Vector()));
+      } else {
+         const Vector c(pos(gen), pos(gen), pos(gen));
+         spheres.push_back(Sphere(c, rad(gen), Vector(), Vector()));
+      }
+   }
+   return spheres;
+}
+
+/* Random ray with an origin in the [-15, 15]^3 box, which contains origins
+ * inside spheres, and an isotropic direction.
+ */
+Ray RandomRay(std::mt19937& gen) {
+   std::uniform_real_distribution<double> pos(-15.0, 15.0);
+   std::normal_distribution<double> normal;
+   Vector d(normal(gen), normal(gen), normal(gen));
+   return Ray(Vector(pos(gen), pos(gen), pos(gen)), d.Normalize());
+}
+
+/* Hits of the BVH must be the ones of the linear 'Intersect' over the
+ * vector of spheres, including the index of the sphere for duplicates.
+ */
+int TestBVH() {
+   int nb_fails = 0;
+
+   std::mt19937 gen(0);
+   const int sizes[] = { 1, 2, 7, 16, 17, 64, 300, 2000 };
+   for(int n : sizes) {
+      const std::vector<Sphere> spheres = RandomScene(n, gen);
+      const SphereBVH bvh(spheres);
+
+      int nb_diffs = 0;
+      for(int i=0; i<20000; ++i) {
+         const Ray ray = RandomRay(gen);
+         double t1, t2;
+         int id1 = -1, id2 = -1;
+         const bool hit1 = Intersect(spheres, ray, t1, id1);
+         const bool hit2 = Intersect(bvh, ray, t2, id2);
+         if(hit1 != hit2 || (hit1 && (id1 != id2 || std::abs(t1-t2) > 1.0E-9*t1))) {
+            if(nb_diffs++ == 0) {
+               std::cerr << "Error: BVH hit differs from the linear one for "
+                         << n << " spheres" << std::endl;
+               std::cerr << hit1 << ", " << id1 << ", " << t1 << " ≠ "
+                         << hit2 << ", " << id2 << ", " << t2 << std::endl;
+            }
+         }
+      }
+      nb_fails += (nb_diffs > 0) ? 1 : 0;
+   }
+
+   // Empty scene
+   const std::vector<Sphere> empty;
+   const SphereBVH bvh(empty);
+   double t;
+   int id = -1;
+   std::mt19937 rgen(1);
+   if(Intersect(bvh, RandomRay(rgen), t, id) || id != -1) {
+      std::cerr << "Error: empty BVH reports a hit" << std::endl;
+      ++nb_fails;
+   }
+
+   return nb_fails;
+}
+
+/* The SIMD kernel must return the distances of 'Sphere::Intersect', and the
+ * structure-of-arrays scene the hits of the linear 'Intersect'.
+ */
+int TestSoA() {
+   int nb_fails = 0;
+
+   std::mt19937 gen(2);
+   const int sizes[] = { 1, 15, 16, 33, 300 };
+   for(int n : sizes) {
+      const std::vector<Sphere> spheres = RandomScene(n, gen);
+      const SphereSoA soa(spheres);
+
+      int nb_diffs = 0;
+      std::vector<double> d(n);
+      for(int i=0; i<5000; ++i) {
+         const Ray ray = RandomRay(gen);
+         IntersectSpheres(soa.cx.data(), soa.cy.data(), soa.cz.data(),
+                          soa.r.data(), n, ray, d.data());
+         for(int k=0; k<n; ++k) {
+            const double ref = spheres[k].Intersect(ray);
+            if(std::abs(d[k] - ref) > 1.0E-9*ref) {
+               if(nb_diffs++ == 0) {
+                  std::cerr << "Error: SIMD distance differs from Sphere::Intersect: "
+                            << ref << " ≠ " << d[k] << std::endl;
+               }
+            }
+         }
+
+         double t1, t2;
+         int id1 = -1, id2 = -1;
+         const bool hit1 = Intersect(spheres, ray, t1, id1);
+         const bool hit2 = Intersect(soa, ray, t2, id2);
+         if(hit1 != hit2 || (hit1 && (id1 != id2 || std::abs(t1-t2) > 1.0E-9*t1))) {
+            if(nb_diffs++ == 0) {
+               std::cerr << "Error: SoA hit differs from the linear one for "
+                         << n << " spheres" << std::endl;
+               std::cerr << hit1 << ", " << id1 << ", " << t1 << " ≠ "
+                         << hit2 << ", " << id2 << ", " << t2 << std::endl;
+            }
+         }
+      }
+      nb_fails += (nb_diffs > 0) ? 1 : 0;
+   }
+
+   return nb_fails;
+}
+
+/* Each ray of a packet must get the hit of the linear 'Intersect', for
+ * coherent packets (a shared origin and close directions, like the primary
+ * rays of a tile) and for incoherent ones.
+ */
+template<int N>
+int TestPacket() {
+   int nb_fails = 0;
+
+   std::mt19937 gen(3);
+   std::uniform_real_distribution<double> jitter(-0.05, 0.05);
+   const int sizes[] = { 7, 64, 2000 };
+   for(int n : sizes) {
+      const std::vector<Sphere> spheres = RandomScene(n, gen);
+      const SphereBVH bvh(spheres);
+
+      int nb_diffs = 0;
+      for(int p=0; p<2000; ++p) {
+         const bool coherent = (p % 2 == 0);
+         const Ray lead = RandomRay(gen);
+         RayPacket<N> rays;
+         for(int k=0; k<N; ++k) {
+            if(coherent) {
+               Vector d = lead.d + Vector(jitter(gen), jitter(gen), jitter(gen));
+               rays.Set(k, Ray(lead.o, d.Normalize()));
+            } else {
+               rays.Set(k, RandomRay(gen));
+            }
+         }
+
+         double t[N];
+         int id[N];
+         bool hit[N];
+         IntersectPacket<N>(bvh, rays, t, id, hit);
+         for(int k=0; k<N; ++k) {
+            double tr;
+            int idr = -1;
+            const bool hitr = Intersect(spheres, rays.Get(k), tr, idr);
+            if(hitr != hit[k] || (hitr && (idr != id[k] || std::abs(tr-t[k]) > 1.0E-9*tr))) {
+               if(nb_diffs++ == 0) {
+                  std::cerr << "Error: packet of " << N << " rays differs from "
+                            << "the linear hit for " << n << " spheres" << std::endl;
+                  std::cerr << hitr << ", " << idr << ", " << tr << " ≠ "
+                            << hit[k] << ", " << id[k] << ", " << t[k] << std::endl;
+               }
+            }
+         }
+      }
+      nb_fails += (nb_diffs > 0) ? 1 : 0;
+   }
+
+   return nb_fails;
+}
+
+int main(int argc, char** argv) {
+   int nb_fails = 0;
+   std::cout << std::setprecision(17);
+
+   nb_fails += TestBVH();
+   nb_fails += TestSoA();
+   nb_fails += TestPacket<4>();
+   nb_fails += TestPacket<8>();
+   nb_fails += TestPacket<16>();
+
+   if(nb_fails > 0) {
+      return EXIT_FAILURE;
+   } else {
+      return EXIT_SUCCESS;
+   }
+}
@@ -0,0 +1,406 @@
+#pragma once
+
+// Include STL
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Local includes
+#include "common.hpp"
+#include "packet.hpp"
+
+/* Bounding volume hierarchy over a vector of spheres.
+ *
+ * The tree is built with the surface area heuristic (SAH) evaluated on
+ * bins of the centroids, and flattened in depth first order: the first
+ * child of an inner node is the next node in the array and the second one
+ * is at 'offset'. Each node fills a cache line. The leaves point to a copy
+ * of the geometry of the spheres (center and radius) stored in tree order
+ * and in structure-of-arrays layout, so that a traversal never touches the
+ * materials and the spheres of a leaf are tested in SIMD lanes (see
+ * 'packet.hpp').
+ *
+ * The BVH keeps a pointer to the vector of spheres to give access to the
+ * hit object with 'operator[]': it can replace the vector in the routines
+ * templated on the scene ('Radiance', 'CovarianceFilter'). The materials of
+ * the spheres can be modified after the build, but the BVH has to be
+ * rebuilt if the geometry changes.
+ *
+ * 'Intersect(bvh, ...)' returns the hit of the linear
+ * 'Intersect(spheres, ...)': distances are computed with the arithmetic of
+ * 'Sphere::Intersect' and, for spheres hit at the same distance, the one
+ * with the largest index is returned.
+ */
+struct SphereBVH {
+
+   struct alignas(64) Node {
+      double  lo[3], hi[3]; // Bounding box
+      int32_t offset;       // Second child, or first primitive of a leaf
+      int16_t count;        // Number of primitives, 0 for inner nodes
+      int16_t axis;         // Split axis of inner nodes
+   };
+
+   static const int MaxLeafSize   = 16;
+   static const int NbBins        = 16;
+   static const int StackSize     = 64;
+   static const int MaxPacketSize = 64;
+
+   std::vector<Node>   nodes;
+   std::vector<double> cx, cy, cz, r; // Spheres in leaf order
+   std::vector<int>    ids;           // Index of the spheres in the input vector
+   const std::vector<Sphere>* spheres;
+
+   SphereBVH(const std::vector<Sphere>& spheres) {
+      Build(spheres);
+   }
+
+   const Sphere& operator[](int i) const {
+      return (*spheres)[i];
+   }
+   size_t size() const {
+      return spheres->size();
+   }
+
+   static inline double Axis(const Vector& v, int axis) {
+      return (axis == 0) ? v.x : (axis == 1) ? v.y : v.z;
+   }
+
+   /* Inverse of the ray direction for the slab test. Null components are
+    * replaced by a large finite value so that no infinity (or NaN from
+    * 0*inf) is produced, which '-ffast-math' would not handle.
+    */
+   static inline void InverseDirection(const Vector& d, double* inv) {
+      for(int k=0; k<3; ++k) {
+         const double dk = Axis(d, k);
+         inv[k] = (std::fabs(dk) > 1.0E-200) ? 1.0/dk : std::copysign(1.0E200, dk);
+      }
+   }
+
+   /* Slab test of the ray with origin 'o' and inverse direction 'inv'
+    * against the box of 'node', restricted to [0, tmax].
+    */
+   static inline bool Slab(const Node& node, const Vector& o, const double* inv,
+                           double tmax) {
+      double tmin = 0.0;
+      for(int k=0; k<3; ++k) {
+         const double ok = Axis(o, k);
+         const double t0 = (node.lo[k] - ok) * inv[k];
+         const double t1 = (node.hi[k] - ok) * inv[k];
+         tmin = std::max(tmin, std::min(t0, t1));
+         tmax = std::min(tmax, std::max(t0, t1));
+      }
+      return tmin <= tmax;
+   }
+
+   /* Test the primitives of a leaf and update the closest hit ('t', 'id')
+    * with the tie-break of the linear 'Intersect'.
+    */
+   inline void IntersectLeaf(const Node& node, const Ray& ray, double& t, int& id) const {
+      const int o = node.offset;
+      double d[MaxLeafSize];
+      IntersectSpheres(&cx[o], &cy[o], &cz[o], &r[o], node.count, ray, d);
+      double tl = t;
+      int    il = id;
+      for(int k=0; k<node.count; ++k) {
+         ClosestHit(d[k], ids[o+k], tl, il);
+      }
+      t = tl; id = il;
+   }
+
+   /* Same as above for the rays of a packet flagged in 'active', in SIMD
+    * lanes over the rays.
+    */
+   template<int N>
+   inline void IntersectLeaf(const Node& node, const RayPacket<N>& rays,
+                             uint64_t active, double* t, int* id) const {
+      double d[N];
+      for(int i=node.offset; i<node.offset+node.count; ++i) {
+         IntersectSphere(rays, cx[i], cy[i], cz[i], r[i], d);
+         for(int k=0; k<N; ++k) {
+            if(active & (uint64_t(1) << k)) {
+               ClosestHit(d[k], ids[i], t[k], id[k]);
+            }
+         }
+      }
+   }
+
+
+   ////////////////////////
+   //    Construction    //
+   ////////////////////////
+
+   struct BuildItem {
+      double lo[3], hi[3], c[3];
+      int    id;
+   };
+
+   void Build(const std::vector<Sphere>& spheres) {
+      this->spheres = &spheres;
+      nodes.clear();
+      cx.clear(); cy.clear(); cz.clear(); r.clear(); ids.clear();
+      if(spheres.empty()) {
+         return;
+      }
+
+      // The boxes are padded to account for the rounding of the slab test
+      // against the distances computed by 'Sphere::Intersect'.
+      std::vector<BuildItem> items(spheres.size());
+      for(size_t i=0; i<spheres.size(); ++i) {
+         const Sphere& s = spheres[i];
+         BuildItem& item = items[i];
+         for(int k=0; k<3; ++k) {
+            const double c   = Axis(s.c, k);
+            const double pad = 1.0E-9*(s.r + std::fabs(c));
+            item.lo[k] = c - s.r - pad;
+            item.hi[k] = c + s.r + pad;
+            item.c[k]  = c;
+         }
+         item.id = int(i);
+      }
+
+      nodes.reserve(2*spheres.size());
+      BuildNode(items, 0, int(items.size()), 0);
+   }
+
+   static inline double Area(const double* lo, const double* hi) {
+      const double dx = hi[0]-lo[0], dy = hi[1]-lo[1], dz = hi[2]-lo[2];
+      return 2.0*(dx*dy + dy*dz + dz*dx);
+   }
+
+   static inline void Grow(double* lo, double* hi, const double* blo, const double* bhi) {
+      for(int k=0; k<3; ++k) {
+         lo[k] = std::min(lo[k], blo[k]);
+         hi[k] = std::max(hi[k], bhi[k]);
+      }
+   }
+
+   /* Build the subtree of items [begin, end) and return the index of its
+    * root. Below half of the stack size, nodes are split at the median to
+    * bound the depth of the tree.
+    */
+   int BuildNode(std::vector<BuildItem>& items, int begin, int end, int depth) {
+      const int index = int(nodes.size());
+      nodes.push_back(Node());
+
+      double lo[3] = { 1e300,  1e300,  1e300}, hi[3]  = {-1e300, -1e300, -1e300};
+      double clo[3] = { 1e300,  1e300,  1e300}, chi[3] = {-1e300, -1e300, -1e300};
+      for(int i=begin; i<end; ++i) {
+         Grow(lo, hi, items[i].lo, items[i].hi);
+         Grow(clo, chi, items[i].c, items[i].c);
+      }
+      for(int k=0; k<3; ++k) {
+         nodes[index].lo[k] = lo[k];
+         nodes[index].hi[k] = hi[k];
+      }
+
+      const int count = end - begin;
+      int axis = 0;
+      for(int k=1; k<3; ++k) {
+         if(chi[k]-clo[k] > chi[axis]-clo[axis]) { axis = k; }
+      }
+      if(count <= 1 || chi[axis] <= clo[axis]) {
+         if(count <= MaxLeafSize) {
+            MakeLeaf(items, begin, end, index);
+            return index;
+         }
+      }
+
+      // Find the SAH split among the bins of the three axes. The cost of a
+      // traversal step is twice the cost of a sphere test.
+      int    split    = -1, splitAxis = axis;
+      double bestCost = double(count);
+      if(depth < StackSize/2) {
+         const double area = Area(lo, hi);
+         for(int k=0; k<3; ++k) {
+            const double extent = chi[k] - clo[k];
+            if(!(extent > 0.0)) continue;
+            const double scale = NbBins / extent;
+
+            int    binCount[NbBins] = { 0 };
+            double binLo[NbBins][3], binHi[NbBins][3];
+            for(int b=0; b<NbBins; ++b) {
+               for(int j=0; j<3; ++j) { binLo[b][j] = 1e300; binHi[b][j] = -1e300; }
+            }
+            for(int i=begin; i<end; ++i) {
+               const int b = std::min(NbBins-1, int((items[i].c[k] - clo[k]) * scale));
+               ++binCount[b];
+               Grow(binLo[b], binHi[b], items[i].lo, items[i].hi);
+            }
+
+            // Sweep from the right to get the area and count of the right
+            // side of each split, then from the left to evaluate the cost.
+            double rightArea[NbBins];
+            int    rightCount[NbBins];
+            double rlo[3] = { 1e300,  1e300,  1e300}, rhi[3] = {-1e300, -1e300, -1e300};
+            int    rn = 0;
+            for(int b=NbBins-1; b>0; --b) {
+               rn += binCount[b];
+               if(binCount[b] > 0) { Grow(rlo, rhi, binLo[b], binHi[b]); }
+               rightCount[b] = rn;
+               rightArea[b]  = (rn > 0) ? Area(rlo, rhi) : 0.0;
+            }
+            double llo[3] = { 1e300,  1e300,  1e300}, lhi[3] = {-1e300, -1e300, -1e300};
+            int    ln = 0;
+            for(int b=1; b<NbBins; ++b) {
+               ln += binCount[b-1];
+               if(binCount[b-1] > 0) { Grow(llo, lhi, binLo[b-1], binHi[b-1]); }
+               if(ln == 0 || rightCount[b] == 0) continue;
+               const double cost = 2.0 +
+                  (ln*Area(llo, lhi) + rightCount[b]*rightArea[b]) / area;
+               if(cost < bestCost) {
+                  bestCost  = cost;
+                  split     = b;
+                  splitAxis = k;
+               }
+            }
+         }
+      }
+
+      if(split < 0 && count <= MaxLeafSize) {
+         MakeLeaf(items, begin, end, index);
+         return index;
+      }
+
+      int mid;
+      if(split >= 0) {
+         const double lo_k  = clo[splitAxis];
+         const double scale = NbBins / (chi[splitAxis] - lo_k);
+         mid = int(std::partition(items.begin()+begin, items.begin()+end,
+                  [&](const BuildItem& item) {
+                     return std::min(NbBins-1, int((item.c[splitAxis] - lo_k) * scale)) < split;
+                  }) - items.begin());
+      } else {
+         // No split beats the leaf but there are too many primitives, or
+         // the tree is too deep: split at the median of the largest axis.
+         splitAxis = axis;
+         mid = (begin + end) / 2;
+         std::nth_element(items.begin()+begin, items.begin()+mid, items.begin()+end,
+                          [&](const BuildItem& a, const BuildItem& b) {
+                             return a.c[splitAxis] < b.c[splitAxis];
+                          });
+      }
+
+      BuildNode(items, begin, mid, depth+1);
+      const int second = BuildNode(items, mid, end, depth+1);
+      nodes[index].offset = second;
+      nodes[index].count  = 0;
+      nodes[index].axis   = int16_t(splitAxis);
+      return index;
+   }
+
+   void MakeLeaf(const std::vector<BuildItem>& items, int begin, int end, int index) {
+      nodes[index].offset = int32_t(ids.size());
+      nodes[index].count  = int16_t(end - begin);
+      nodes[index].axis   = 0;
+      for(int i=begin; i<end; ++i) {
+         const Sphere& s = (*spheres)[items[i].id];
+         cx.push_back(s.c.x);
+         cy.push_back(s.c.y);
+         cz.push_back(s.c.z);
+         r.push_back(s.r);
+         ids.push_back(items[i].id);
+      }
+   }
+};
+
+/* 'Intersect' routine using the BVH. Same interface and result as the
+ * linear 'Intersect' over the vector of spheres.
+ */
+inline bool Intersect(const SphereBVH& bvh, const Ray &r, double &t, int &id) {
+   const double inf = t = 1e20;
+   if(bvh.nodes.empty()) {
+      return false;
+   }
+
+   // Small scenes are a single leaf: skip the box test.
+   int hit = -1;
+   if(bvh.nodes[0].count > 0) {
+      bvh.IntersectLeaf(bvh.nodes[0], r, t, hit);
+      if(hit >= 0) { id = hit; }
+      return t<inf;
+   }
+
+   double inv[3];
+   SphereBVH::InverseDirection(r.d, inv);
+
+   int stack[SphereBVH::StackSize];
+   int top = 0, node = 0;
+   while(true) {
+      const SphereBVH::Node& n = bvh.nodes[node];
+      if(SphereBVH::Slab(n, r.o, inv, t)) {
+         if(n.count > 0) {
+            bvh.IntersectLeaf(n, r, t, hit);
+         } else {
+            // Visit the child on the side of the origin first.
+            int first = node+1, second = n.offset;
+            if(inv[n.axis] < 0.0) { std::swap(first, second); }
+            stack[top++] = second;
+            node = first;
+            continue;
+         }
+      }
+      if(top == 0) { break; }
+      node = stack[--top];
+   }
+
+   if(hit >= 0) { id = hit; }
+   return t<inf;
+}
+
+/* 'IntersectPacket' routine for a packet of 'N' coherent rays (at most
+ * 'SphereBVH::MaxPacketSize'), like the primary rays of a tile of pixels.
+ * The rays traverse the tree together: a node is visited if any active ray
+ * hits its box, which amortizes the node fetches over the packet, and the
+ * spheres of a leaf are tested in SIMD lanes over the rays. The result of
+ * each ray is the one of 'Intersect': 'hit[k]' tells if ray 'k' hit a
+ * sphere, in which case 't[k]' and 'id[k]' are set.
+ */
+template<int N>
+inline void IntersectPacket(const SphereBVH& bvh, const RayPacket<N>& rays,
+                            double* t, int* id, bool* hit) {
+   static_assert(N <= SphereBVH::MaxPacketSize, "Packet too large for the active mask");
+   int hitId[N];
+   double inv[N][3];
+   for(int k=0; k<N; ++k) {
+      t[k] = 1e20;
+      hitId[k] = -1;
+      SphereBVH::InverseDirection(Vector(rays.dx[k], rays.dy[k], rays.dz[k]), inv[k]);
+   }
+
+   int stack[SphereBVH::StackSize];
+   int top = 0, node = 0;
+   while(!bvh.nodes.empty()) {
+      const SphereBVH::Node& nd = bvh.nodes[node];
+
+      uint64_t active = 0;
+      for(int k=0; k<N; ++k) {
+         const Vector o(rays.ox[k], rays.oy[k], rays.oz[k]);
+         if(SphereBVH::Slab(nd, o, inv[k], t[k])) {
+            active |= uint64_t(1) << k;
+         }
+      }
+
+      if(active != 0) {
+         if(nd.count > 0) {
+            bvh.IntersectLeaf(nd, rays, active, t, hitId);
+         } else {
+            // Order the children using the direction of the first active
+            // ray: the rays of a coherent packet share its sign.
+            int first = node+1, second = nd.offset;
+            int lead = 0;
+            while(!(active & (uint64_t(1) << lead))) { ++lead; }
+            if(inv[lead][nd.axis] < 0.0) { std::swap(first, second); }
+            stack[top++] = second;
+            node = first;
+            continue;
+         }
+      }
+      if(top == 0) { break; }
+      node = stack[--top];
+   }
+
+   for(int k=0; k<N; ++k) {
+      hit[k] = hitId[k] >= 0;
+      if(hit[k]) { id[k] = hitId[k]; }
+   }
+}
@@ -2,6 +2,7 @@
 
 // Include STL
 #define _USE_MATH_DEFINES
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <string>
@@ -45,7 +46,7 @@ struct Vector {
       r = 2*dot*n - w;
       return r;
    }
-   Vector Multiply(const Vector& m) {
+   Vector Multiply(const Vector& m) const {
       Vector r;
       r.x = this->x * m.x;
       r.y = this->y * m.y;
@@ -238,48 +239,60 @@ inline bool Intersect(const std::vector<Sphere>& spheres, const Ray &r, double &
    return t<inf;
 }
 
+// SIMD kernels and BVH over the spheres, with the same 'Intersect' interface
+#include "packet.hpp"
+#include "bvh.hpp"
+
 /* 'Radiance' evaluate the RGB throughput using path tracing with no explicit
  * connection to the light. This is a very crude way to do it, but it is the simplest
  * to rapidly prototype in practice. This code assumes that light sources do not
- * scatter light.
+ * scatter light. 'Scene' is either the vector of spheres or a 'SphereBVH'.
+ *
+ * The path is traced iteratively and the BSDF weights of its vertices are
+ * accumulated forward in the throughput 'beta', so the depth of the path is
+ * only bounded by 'maxdepth'.
  */
-Vector Radiance(const std::vector<Sphere>& spheres,
+template<class Scene>
+Vector Radiance(const Scene& spheres,
                 const Ray &r,
                 Random& rng,
                 int depth,
                 int maxdepth=1) {
-   double t;                               // distance to intersection
-   int id=0;                               // id of intersected object
-   if (!Intersect(spheres, r, t, id)) return Vector(); // if miss, return black
-   const Sphere&   obj = spheres[id];      // the hit object
-   const Material& mat = obj.mat;          // Its material
-
-   Vector x  = r.o+r.d*t;
-   Vector n  = (x-obj.c).Normalize();
-   Vector nl = (Vector::Dot(n, r.d) < 0.f) ? n : (-1.f)*n;
-
-   // If the object is a source return radiance
-   if(!mat.ke.IsNull()) {
-      return mat.ke;
-
-   // Terminate the recursion after a finite number of call
-   } else if(depth > maxdepth) {
-      return Vector();
-
-   // Ray shooting
-   } else {
+   Vector beta(1,1,1);
+   Ray ray = r;
+   for(; ; ++depth) {
+      double t;                               // distance to intersection
+      int id=0;                               // id of intersected object
+      if (!Intersect(spheres, ray, t, id)) break; // if miss, return black
+      const Sphere&   obj = spheres[id];      // the hit object
+      const Material& mat = obj.mat;          // Its material
+
+      Vector x  = ray.o+ray.d*t;
+      Vector n  = (x-obj.c).Normalize();
+      Vector nl = (Vector::Dot(n, ray.d) < 0.f) ? n : (-1.f)*n;
+
+      // If the object is a source return radiance
+      if(!mat.ke.IsNull()) {
+         return beta.Multiply(mat.ke);
+
+      // Terminate the path after a finite number of bounces
+      } else if(depth > maxdepth) {
+         break;
+      }
+
+      // Ray shooting
       double pdf = 0.f;
       const auto e  = Vector(rng(), rng(), rng());
-      const auto wo = -r.d;
+      const auto wo = -ray.d;
       const auto wi = mat.Sample(wo, nl, e, pdf);
       if(Vector::Dot(wo, nl) <= 0.f || pdf <= 0.f) {
-      	 return Vector();
+         break;
       }
-      auto f = Vector::Dot(wi, nl)*mat.Reflectance(wi, wo, nl);
-      const Vector rad = Radiance(spheres, Ray(x, wi), rng, depth+1, maxdepth);
-
-      return (1.f/pdf) * f.Multiply(rad);
+      const auto f = Vector::Dot(wi, nl)*mat.Reflectance(wi, wo, nl);
+      beta = (1.f/pdf) * f.Multiply(beta);
+      ray  = Ray(x, wi);
    }
+   return Vector();
 }
 
 // Covariance Tracing includes
@@ -302,33 +315,37 @@ std::ostream& operator<<(std::ostream& out, const Cov4D& cov) {
    return out;
 }
 
-PosCov CovarianceFilter(const std::vector<Sphere>& spheres, const Ray &r, const Cov4D& cov, int depth, int maxdepth=2) {
-   double t;                               // distance to Intersection
-   int id=0;                               // id of Intersected object
-   if (!Intersect(spheres, r, t, id)) return PosCov(Vector(), Cov4D()); // if miss, return black
-   const Sphere&   obj = spheres[id];      // the hit object
-   const Material& mat = obj.mat;          // Its material
-   Vector x  = r.o+r.d*t,
-          n  = (x-obj.c).Normalize(),
-          nl = Vector::Dot(n,r.d) < 0 ? n:n*-1;
-   const double k = 1.f/spheres[id].r;
-
-   // Update the covariance with travel and project it onto the tangent plane
-   // of the hit object.
+template<class Scene>
+PosCov CovarianceFilter(const Scene& spheres, const Ray &r, const Cov4D& cov, int depth, int maxdepth=2) {
+   // The covariance is carried forward along the path: the recursion is a
+   // loop.
+   Ray   ray  = r;
    Cov4D cov2 = cov;
-   cov2.Travel(t);
-   cov2.Projection(n);
-
-   // if the max depth is reached
-   if(depth >= maxdepth) {
-      cov2.matrix[1] = - cov2.matrix[1];
-      return PosCov(x, cov2);
-   } else {
+   for(; ; ++depth) {
+      double t;                               // distance to Intersection
+      int id=0;                               // id of Intersected object
+      if (!Intersect(spheres, ray, t, id)) return PosCov(Vector(), Cov4D()); // if miss, return black
+      const Sphere&   obj = spheres[id];      // the hit object
+      const Material& mat = obj.mat;          // Its material
+      Vector x  = ray.o+ray.d*t,
+             n  = (x-obj.c).Normalize(),
+             nl = Vector::Dot(n,ray.d) < 0 ? n:n*-1;
+      const double k = 1.f/spheres[id].r;
+
+      // Update the covariance with travel and project it onto the tangent plane
+      // of the hit object.
+      cov2.Travel(t);
+      cov2.Projection(n);
+
+      // if the max depth is reached
+      if(depth >= maxdepth) {
+         cov2.matrix[1] = - cov2.matrix[1];
+         return PosCov(x, cov2);
+      }
 
       // Sample a new direction
-      auto wi = -r.d;
+      auto wi = -ray.d;
       auto wr = 2*Vector::Dot(wi, nl)*nl - wi;
-      auto r2 = Ray(x, wr);
 
       cov2.Curvature(k, k);
       cov2.Cosine(1.0f);
@@ -337,56 +354,165 @@ PosCov CovarianceFilter(const std::vector<Sphere>& spheres, const Ray &r, const
       cov2.Reflection(rho, rho);
       cov2.Curvature(-k, -k);
       cov2.InverseProjection(wr);
-      return CovarianceFilter(spheres, r2, cov2, depth+1, maxdepth);
+      ray = Ray(x, wr);
    }
 }
 
-// TinyEXR includes
-#define TINYEXR_IMPLEMENTATION
-#include <tinyexr/tinyexr.h>
-
-int SaveEXR(const Vector* img, int w, int h, const std::string& filename) {
-   EXRImage image;
-   InitEXRImage(&image);
-   image.num_channels  = 3;
-   const char* names[] = {"B", "G", "R"};
-
-    std::vector<float> images[3];
-    images[0].resize(w * h);
-    images[1].resize(w * h);
-    images[2].resize(w * h);
-
-    for (int i = 0; i < w * h; i++) {
-      images[0][i] = img[i].x;
-      images[1][i] = img[i].y;
-      images[2][i] = img[i].z;
-    }
-
-    float* image_ptr[3];
-    image_ptr[0] = &(images[2].at(0)); // B
-    image_ptr[1] = &(images[1].at(0)); // G
-    image_ptr[2] = &(images[0].at(0)); // R
-
-    image.channel_names = names;
-    image.images = (unsigned char**)image_ptr;
-    image.width = w;
-    image.height = h;
-    image.compression = TINYEXR_COMPRESSIONTYPE_ZIP;
-
-    image.pixel_types = (int *)malloc(sizeof(int) * image.num_channels);
-    image.requested_pixel_types = (int *)malloc(sizeof(int) * image.num_channels);
-    for (int i = 0; i < image.num_channels; i++) {
-      image.pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT; // pixel type of input image
-      image.requested_pixel_types[i] = TINYEXR_PIXELTYPE_HALF; // pixel type of output image to be stored in .EXR
-    }
-
-    const char* err;
-    int ret = SaveMultiChannelEXRToFile(&image, filename.c_str(), &err);
-    if (ret != 0) {
-      fprintf(stderr, "Save EXR err: %s\n", err);
-    }
-
-    free(image.pixel_types);
-    free(image.requested_pixel_types);
-    return ret;
+/* Vertex of a path stored by 'TraceCovariance': everything the backward
+ * pass needs to apply the BSDF weight and the covariance operators of the
+ * vertex once the radiance and covariance of the rest of the path are known.
+ */
+struct PathVertex {
+   Vector nl;     // Normal facing the incoming ray
+   Vector wo;     // Direction toward the previous vertex
+   Vector f;      // BSDF times cosine of the sampled direction
+   double k;      // Curvature of the surface
+   double rho;    // Covariance of the BRDF
+   double t;      // Distance from the previous vertex
+   double pdf;    // Density of the sampled direction
+   double q;      // Probability to survive the Russian roulette
+};
+
+/* Radiance and covariance of a path traced by 'TraceCovariance', with the
+ * distance to and the id of its first hit (-1 for a miss).
+ */
+template<class Cov>
+struct PathSample {
+   Vector rad;
+   Cov    cov;
+   double t  = 0.0;
+   int    id = -1;
+};
+
+/* Customization points of 'TraceCovariance'. The default traces the paths
+ * of 'Radiance' without instrumentation. 'BeginCov' and 'EndCov' surround
+ * the covariance operators, 'ops' being the number of operators applied.
+ */
+struct PathHooks {
+   template<class Scene>
+   bool Intersect(const Scene& spheres, const Ray& r, double& t, int& id) {
+      return ::Intersect(spheres, r, t, id);
+   }
+   // Spatial covariance of a source hit at 'depth'
+   double SourceCovariance(int depth) const { return 1.0E2; }
+   // Radiance of a path whose direction sampling failed
+   Vector SamplingFailed(double pdf) const { return Vector(); }
+   void BeginCov() {}
+   void EndCov(int ops) {}
+};
+
+/* Iterative covariance path tracer. The path is traced forward and its
+ * vertices are pushed on a stack. Then the radiance and the covariance of
+ * the end of the path (a source, a miss or a terminated path) are carried
+ * backward through the stack with 'SurfaceInteraction'.
+ *
+ * After 'rrDepth' bounces (-1 to disable it), the path survives with a
+ * probability given by the largest component of its throughput, and its
+ * radiance is divided by this probability. 'rng' returns uniform numbers
+ * in [0,1). The covariance is only traced when 'useCov' is set.
+ */
+template<class Cov, class Scene, class Rng, class Hooks = PathHooks>
+PathSample<Cov> TraceCovariance(const Scene& spheres, Ray r, Rng& rng,
+                                int maxDepth, int rrDepth = -1,
+                                bool useCov = true, Hooks hooks = Hooks()) {
+   // Per thread to keep the memory of the vertices between calls. The
+   // stack grows with the depth of the paths.
+   static thread_local std::vector<PathVertex> stack;
+   stack.clear();
+
+   PathSample<Cov> sample;
+   Vector beta(1,1,1);
+   for(int depth=0; ; ++depth) {
+      double t;                               // distance to intersection
+      int id=0;                               // id of intersected object
+      if (!hooks.Intersect(spheres, r, t, id)) break; // if miss, return black
+      const Sphere&   obj = spheres[id];      // the hit object
+      const Material& mat = obj.mat;          // Its material
+      if(depth == 0) { sample.t = t; sample.id = id; }
+
+      Vector x  = r.o+r.d*t;
+      Vector n  = (x-obj.c).Normalize();
+      Vector nl = (Vector::Dot(n, r.d) < 0.f) ? n : (-1.f)*n;
+
+      /* Local Frame at the surface of the object */
+      Vector w = nl;
+      Vector u = Vector::Cross((fabs(w.x) > .1 ? Vector(0,1,0) : Vector(1,0,0)), w).Normalize();
+      Vector v = Vector::Cross(w, u);
+
+      // The end of a path sets the covariance of the lightfield leaving it
+      // toward 'wo', after a travel of 'd'.
+      auto end = [&](double sxx, const Vector& wo, double d, int ops) {
+         if(!useCov) return;
+         hooks.BeginCov();
+         sample.cov = Cov({ sxx, 0.0, sxx, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }, u, v, w);
+         sample.cov.InverseProjection(wo);
+         if(d > 0.0) { sample.cov.Travel(d); }
+         hooks.EndCov(ops);
+      };
+
+      // Source with a bounded spatial extent.
+      if(!mat.ke.IsNull()) {
+         end(hooks.SourceCovariance(depth), -r.d, t, 2);
+         sample.rad = mat.ke;
+         break;
+
+      // Terminate the path after a finite number of bounces.
+      } else if(depth > maxDepth) {
+         end(0.0, -r.d, 0.0, 1);
+         break;
+      }
+
+      /* Sampling a new direction */
+      double pdf = 0.f;
+      const auto e  = Vector(rng(), rng(), rng());
+      const auto wo = -r.d;
+      const auto wi = mat.Sample(wo, nl, e, pdf);
+      if(Vector::Dot(wo, nl) <= 0.f || pdf <= 0.f) {
+         end(0.0, wo, 0.0, 1);
+         sample.rad = hooks.SamplingFailed(pdf);
+         break;
+      }
+      auto f = Vector::Dot(wi, nl)*mat.Reflectance(wi, wo, nl);
+
+      // Russian roulette. The throughput is updated at every bounce, and
+      // the roulette only starts at 'rrDepth'. A terminated path ends at
+      // this vertex like a path reaching the maximum depth.
+      double q = 1.0;
+      beta = (1.0/pdf) * f.Multiply(beta);
+      if(rrDepth >= 0 && depth >= rrDepth) {
+         q = std::min(1.0, std::max(beta.x, std::max(beta.y, beta.z)));
+         if(rng() >= q) {
+            end(0.0, wo, 0.0, 1);
+            break;
+         }
+         beta = (1.0/q) * beta;
+      }
+
+      stack.emplace_back();
+      PathVertex& vertex = stack.back();
+      vertex.nl  = nl;
+      vertex.wo  = wo;
+      vertex.f   = f;
+      vertex.k   = 1.f/obj.r;
+      vertex.rho = mat.exponent / (4*M_PI*M_PI); // TODO correct the formula
+      vertex.t   = t;
+      vertex.pdf = pdf;
+      vertex.q   = q;
+      r = Ray(x, wi);
+   }
+
+   // Backward pass: apply the vertices from the end of the path.
+   for(int i=int(stack.size())-1; i>=0; --i) {
+      const PathVertex& vertex = stack[i];
+      if(useCov) {
+         hooks.BeginCov();
+         sample.cov.SurfaceInteraction(vertex.nl, vertex.k, vertex.wo, vertex.rho, vertex.rho, vertex.t);
+         hooks.EndCov(8);
+      }
+      sample.rad = (1.f/vertex.pdf) * vertex.f.Multiply(sample.rad);
+      if(vertex.q < 1.0) {
+         sample.rad = (1.0/vertex.q) * sample.rad;
+      }
+   }
+   return sample;
 }
@@ -0,0 +1,176 @@
+#pragma once
+
+// Include STL
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Local includes
+#include "common.hpp"
+
+// For 'COV_SIMD'
+#include <Covariance/Matrix.hpp>
+
+/* SIMD ray-sphere intersection kernels.
+ *
+ * The kernels evaluate 'Sphere::Intersect' without branches on
+ * structure-of-arrays data, either for one ray against several spheres or
+ * for a packet of rays against one sphere. Each lane performs the same
+ * operations in the same order as the scalar code, so the distances match
+ * bit-for-bit unless the compiler reassociates them differently (e.g.
+ * '-ffast-math' with FMA contraction).
+ */
+
+/* Distance to the sphere of center 'c' and radius 'r' along the ray of
+ * origin 'o' and direction 'd', 0 if there is no hit.
+ */
+inline double IntersectLane(double cx, double cy, double cz, double r,
+                            double ox, double oy, double oz,
+                            double dx, double dy, double dz) {
+   const double eps = 1e-4;
+   const double opx = cx-ox, opy = cy-oy, opz = cz-oz;
+   const double b   = opx*dx + opy*dy + opz*dz;
+   const double det = b*b - (opx*opx + opy*opy + opz*opz) + r*r;
+   const double s   = std::sqrt(std::max(det, 0.0));
+   const double t0  = b-s, t1 = b+s;
+   const double t   = (t0 > eps) ? t0 : ((t1 > eps) ? t1 : 0.0);
+   return (det < 0.0) ? 0.0 : t;
+}
+
+/* Intersect one ray with the 'n' spheres stored in 'cx', 'cy', 'cz' and
+ * 'r'. The distances are written in 'd'.
+ */
+inline void IntersectSpheres(const double* cx, const double* cy, const double* cz,
+                             const double* r, int n, const Ray& ray, double* d) {
+   const double ox = ray.o.x, oy = ray.o.y, oz = ray.o.z;
+   const double dx = ray.d.x, dy = ray.d.y, dz = ray.d.z;
+   COV_SIMD
+   for(int k=0; k<n; ++k) {
+      d[k] = IntersectLane(cx[k], cy[k], cz[k], r[k], ox, oy, oz, dx, dy, dz);
+   }
+}
+
+/* Keep the closest hit, with the tie-break of the linear 'Intersect': for
+ * spheres hit at the same distance, the largest index wins. A distance of
+ * 0 (no hit) or above 1e20 is ignored.
+ */
+inline void ClosestHit(double d, int i, double& t, int& id) {
+   if(d > 0.0 && d < 1e20 && (d < t || (d == t && i > id))) {
+      t = d; id = i;
+   }
+}
+
+
+////////////////////////
+//    Ray packets     //
+////////////////////////
+
+/* Packet of 'N' rays in structure-of-arrays layout. 'N' is typically 4, 8
+ * or 16 to fill the SIMD registers.
+ */
+template<int N>
+struct RayPacket {
+   alignas(64) double ox[N];
+   alignas(64) double oy[N];
+   alignas(64) double oz[N];
+   alignas(64) double dx[N];
+   alignas(64) double dy[N];
+   alignas(64) double dz[N];
+
+   void Set(int k, const Ray& r) {
+      ox[k] = r.o.x; oy[k] = r.o.y; oz[k] = r.o.z;
+      dx[k] = r.d.x; dy[k] = r.d.y; dz[k] = r.d.z;
+   }
+   Ray Get(int k) const {
+      return Ray(Vector(ox[k], oy[k], oz[k]), Vector(dx[k], dy[k], dz[k]));
+   }
+};
+
+/* Intersect the packet 'rays' with the sphere of center 'c' and radius 'r'
+ * and write the distances in 'd'.
+ */
+template<int N>
+inline void IntersectSphere(const RayPacket<N>& rays, double cx, double cy,
+                            double cz, double r, double* d) {
+   COV_SIMD
+   for(int k=0; k<N; ++k) {
+      d[k] = IntersectLane(cx, cy, cz, r, rays.ox[k], rays.oy[k], rays.oz[k],
+                           rays.dx[k], rays.dy[k], rays.dz[k]);
+   }
+}
+
+
+////////////////////////
+//   SoA sphere set   //
+////////////////////////
+
+/* Geometry of a vector of spheres in structure-of-arrays layout. Like
+ * 'SphereBVH', it gives access to the spheres with 'operator[]' and can
+ * replace the vector in the routines templated on the scene.
+ */
+struct SphereSoA {
+   std::vector<double> cx, cy, cz, r;
+   const std::vector<Sphere>* spheres;
+
+   SphereSoA(const std::vector<Sphere>& spheres) : spheres(&spheres) {
+      for(const Sphere& s : spheres) {
+         cx.push_back(s.c.x);
+         cy.push_back(s.c.y);
+         cz.push_back(s.c.z);
+         r.push_back(s.r);
+      }
+   }
+
+   const Sphere& operator[](int i) const {
+      return (*spheres)[i];
+   }
+   size_t size() const {
+      return r.size();
+   }
+};
+
+/* 'Intersect' routine of one ray against all the spheres of 'scene', in
+ * SIMD lanes over the spheres. Same interface and result as the linear
+ * 'Intersect'.
+ */
+inline bool Intersect(const SphereSoA& scene, const Ray &r, double &t, int &id) {
+   const int Chunk = 16;
+   const double inf = t = 1e20;
+   int hit = -1;
+   double d[Chunk];
+   for(int i=0; i<int(scene.size()); i+=Chunk) {
+      const int n = std::min(Chunk, int(scene.size()) - i);
+      IntersectSpheres(&scene.cx[i], &scene.cy[i], &scene.cz[i], &scene.r[i], n, r, d);
+      for(int k=0; k<n; ++k) {
+         ClosestHit(d[k], i+k, t, hit);
+      }
+   }
+   if(hit >= 0) { id = hit; }
+   return t<inf;
+}
+
+/* 'IntersectPacket' routine of a packet of rays against all the spheres of
+ * 'scene', in SIMD lanes over the rays. The result of each ray is the one
+ * of 'Intersect': 'hit[k]' tells if ray 'k' hit a sphere, in which case
+ * 't[k]' and 'id[k]' are set.
+ */
+template<int N>
+inline void IntersectPacket(const SphereSoA& scene, const RayPacket<N>& rays,
+                            double* t, int* id, bool* hit) {
+   int hitId[N];
+   double d[N];
+   for(int k=0; k<N; ++k) {
+      t[k] = 1e20;
+      hitId[k] = -1;
+   }
+   for(int i=0; i<int(scene.size()); ++i) {
+      IntersectSphere(rays, scene.cx[i], scene.cy[i], scene.cz[i], scene.r[i], d);
+      for(int k=0; k<N; ++k) {
+         ClosestHit(d[k], i, t[k], hitId[k]);
+      }
+   }
+   for(int k=0; k<N; ++k) {
+      hit[k] = hitId[k] >= 0;
+      if(hit[k]) { id[k] = hitId[k]; }
+   }
+}
@@ -1,21 +1,73 @@
 // STL includes
+#include <cctype>
 #include <cstdlib>
 #include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
 #include <random>
+#include <string>
 #include <utility>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 std::default_random_engine gen;
 std::uniform_real_distribution<double> dist(0,1);
 
 // Local includes
 #include "common.hpp"
+#include "exr.hpp"
 
 // Covariance Tracing includes
 #include <Covariance/Covariance4D.hpp>
+#include <Covariance/CovarianceBatch4D.hpp>
+#include <Covariance/Accumulator.hpp>
 using namespace Covariance;
 using Cov    = Covariance4D<Vector, double>;
 using RadCov = std::pair<Vector, Cov>;
 
+/* Render options, see 'Usage'.
+ */
+int  maxDepth  = 1;
+int  rrDepth   = -1;   // Depth at which Russian roulette starts, -1 to disable it
+bool useCov    = true;
+bool recursive = false;
+bool wavefront = false;
+
+/* Per thread counters of the render loop. Time is measured in ticks of the
+ * CPU time stamp counter (or of the steady clock on other architectures) and
+ * is only used as ratios. Each thread writes its own cache line.
+ */
+struct alignas(64) Stats {
+   uint64_t rays   = 0; // Number of rays intersected with the scene
+   uint64_t covOps = 0; // Number of covariance operators applied
+   uint64_t isect  = 0; // Ticks spent in intersection
+   uint64_t cov    = 0; // Ticks spent in covariance tracing
+   uint64_t total  = 0; // Ticks spent in the render loop
+};
+std::vector<Stats> stats(1);
+
+inline Stats& ThreadStats() {
+#ifdef _OPENMP
+   return stats[omp_get_thread_num()];
+#else
+   return stats[0];
+#endif
+}
+
+inline uint64_t Ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+   return __rdtsc();
+#else
+   return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
 
 Material phong(Vector(), Vector(0,0,0), Vector(1,1,1)*.999, 100.0);
 
@@ -30,11 +82,20 @@ std::vector<Sphere> spheres = {
    Sphere(Vector(73,16.5,78),        16.5, Vector(),Vector(1,1,1)*.999),//Glas
    Sphere(Vector(50,681.6-.27,81.6), 600,  Vector(12,12,12),  Vector()) //Lite
 };
+const SphereBVH scene(spheres);
 
-RadCov radiance(const Ray &r, int depth, int maxdepth=1){
+/* Each branch of 'radiance' accounts for the covariance operators it
+ * applies. 'SurfaceInteraction' counts as the eight operators it fuses.
+ */
+RadCov radiance(const Ray &r, int depth){
    double t;                               // distance to intersection
    int id=0;                               // id of intersected object
-   if (!Intersect(spheres, r, t, id)) return RadCov(Vector(), Cov()); // if miss, return black
+   Stats& st = ThreadStats();
+   const uint64_t t0 = Ticks();
+   const bool hit = Intersect(scene, r, t, id);
+   st.isect += Ticks() - t0;
+   st.rays  += 1;
+   if (!hit) return RadCov(Vector(), Cov()); // if miss, return black
    const Sphere&   obj = spheres[id];      // the hit object
    const Material& mat = obj.mat;          // Its material
 
@@ -54,17 +115,29 @@ RadCov radiance(const Ray &r, int depth, int maxdepth=1){
    // is no way here to infer the extent of the source, its frequency is
    // defined as 1.0E5.
    if(!mat.ke.IsNull()) {
-      Cov cov({ 1.0E2, 0.0, 1.0E2, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }, u, v, w);
-      cov.InverseProjection(-r.d);
-      cov.Travel(t);
+      Cov cov;
+      if(useCov) {
+         const uint64_t c0 = Ticks();
+         cov = Cov({ 1.0E2, 0.0, 1.0E2, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }, u, v, w);
+         cov.InverseProjection(-r.d);
+         cov.Travel(t);
+         st.cov    += Ticks() - c0;
+         st.covOps += 2;
+      }
       return RadCov(mat.ke, cov) ;
 
    // Terminate the recursion after a finite number of call. Since this
    // implementation is recursive and passing covariance objects, the
    // number of max bounces is deterministic.
-   } else if(depth > maxdepth) {
-      Cov cov({ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }, u, v, w);
-      cov.InverseProjection(-r.d);
+   } else if(depth > maxDepth) {
+      Cov cov;
+      if(useCov) {
+         const uint64_t c0 = Ticks();
+         cov = Cov({ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }, u, v, w);
+         cov.InverseProjection(-r.d);
+         st.cov    += Ticks() - c0;
+         st.covOps += 1;
+      }
       return RadCov(Vector(), cov) ;
 
    // Main covariance computation. First this code generate a new direction
@@ -77,8 +150,14 @@ RadCov radiance(const Ray &r, int depth, int maxdepth=1){
       const auto wo = -r.d;
       const auto wi = mat.Sample(wo, nl, e, pdf);
       if(Vector::Dot(wo, nl) <= 0.f || pdf <= 0.f) {
-         Cov cov({ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }, u, v, w);
-         cov.InverseProjection(wo);
+         Cov cov;
+         if(useCov) {
+            const uint64_t c0 = Ticks();
+            cov = Cov({ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }, u, v, w);
+            cov.InverseProjection(wo);
+            st.cov    += Ticks() - c0;
+            st.covOps += 1;
+         }
       	 return RadCov(Vector((pdf <= 0.f) ? 1.0 : 0.0,0.0,0.0), cov) ;
       }
       auto f = Vector::Dot(wi, nl)*mat.Reflectance(wi, wo, nl);
@@ -86,23 +165,431 @@ RadCov radiance(const Ray &r, int depth, int maxdepth=1){
 
       /* Covariance computation */
       Cov cov = radcov.second;
-      cov.Projection(nl);
-      cov.Curvature(k, k);
-      cov.Cosine(1.0f);
-      cov.Symmetry();
-      const double rho = mat.exponent / (4*M_PI*M_PI);
-      cov.Reflection(rho, rho); // TODO correct the formula
-      cov.Curvature(-k, -k);
-      cov.InverseProjection(-r.d);
-      cov.Travel(t);
+      if(useCov) {
+         const uint64_t c0 = Ticks();
+         const double rho = mat.exponent / (4*M_PI*M_PI); // TODO correct the formula
+         cov.SurfaceInteraction(nl, k, -r.d, rho, rho, t);
+         st.cov    += Ticks() - c0;
+         st.covOps += 8;
+      }
       return RadCov((1.f/pdf) * f.Multiply(radcov.first), cov);
    }
 }
 
+/* Instrumentation of 'TraceCovariance' with the counters of the thread.
+ * Failed direction samplings are marked in red, as in 'radiance'.
+ */
+struct StatsHooks : PathHooks {
+   Stats&   st = ThreadStats();
+   uint64_t c0 = 0;
+
+   template<class Scene>
+   bool Intersect(const Scene& spheres, const Ray& r, double& t, int& id) {
+      const uint64_t t0 = Ticks();
+      const bool hit = ::Intersect(spheres, r, t, id);
+      st.isect += Ticks() - t0;
+      st.rays  += 1;
+      return hit;
+   }
+   Vector SamplingFailed(double pdf) const {
+      return Vector((pdf <= 0.f) ? 1.0 : 0.0,0.0,0.0);
+   }
+   void BeginCov() { c0 = Ticks(); }
+   void EndCov(int ops) {
+      st.cov    += Ticks() - c0;
+      st.covOps += ops;
+   }
+};
+
+/* Iterative version of 'radiance', using the covariance path tracer of
+ * 'TraceCovariance'. The operations and the use of the random number
+ * generator are the same as the recursive version, which gives the same
+ * image when the Russian roulette is disabled.
+ *
+ * After 'rrDepth' bounces, the path survives with a probability given by
+ * the largest component of its throughput, and its radiance is divided by
+ * this probability.
+ */
+RadCov radianceIterative(Ray r) {
+   auto rng = []() { return dist(gen); };
+   const PathSample<Cov> sample = TraceCovariance<Cov>(scene, r, rng, maxDepth, rrDepth,
+                                                       useCov, StatsHooks());
+   return RadCov(sample.rad, sample.cov);
+}
+
+/* Wavefront version of 'radianceIterative'. Instead of tracing the paths
+ * one after the other, all the paths of a wave (a row of the image) are
+ * traced together, one depth at a time, as separate stages over the queue
+ * of the paths still being traced:
+ *
+ *  1) 'IntersectStage' intersects the rays of the queue with the scene,
+ *     using ray packets for the coherent primary rays.
+ *  2) 'ShadeStage' evaluates the materials, samples the next directions
+ *     and records the vertices of the paths.
+ *  3) 'EndStage' initializes the covariance of the paths terminated at
+ *     this depth in batches of 'CovarianceBatch4D'.
+ *  4) 'CompactStage' removes the terminated paths from the queue.
+ *
+ * The covariance is carried from the end of the paths, so the operators of
+ * the vertices are applied once all paths are terminated, one depth at a
+ * time from the deepest, by 'BackwardStage'.
+ *
+ * The operations are the ones of 'radianceIterative' but the random
+ * numbers are drawn in the order of the stages, which gives a different
+ * (but equally distributed) image.
+ */
+struct Wavefront {
+   static constexpr int BatchSize = 8;
+   using Batch = CovarianceBatch4D<double, BatchSize>;
+
+   // Ray state of the paths, as structure of arrays
+   std::vector<double> ox, oy, oz;
+   std::vector<double> dx, dy, dz;
+   std::vector<double> bx, by, bz; // Throughput for the Russian roulette
+   std::vector<Vector> primary;    // Direction of the primary ray
+
+   // Radiance and covariance of the paths
+   std::vector<Vector> rad;
+   std::vector<Cov>    cov;
+
+   // Queue of the paths still being traced and result of the intersection
+   // stage, per element of the queue.
+   std::vector<int>    queue;
+   std::vector<double> t;
+   std::vector<int>    id;
+   std::vector<char>   hit, alive;
+
+   // Paths terminated at the current depth. Their covariance is set in the
+   // frame (u, v, w) with 'value' as spatial covariance, then projected
+   // along 'dir' and travelled over 'dist'.
+   struct PathEnd {
+      int    path;
+      Vector u, v, w, dir;
+      double value, dist;
+   };
+   std::vector<PathEnd> ends;
+
+   // Vertices of the paths, per depth. The levels grow with the depth of
+   // the paths and keep their memory between waves.
+   std::vector<std::vector<int>>        levelPath;
+   std::vector<std::vector<PathVertex>> levelVertex;
+   int nLevels = 0;
+
+   /* Empty the wave, keeping the memory */
+   void Clear() {
+      for(auto* v : { &ox, &oy, &oz, &dx, &dy, &dz, &bx, &by, &bz }) {
+         v->clear();
+      }
+      primary.clear();
+      for(int l=0; l<nLevels; ++l) {
+         levelPath[l].clear();
+         levelVertex[l].clear();
+      }
+      nLevels = 0;
+   }
+
+   /* Add a path starting with ray 'r' and return its index */
+   int Push(const Ray& r) {
+      ox.push_back(r.o.x); oy.push_back(r.o.y); oz.push_back(r.o.z);
+      dx.push_back(r.d.x); dy.push_back(r.d.y); dz.push_back(r.d.z);
+      bx.push_back(1.0);   by.push_back(1.0);   bz.push_back(1.0);
+      primary.push_back(r.d);
+      return int(primary.size()) - 1;
+   }
+
+   Ray GetRay(int p) const {
+      return Ray(Vector(ox[p], oy[p], oz[p]), Vector(dx[p], dy[p], dz[p]));
+   }
+
+   /* Trace all the paths of the wave */
+   void Trace() {
+      const int n = int(primary.size());
+      rad.assign(n, Vector());
+      cov.assign(n, Cov());
+      queue.resize(n);
+      for(int p=0; p<n; ++p) {
+         queue[p] = p;
+      }
+      for(int depth=0; !queue.empty(); ++depth) {
+         IntersectStage(depth);
+         ShadeStage(depth);
+         EndStage();
+         CompactStage();
+      }
+      BackwardStage();
+   }
+
+   void IntersectStage(int depth) {
+      Stats& st = ThreadStats();
+      const uint64_t t0 = Ticks();
+      const int n = int(queue.size());
+      t.resize(n); id.resize(n); hit.resize(n);
+      if(depth == 0) {
+         // Primary rays are ordered by pixel: intersect them as packets.
+         // The last packet repeats its last ray.
+         RayPacket<BatchSize> rays;
+         double ts[BatchSize]; int ids[BatchSize]; bool hits[BatchSize];
+         for(int k0=0; k0<n; k0+=BatchSize) {
+            for(int k=0; k<BatchSize; ++k) {
+               rays.Set(k, GetRay(queue[std::min(k0+k, n-1)]));
+            }
+            IntersectPacket(scene, rays, ts, ids, hits);
+            for(int k=k0; k<std::min(k0+BatchSize, n); ++k) {
+               t[k] = ts[k-k0]; id[k] = ids[k-k0]; hit[k] = hits[k-k0];
+            }
+         }
+      } else {
+         for(int k=0; k<n; ++k) {
+            hit[k] = Intersect(scene, GetRay(queue[k]), t[k], id[k]);
+         }
+      }
+      st.isect += Ticks() - t0;
+      st.rays  += n;
+   }
+
+   void ShadeStage(int depth) {
+      const int n = int(queue.size());
+      alive.assign(n, 0);
+      ends.clear();
+      for(int k=0; k<n; ++k) {
+         if(!hit[k]) continue;                   // if miss, return black
+         const int p = queue[k];
+         const Ray r = GetRay(p);
+         const Sphere&   obj = spheres[id[k]];  // the hit object
+         const Material& mat = obj.mat;         // Its material
+
+         Vector x  = r.o+r.d*t[k];
+         Vector n  = (x-obj.c).Normalize();
+         Vector nl = (Vector::Dot(n, r.d) < 0.f) ? n : (-1.f)*n;
+
+         /* Local Frame at the surface of the object */
+         Vector w = nl;
+         Vector u = Vector::Cross((fabs(w.x) > .1 ? Vector(0,1,0) : Vector(1,0,0)), w).Normalize();
+         Vector v = Vector::Cross(w, u);
+
+         // Source, see 'radiance'.
+         if(!mat.ke.IsNull()) {
+            rad[p] = mat.ke;
+            ends.push_back({ p, u, v, w, -r.d, 1.0E2, t[k] });
+            continue;
+
+         // Terminate the path after a finite number of bounces.
+         } else if(depth > maxDepth) {
+            ends.push_back({ p, u, v, w, -r.d, 0.0, 0.0 });
+            continue;
+         }
+
+         /* Sampling a new direction */
+         double pdf = 0.f;
+         const auto e  = Vector(dist(gen), dist(gen), dist(gen));
+         const auto wo = -r.d;
+         const auto wi = mat.Sample(wo, nl, e, pdf);
+         if(Vector::Dot(wo, nl) <= 0.f || pdf <= 0.f) {
+            rad[p] = Vector((pdf <= 0.f) ? 1.0 : 0.0,0.0,0.0);
+            ends.push_back({ p, u, v, w, wo, 0.0, 0.0 });
+            continue;
+         }
+         auto f = Vector::Dot(wi, nl)*mat.Reflectance(wi, wo, nl);
+
+         // Russian roulette, see 'radianceIterative'.
+         double q = 1.0;
+         Vector beta = (1.0/pdf) * f.Multiply(Vector(bx[p], by[p], bz[p]));
+         if(rrDepth >= 0 && depth >= rrDepth) {
+            q = std::min(1.0, std::max(beta.x, std::max(beta.y, beta.z)));
+            if(dist(gen) >= q) {
+               ends.push_back({ p, u, v, w, wo, 0.0, 0.0 });
+               continue;
+            }
+            beta = (1.0/q) * beta;
+         }
+         bx[p] = beta.x; by[p] = beta.y; bz[p] = beta.z;
+
+         PathVertex vertex;
+         vertex.nl  = nl;
+         vertex.wo  = wo;
+         vertex.f   = f;
+         vertex.k   = 1.f/obj.r;
+         vertex.rho = mat.exponent / (4*M_PI*M_PI); // TODO correct the formula
+         vertex.t   = t[k];
+         vertex.pdf = pdf;
+         vertex.q   = q;
+         if(depth >= int(levelPath.size())) {
+            levelPath.resize(depth+1);
+            levelVertex.resize(depth+1);
+         }
+         levelPath[depth].push_back(p);
+         levelVertex[depth].push_back(vertex);
+         nLevels = std::max(nLevels, depth+1);
+
+         ox[p] = x.x;  oy[p] = x.y;  oz[p] = x.z;
+         dx[p] = wi.x; dy[p] = wi.y; dz[p] = wi.z;
+         alive[k] = 1;
+      }
+   }
+
+   void EndStage() {
+      if(!useCov || ends.empty()) return;
+      Stats& st = ThreadStats();
+      const uint64_t c0 = Ticks();
+      const int n = int(ends.size());
+      Batch batch;
+      alignas(64) double d[3][BatchSize];
+      alignas(64) double l[BatchSize];
+      for(int k0=0; k0<n; k0+=BatchSize) {
+         // The last batch repeats its last path.
+         for(int i=0; i<BatchSize; ++i) {
+            const PathEnd& end = ends[std::min(k0+i, n-1)];
+            for(int j=0; j<10; ++j) {
+               batch.matrix[j][i] = 0.0;
+            }
+            batch.matrix[0][i] = batch.matrix[2][i] = end.value;
+            batch.x[0][i] = end.u.x; batch.x[1][i] = end.u.y; batch.x[2][i] = end.u.z;
+            batch.y[0][i] = end.v.x; batch.y[1][i] = end.v.y; batch.y[2][i] = end.v.z;
+            batch.z[0][i] = end.w.x; batch.z[1][i] = end.w.y; batch.z[2][i] = end.w.z;
+            d[0][i] = end.dir.x; d[1][i] = end.dir.y; d[2][i] = end.dir.z;
+            l[i] = end.dist;
+         }
+         batch.InverseProjection(d);
+         batch.Travel(l);
+         for(int i=0; i<std::min(BatchSize, n-k0); ++i) {
+            const PathEnd& end = ends[k0+i];
+            batch.Store(i, cov[end.path]);
+            st.covOps += (end.dist > 0.0) ? 2 : 1;
+         }
+      }
+      st.cov += Ticks() - c0;
+   }
+
+   void CompactStage() {
+      int m = 0;
+      for(int k=0; k<int(queue.size()); ++k) {
+         if(alive[k]) { queue[m++] = queue[k]; }
+      }
+      queue.resize(m);
+   }
+
+   /* Apply the vertices from the deepest. Each vertex applies the operators
+    * of 'Covariance4D::SurfaceInteraction' to the covariance of its path.
+    */
+   void BackwardStage() {
+      Stats& st = ThreadStats();
+      Batch batch;
+      alignas(64) double nl[3][BatchSize], wo[3][BatchSize];
+      alignas(64) double k[BatchSize], mk[BatchSize], rho[BatchSize];
+      alignas(64) double wz[BatchSize], l[BatchSize];
+      for(int level=nLevels-1; level>=0; --level) {
+         const std::vector<int>&        paths    = levelPath[level];
+         const std::vector<PathVertex>& vertices = levelVertex[level];
+         const int n = int(paths.size());
+         for(int i=0; i<n; ++i) {
+            const PathVertex& vertex = vertices[i];
+            Vector& r = rad[paths[i]];
+            r = (1.f/vertex.pdf) * vertex.f.Multiply(r);
+            if(vertex.q < 1.0) {
+               r = (1.0/vertex.q) * r;
+            }
+         }
+         if(!useCov) continue;
+
+         const uint64_t c0 = Ticks();
+         for(int k0=0; k0<n; k0+=BatchSize) {
+            // The last batch repeats its last vertex.
+            for(int i=0; i<BatchSize; ++i) {
+               const int j = std::min(k0+i, n-1);
+               const PathVertex& vertex = vertices[j];
+               batch.Load(i, cov[paths[j]]);
+               nl[0][i] = vertex.nl.x; nl[1][i] = vertex.nl.y; nl[2][i] = vertex.nl.z;
+               wo[0][i] = vertex.wo.x; wo[1][i] = vertex.wo.y; wo[2][i] = vertex.wo.z;
+               k[i]   =  vertex.k;
+               mk[i]  = -vertex.k;
+               rho[i] =  vertex.rho;
+               wz[i]  =  1.0;
+               l[i]   =  vertex.t;
+            }
+            batch.Projection(nl);
+            batch.Curvature(k, k);
+            batch.Cosine(wz);
+            batch.Symmetry();
+            batch.Reflection(rho, rho);
+            batch.Curvature(mk, mk);
+            batch.InverseProjection(wo);
+            batch.Travel(l);
+            for(int i=0; i<std::min(BatchSize, n-k0); ++i) {
+               batch.Store(i, cov[paths[k0+i]]);
+            }
+         }
+         st.cov    += Ticks() - c0;
+         st.covOps += 8*uint64_t(n);
+      }
+   }
+};
+
 #include <xmmintrin.h>
 
+void Usage(const char* name) {
+   fprintf(stderr, "Usage: %s [spp] [options]\n"
+           "  -w, --width n      image width (512)\n"
+           "  -h, --height n     image height (512)\n"
+           "  -s, --spp n        samples per pixel, rounded to a multiple of 4 (4)\n"
+           "  -d, --depth n      maximum depth of the paths (1)\n"
+           "  -t, --threads n    number of threads (all)\n"
+           "  -r, --rr n         start the Russian roulette at depth n (off)\n"
+           "  --recursive        use the recursive integrator\n"
+           "  --wavefront        trace the paths of each row together in stages\n"
+           "  --no-cov           disable covariance tracing\n"
+           "  -m, --mode m       output: density, radiance, spatial or angular (density)\n"
+           "  -o, --output f     output EXR file, 'none' to skip it (image.exr)\n",
+           name);
+}
+
 int main(int argc, char** argv){
-   int w=512, h=512, samps = argc==2 ? atoi(argv[1])/4 : 1; // # samples
+   int w=512, h=512, samps=1, threads=0; // # samples per sub-pixel
+   std::string mode = "density", output = "image.exr";
+   for(int k=1; k<argc; ++k) {
+      const std::string arg = argv[k];
+      const bool next = k+1 < argc;
+      if((arg == "-w" || arg == "--width") && next) {
+         w = atoi(argv[++k]);
+      } else if((arg == "-h" || arg == "--height") && next) {
+         h = atoi(argv[++k]);
+      } else if((arg == "-s" || arg == "--spp") && next) {
+         samps = atoi(argv[++k])/4;
+      } else if((arg == "-d" || arg == "--depth") && next) {
+         maxDepth = atoi(argv[++k]);
+      } else if((arg == "-t" || arg == "--threads") && next) {
+         threads = atoi(argv[++k]);
+      } else if((arg == "-r" || arg == "--rr") && next) {
+         rrDepth = atoi(argv[++k]);
+      } else if(arg == "--recursive") {
+         recursive = true;
+      } else if(arg == "--wavefront") {
+         wavefront = true;
+      } else if(arg == "--no-cov") {
+         useCov = false;
+      } else if((arg == "-m" || arg == "--mode") && next) {
+         mode = argv[++k];
+      } else if((arg == "-o" || arg == "--output") && next) {
+         output = argv[++k];
+      } else if(k == 1 && std::isdigit(arg[0])) {
+         samps = atoi(argv[k])/4;
+      } else {
+         Usage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+   if(w <= 0 || h <= 0 || samps <= 0 || maxDepth < 0 ||
+      (mode != "density" && mode != "radiance" && mode != "spatial" && mode != "angular")) {
+      Usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+#ifdef _OPENMP
+   if(threads > 0) { omp_set_num_threads(threads); }
+   threads = omp_get_max_threads();
+#else
+   threads = 1;
+#endif
+   stats.resize(threads);
+
    Ray cam(Vector(50,52,295.6), Vector(0,-0.042612,-1).Normalize()); // cam pos, dir
    cam.o = cam.o + 140.0*cam.d;
    double fovx = 1.2; // 0.5135;
@@ -117,94 +604,168 @@ int main(int argc, char** argv){
 
    // Loop over the rows and columns of the image and evaluate radiance and
    // covariance per pixel using Monte-Carlo.
+   const auto start = std::chrono::steady_clock::now();
    #pragma omp parallel for schedule(dynamic, 1) private(gen)
    for (int y=0; y<h; y++){
-      fprintf(stderr,"\rRendering (%d spp) %5.2f%%",samps*4,100.*y/(h-1));
-      for (unsigned short x=0; x<w; x++) {
+      fprintf(stderr,"\rRendering (%d spp) %5.2f%%",samps*4,100.*y/std::max(h-1, 1));
+      Stats& st = ThreadStats();
+      const uint64_t row = Ticks();
+
+      // In wavefront mode, the paths of the whole row are generated and
+      // traced first, in the order of the pixel loop below.
+      static thread_local Wavefront wave;
+      if(wavefront) {
+         wave.Clear();
+         for (int x=0; x<w; x++) {
+            for (int sy=0; sy<2; sy++) {
+               for (int sx=0; sx<2; sx++) {
+                  for (int s=0; s<samps; s++) {
+                     double r1=2*dist(gen), dx=r1<1 ? sqrt(r1)-1: 1-sqrt(2-r1);
+                     double r2=2*dist(gen), dy=r2<1 ? sqrt(r2)-1: 1-sqrt(2-r2);
+                     Vector d = ncx*fovx*(( (sx+.5 + dx)/2 + x)/w - .5) +
+                                ncy*fovy*(( (sy+.5 + dy)/2 + y)/h - .5) + cam.d;
+                     d.Normalize();
+                     wave.Push(Ray(cam.o, d));
+                  }
+               }
+            }
+         }
+         wave.Trace();
+      }
+
+      for (int x=0, p=0; x<w; x++) {
 
          // Sub pixel sampling
          for (int sy=0, i=(h-y-1)*w+x; sy<2; sy++) {
             for (int sx=0; sx<2; sx++){
 
                Vector _r;
-               Cov _cov;
-
-               for (int s=0; s<samps; s++){
-
-                  // Generate a sub-pixel random position to perform super
-                  // sampling.
-                  double r1=2*dist(gen), dx=r1<1 ? sqrt(r1)-1: 1-sqrt(2-r1);
-                  double r2=2*dist(gen), dy=r2<1 ? sqrt(r2)-1: 1-sqrt(2-r2);
-
-                  // Generate the pixel direction
-                  Vector d = ncx*fovx*(( (sx+.5 + dx)/2 + x)/w - .5) +
-                             ncy*fovy*(( (sy+.5 + dy)/2 + y)/h - .5) + cam.d;
-                  d.Normalize();
-
-                  // Covariance tracing requires to know the pixel frame in order to
-                  // align the orientation of the covariance matrix with respect to
-                  // the image plane. (cx, cy, d) is not a proper frame and we need
-                  // to correct it.
-                  const Vector px = (ncx - Vector::Dot(d, ncx)*d).Normalize(),
-                               py = (ncy - Vector::Dot(d, ncy)*d).Normalize();
-                  const double scaleX = Vector::Norm(ncx) / double(w),
-                               scaleY = Vector::Norm(ncy) / double(h);
-
-                  // Evaluate the Covariance and Radiance at the pixel location
-                  auto radcov = radiance(Ray(cam.o, d), 0);
+               CovarianceAccumulator4D<Vector, double> _acc;
+
+               for (int s=0; s<samps; s++, p++){
+
+                  Vector d;
+                  RadCov radcov;
+                  if(wavefront) {
+                     d      = wave.primary[p];
+                     radcov = RadCov(wave.rad[p], wave.cov[p]);
+                  } else {
+                     // Generate a sub-pixel random position to perform super
+                     // sampling.
+                     double r1=2*dist(gen), dx=r1<1 ? sqrt(r1)-1: 1-sqrt(2-r1);
+                     double r2=2*dist(gen), dy=r2<1 ? sqrt(r2)-1: 1-sqrt(2-r2);
+
+                     // Generate the pixel direction
+                     d = ncx*fovx*(( (sx+.5 + dx)/2 + x)/w - .5) +
+                         ncy*fovy*(( (sy+.5 + dy)/2 + y)/h - .5) + cam.d;
+                     d.Normalize();
+
+                     // Evaluate the Covariance and Radiance at the pixel location
+                     radcov = recursive ? radiance(Ray(cam.o, d), 0)
+                                        : radianceIterative(Ray(cam.o, d));
+                  }
                   auto rad = radcov.first;
                   auto cov = radcov.second;
 
-                  // Orient the covariance and scale it to be in pixel^{-2} and not
-                  // in meter^{-2} or rad^{-2}.
-                  double cr, sr;
-                  cr = Vector::Dot(cov.x, px);
-                  sr = Vector::Dot(cov.x, py);
-                  cov.Rotate(cr, sr);
-                  cov.ScaleU(scaleX);
-                  cov.ScaleV(scaleY);
-
-                  _cov.Add(cov, Vector::Norm(_r), Vector::Norm(rad));
+                  if(useCov) {
+                     const uint64_t c0 = Ticks();
+
+                     // Covariance tracing requires to know the pixel frame in order to
+                     // align the orientation of the covariance matrix with respect to
+                     // the image plane. (cx, cy, d) is not a proper frame and we need
+                     // to correct it.
+                     const Vector px = (ncx - Vector::Dot(d, ncx)*d).Normalize(),
+                                  py = (ncy - Vector::Dot(d, ncy)*d).Normalize();
+                     const double scaleX = Vector::Norm(ncx) / double(w),
+                                  scaleY = Vector::Norm(ncy) / double(h);
+
+                     // Orient the covariance and scale it to be in pixel^{-2} and not
+                     // in meter^{-2} or rad^{-2}.
+                     double cr, sr;
+                     cr = Vector::Dot(cov.x, px);
+                     sr = Vector::Dot(cov.x, py);
+                     cov.Rotate(cr, sr);
+                     cov.ScaleU(scaleX);
+                     cov.ScaleV(scaleY);
+
+                     // Covariances are averaged with the norm of their
+                     // radiance as weight.
+                     _acc.Add(cov, Vector::Norm(rad));
+                     st.cov    += Ticks() - c0;
+                     st.covOps += 4;
+                  }
                   _r = (_r*double(s) + rad)*(1.f/(s+1.f));
                }
+               const Cov _cov = _acc.Covariance();
 
-               // What do you want to see? [Un]comment some of those line to
-               // output a different part of aspect of frequency analysis.
+               // Output of the aspect of frequency analysis selected with
+               // '--mode'.
                Vector c;
-
-               //  1) The angular part of the covariance
-               //c = Vector(std::fabs(_cov.matrix[5]),
-               //           std::fabs(_cov.matrix[8]),
-               //           std::fabs(_cov.matrix[9]));
-               //_cov.AngularFilter(c.x, c.y, c.z);
-
-               //  2) The spatial part of the covariance
-               //c = Vector(std::fabs(_cov.matrix[0]),
-               //           std::fabs(_cov.matrix[1]),
-               //           std::fabs(_cov.matrix[2]));
-               //c = Vector(std::fabs(cr), 0.0, std::fabs(sr));
-               //_cov.SpatialFilter(c.x, c.y, c.z);
-
-               //  3) Predicted sampling density. This is what Belcour et al.
-               //  [2013] used to generate the image space adaptive sampling.
-               double den;
-               den = _cov.matrix[0]*_cov.matrix[2]-pow(_cov.matrix[1], 2);
-               den = sqrt(fmax(den, 0.0));
-               c = Vector(den, den, den);
-
-               //  4) Radiance
-               //c = _r;
+               if(mode == "angular") {
+                  //  1) The angular part of the covariance
+                  c = Vector(std::fabs(_cov.matrix[5]),
+                             std::fabs(_cov.matrix[8]),
+                             std::fabs(_cov.matrix[9]));
+               } else if(mode == "spatial") {
+                  //  2) The spatial part of the covariance
+                  c = Vector(std::fabs(_cov.matrix[0]),
+                             std::fabs(_cov.matrix[1]),
+                             std::fabs(_cov.matrix[2]));
+               } else if(mode == "density") {
+                  //  3) Predicted sampling density. This is what Belcour et al.
+                  //  [2013] used to generate the image space adaptive sampling.
+                  double den;
+                  den = _cov.matrix[0]*_cov.matrix[2]-pow(_cov.matrix[1], 2);
+                  den = sqrt(fmax(den, 0.0));
+                  c = Vector(den, den, den);
+               } else {
+                  //  4) Radiance
+                  c = _r;
+               }
 
                img[i] = img[i] + c*.25;
             }
          }
       }
+      st.total += Ticks() - row;
+   }
+   const auto stop = std::chrono::steady_clock::now();
+   fprintf(stderr, "\n");
+
+   // Report the throughput and the fraction of the render loop spent in
+   // intersection and covariance tracing.
+   Stats sum;
+   for(const auto& st : stats) {
+      sum.rays   += st.rays;
+      sum.covOps += st.covOps;
+      sum.isect  += st.isect;
+      sum.cov    += st.cov;
+      sum.total  += st.total;
    }
+   const double time  = std::chrono::duration<double>(stop - start).count();
+   const double total = std::max<double>(sum.total, 1.0);
+   printf("resolution     : %dx%d\n", w, h);
+   printf("spp            : %d\n", samps*4);
+   printf("max depth      : %d\n", maxDepth);
+   printf("roulette depth : %d\n", rrDepth);
+   printf("integrator     : %s\n", wavefront ? "wavefront" :
+                                    recursive ? "recursive" : "iterative");
+   printf("threads        : %d\n", threads);
+   printf("covariance     : %s\n", useCov ? "on" : "off");
+   printf("time           : %.3f s\n", time);
+   printf("rays           : %llu (%.3f Mrays/s)\n",
+          (unsigned long long)sum.rays, sum.rays / time * 1.0E-6);
+   printf("covariance ops : %llu (%.3f Mops/s)\n",
+          (unsigned long long)sum.covOps, sum.covOps / time * 1.0E-6);
+   printf("isect time     : %.1f%% of the render loop\n", 100.0 * sum.isect / total);
+   printf("cov time       : %.1f%% of the render loop\n", 100.0 * sum.cov / total);
 
    // Output image
-   const auto ret = SaveEXR(img, w, h, "image.exr");
+   int ret = EXIT_SUCCESS;
+   if(output != "none") {
+      ret = SaveEXR(img, w, h, output);
+   }
 
    delete[] img;
    return ret;
 }
-
@@ -2,6 +2,7 @@
 
 // Local includes
 #include "common.hpp"
+#include "exr.hpp"
 
 
 /*****************************************************************************\
@@ -11,7 +12,7 @@
   scene defines also the camera position and the screen resolution.
 
    + 'spheres' contains the list of all objects with sphere geometry and phong
-     materials.
+     materials, and 'scene' the BVH used to intersect them.
 
    + 'width' and 'height' are the horizontal and vertical screen resolutions.
 
@@ -35,6 +36,8 @@ std::vector<Sphere> spheres = {
    Sphere(Vector(50,681.6-.27,81.6), 600,  Vector(12,12,12),  Vector()) //Lite
 };
 
+const SphereBVH scene(spheres);
+
 int width = 512, height = 512;
 
 Ray cam(Vector(50.0f, 46.0f, 155.8f), Vector(0,0,-1));
@@ -44,6 +47,24 @@ Vector  cy  = Vector::Cross(cx, cam.d).Normalize()*fov;
 Vector ncx  = 1.0/Vector::Norm(cx) * cx;
 Vector ncy  = 1.0/Vector::Norm(cy) * cy;
 
+/* Intersect the rays through the centers of the pixels [x0, x0+PacketSize)
+ * of row 'y' as a packet (see 'IntersectPacket'). Pixels past the end of
+ * the row repeat the last pixel.
+ */
+const int PacketSize = 8;
+
+void PrimaryHits(int x0, int y, RayPacket<PacketSize>& rays, double* t, bool* hit) {
+   int id[PacketSize];
+   for(int k=0; k<PacketSize; ++k) {
+      const int x = std::min(x0+k, width-1);
+      Vector d = cx*((0.5 + x)/width  - .5) +
+                 cy*((0.5 + y)/height - .5) + cam.d;
+      d.Normalize();
+      rays.Set(k, Ray(cam.o, d));
+   }
+   IntersectPacket(scene, rays, t, id, hit);
+}
+
 
 
 /*****************************************************************************\
@@ -103,7 +124,7 @@ using PosFilter = std::pair<Vector, Vector>;
 PosFilter indirect_filter(const Ray &r, Random& rng, int depth, int maxdepth=2){
    double t;                               // distance to Intersection
    int id=0;                               // id of Intersected object
-   if (!Intersect(spheres, r, t, id)) return PosFilter(Vector(), Vector()); // if miss, return black
+   if (!Intersect(scene, r, t, id)) return PosFilter(Vector(), Vector()); // if miss, return black
    const Sphere&   obj = spheres[id];      // the hit object
    const Material& mat = obj.mat;          // Its material
    Vector x  = r.o+r.d*t,
@@ -167,31 +188,33 @@ void BruteForceTexture(int x, int y, int samps = 1000) {
    for (int y=0; y<height; y++){
       float max_temp = 0.0f;
 
-      for (int x=0; x<width; x++) {
-         int i=(width-x-1)*height+y;
-         float _r = 0.0f;
+      for (int x0=0; x0<width; x0+=PacketSize) {
 
-         // Generate the pixel direction
-         Vector d = cx*((0.5 + x)/width  - .5) +
-                    cy*((0.5 + y)/height - .5) + cam.d;
-         d.Normalize();
+         // Intersect the primary rays of the next pixels together
+         RayPacket<PacketSize> rays;
+         double ts[PacketSize]; bool hits[PacketSize];
+         PrimaryHits(x0, y, rays, ts, hits);
 
-         Ray ray(cam.o, d);
-         double t; int id;
-         if(!Intersect(spheres, ray, t, id)){ continue; }
-         Vector hitp = ray.o + t*ray.d;
-
-         for(auto& elem : _filter_elems) {
-            const auto& p = elem.first;
-            const auto  x = Vector::Norm(hitp-p) / filterRadius;
-            _r += (0.3989422804f/filterRadius) * exp(-0.5f * pow(x, 2)) * elem.second.x;
-         }
+         for (int x=x0; x<std::min(x0+PacketSize, width); x++) {
+            int i=(width-x-1)*height+y;
+            float _r = 0.0f;
 
-         const auto scale = 20.f;
-         const auto Nold  = nPassesFilter * samps;
-         const auto Nnew  = (nPassesFilter+1) * samps;
-         ref_img[i] = (ref_img[i]*Nold + scale*_r) / float(Nnew);
-         max_temp   = std::max(ref_img[i], max_temp);
+            if(!hits[x-x0]){ continue; }
+            const Ray ray = rays.Get(x-x0);
+            Vector hitp = ray.o + ts[x-x0]*ray.d;
+
+            for(auto& elem : _filter_elems) {
+               const auto& p = elem.first;
+               const auto  x = Vector::Norm(hitp-p) / filterRadius;
+               _r += (0.3989422804f/filterRadius) * exp(-0.5f * pow(x, 2)) * elem.second.x;
+            }
+
+            const auto scale = 20.f;
+            const auto Nold  = nPassesFilter * samps;
+            const auto Nnew  = (nPassesFilter+1) * samps;
+            ref_img[i] = (ref_img[i]*Nold + scale*_r) / float(Nnew);
+            max_temp   = std::max(ref_img[i], max_temp);
+         }
       }
 
       #pragma omp critical
@@ -238,7 +261,7 @@ void RadianceTexture() {
          d.Normalize();
 
          Ray ray(cam.o, d);
-         Vector radiance = Radiance(spheres, ray, rng, 0, 1);
+         Vector radiance = Radiance(scene, ray, rng, 0, 1);
 
          bcg_img[i] = (float(nPasses)*bcg_img[i] + Vector::Dot(radiance, Vector(1,1,1))/3.0f) / float(nPasses+1);
       }
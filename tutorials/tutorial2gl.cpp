@@ -8,6 +8,10 @@
 #include <sstream>
 #include <thread>
 
+// The covariance texture queries the spatial filter and extent of the same
+// matrix: only invert it once.
+#define COV_CACHE_INVERSE
+
 // Local includes
 #include "common.hpp"
 #include "opengl.hpp"
@@ -15,7 +19,7 @@
 
 std::stringstream sout;
 
-PosCov CovarianceFilter(const std::vector<Sphere>& spheres, const Ray &r,
+PosCov CovarianceFilter(const SphereBVH& spheres, const Ray &r,
                         const Cov4D& cov, int depth, int maxdepth,
                         std::stringstream& out) {
    double t;
@@ -107,55 +111,55 @@ void CovarianceTexture() {
    const auto pixelCov = Cov4D({ 1.0E-5, 0.0, 1.0E-5, 0.0, 0.0, 1.0E-5, 0.0, 0.0, 0.0, 1.0E-5 }, t);
    //*/
    sout.str("");
-   const auto surfCov  = CovarianceFilter(spheres, Ray(cam.o, t), pixelCov, 0, 1, sout);
+   const auto surfCov  = CovarianceFilter(scene, Ray(cam.o, t), pixelCov, 0, 1, sout);
    sout << surfCov.second << std::endl;
    sout << "Volume = " << surfCov.second.Volume() << std::endl;
    sout << std::endl;
 
    double sxx = 0, syy = 0, sxy = 0;
    Vector Dx, Dy;
-   try {
-      surfCov.second.SpatialFilter(sxx, sxy, syy);
-      surfCov.second.SpatialExtent(Dx, Dy);
-      sout << "Spatial filter = [" << sxx << "," << sxy << "; " << sxy << ", " << syy << "]"<< std::endl;
-      sout << "Extent = " << Dx << ", " << Dy << std::endl;
-      sout << "|Dx| = " << Vector::Norm(Dx) << ", |Dy| = " << Vector::Norm(Dy) << std::endl;
-   } catch (...) {
+   if(!surfCov.second.TrySpatialFilter(sxx, sxy, syy) ||
+      !surfCov.second.TrySpatialExtent(Dx, Dy)) {
       std::cout << "Error: incorrect spatial filter" << std::endl;
       sout << surfCov.second << std::endl;
       return;
    }
+   sout << "Spatial filter = [" << sxx << "," << sxy << "; " << sxy << ", " << syy << "]"<< std::endl;
+   sout << "Extent = " << Dx << ", " << Dy << std::endl;
+   sout << "|Dx| = " << Vector::Norm(Dx) << ", |Dy| = " << Vector::Norm(Dy) << std::endl;
 
    // Loop over the rows and columns of the image and evaluate radiance and
    // covariance per pixel using Monte-Carlo.
    #pragma omp parallel for schedule(dynamic, 1)
    for (int y=0; y<height; y++){
-      for (int x=0; x<width; x++) {
-         // Pixel index
-         int i=(width-x-1)*height+y;
-
-         // Generate the pixel direction
-         Vector d = cx*( ( 0.5 + x)/width - .5) +
-                    cy*( ( 0.5 + y)/height - .5) + cam.d;
-         d.Normalize();
-
-         Ray ray(cam.o, d);
-         double t; int id;
-         if(!Intersect(spheres, ray, t, id)){ continue; }
-         Vector hitp = ray.o + t*ray.d;
-
-         // Evaluate the covariance
-         const Vector dx  = surfCov.first - hitp;
-         const Vector dU = Vector(Vector::Dot(dx, surfCov.second.x), Vector::Dot(dx, surfCov.second.y), Vector::Dot(dx, surfCov.second.z));
-         if(useCovFilter) {
-            double bf = dU.x*dU.x*sxx + dU.y*dU.y*syy + 2*dU.x*dU.y*sxy;
-            cov_img[i] = exp(-10.0*dU.z*dU.z) * exp(- 0.5* bf);
-         } else {
-
-            const double du  = Vector::Dot(dU, Dx) / Vector::Norm(Dx);
-            const double dv  = Vector::Dot(dU, Dy) / Vector::Norm(Dy);
-            cov_img[i] = (abs(du) < Vector::Norm(Dx) &&
-                          abs(dv) < Vector::Norm(Dy)) ? exp(-10.0*dU.z*dU.z) : 0.0;
+      for (int x0=0; x0<width; x0+=PacketSize) {
+
+         // Intersect the primary rays of the next pixels together
+         RayPacket<PacketSize> rays;
+         double ts[PacketSize]; bool hits[PacketSize];
+         PrimaryHits(x0, y, rays, ts, hits);
+
+         for (int x=x0; x<std::min(x0+PacketSize, width); x++) {
+            // Pixel index
+            int i=(width-x-1)*height+y;
+
+            if(!hits[x-x0]){ continue; }
+            const Ray ray = rays.Get(x-x0);
+            Vector hitp = ray.o + ts[x-x0]*ray.d;
+
+            // Evaluate the covariance
+            const Vector dx  = surfCov.first - hitp;
+            const Vector dU = Vector(Vector::Dot(dx, surfCov.second.x), Vector::Dot(dx, surfCov.second.y), Vector::Dot(dx, surfCov.second.z));
+            if(useCovFilter) {
+               double bf = dU.x*dU.x*sxx + dU.y*dU.y*syy + 2*dU.x*dU.y*sxy;
+               cov_img[i] = exp(-10.0*dU.z*dU.z) * exp(- 0.5* bf);
+            } else {
+
+               const double du  = Vector::Dot(dU, Dx) / Vector::Norm(Dx);
+               const double dv  = Vector::Dot(dU, Dy) / Vector::Norm(Dy);
+               cov_img[i] = (abs(du) < Vector::Norm(Dx) &&
+                             abs(dv) < Vector::Norm(Dy)) ? exp(-10.0*dU.z*dU.z) : 0.0;
+            }
          }
       }
    }